@@ -4,23 +4,69 @@
     as well ass command arguments, flags, and inpput/output files.
 
     Data Members:
-        cmd_args (char array) ->    command and associated command arguments
+        cmd_args (char array) ->    command and associated command arguments, ends with NULL
         background: (int) ->        flag to keep track of if command is to be run in the background
         input_file: (string) ->     name of input_file 
         output_file: (string) ->    name of output file
+        output_append: (int) ->     1 if output_file was given with >> (or &>>) and is appended to
+        error_file: (string) ->     name of the file stderr is written to (2> or 2>>), or NULL
+        error_append: (int) ->      1 if error_file was given with 2>>
+        error_to_output: (int) ->   STDERR_AFTER_OUTPUT for "> file 2>&1" and &>, STDERR_BEFORE_OUTPUT for
+                                    "2>&1 > file" (stderr keeps the original stdout), otherwise 0
+        output_to_error: (int) ->   STDOUT_AFTER_ERROR for "2> file >&2", STDOUT_BEFORE_ERROR for ">&2 2> file"
+                                    and ">&2" alone, otherwise 0
+        here_string: (string) ->    text given with <<<, fed to stdin followed by a newline, or NULL
+        tee_files: (OutputFile array) -> further > and >> targets after output_file, stdout fans out to all of them
+        tee_count: (int) ->         number of entries in tee_files
+        line: (string) ->           command line as typed (set on the first stage)
+        placement: (Placement pointer) -> CPU affinity, niceness and limits from pin/nice/ionice/ulimit, or NULL
+        program: (Program pointer) -> compiled if/for/while/function/; input of the line, run instead of cmd_args
+        next: (Command pointer) ->  next stage of a pipeline (a | b), NULL for the last stage
 */
 
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#define STDERR_AFTER_OUTPUT 1
+#define STDERR_BEFORE_OUTPUT 2
+#define STDOUT_AFTER_ERROR 1
+#define STDOUT_BEFORE_ERROR 2
+
+struct Placement;
+struct Program;
+
+/*
+    Data Members:
+        name: (string) ->   name of the file
+        append: (int) ->    1 if the file was given with >> and is appended to
+*/
+struct OutputFile
+{
+    char *name;
+    int append;
+};
+
 struct Command
 {
     /* data */
-    char *cmd_args[512];
+    char **cmd_args;
 
     char* input_file;
     char* output_file;
+    int output_append;
+    char *error_file;
+    int error_append;
+    int error_to_output;
+    int output_to_error;
+    char *here_string;
+    struct OutputFile *tee_files;
+    int tee_count;
     int background;
+    char *line;
+    struct Placement *placement;
+    struct Program *program;
+
+    struct Command *next;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+/*
+    This file contains a bump (arena) allocator used while parsing a command line. Every Command struct,
+    argument vector and token string of one input line is carved out of the arena, and the whole arena is
+    reset once the line has run, so parsing does not malloc/free per token and memory stays flat.
+
+    There are five functions in this file:
+        1.) arenaAlloc()
+        2.) arenaStrdup()
+        3.) arenaReset()
+        4.) arenaMark()
+        5.) arenaRewind()
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Size of the first block, enough for any ordinary command line
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+
+/*
+    Data Members:
+        next: (ArenaBlock pointer) ->   next (older) block of the arena
+        size: (size_t) ->               number of usable bytes in data
+        used: (size_t) ->               number of bytes handed out from data
+        data: (char array) ->           memory handed out by arenaAlloc()
+*/
+struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/*
+    Data Members:
+        head: (ArenaBlock pointer) ->   block allocations are currently taken from
+*/
+struct Arena
+{
+    struct ArenaBlock *head;
+};
+
+/*
+    Data Members:
+        block: (ArenaBlock pointer) ->  block that was the head when the mark was taken
+        used: (size_t) ->               bytes used in that block at the time
+*/
+struct ArenaMark
+{
+    struct ArenaBlock *block;
+    size_t used;
+};
+
+// Arena holding everything parsed from the current input line
+struct Arena lineArena = {NULL};
+
+/*  arenaAlloc()
+    Functionality:
+            This function returns size bytes from the arena, aligned to 16 bytes. When the current block is full
+            a new block is chained in front of it, the memory is zero filled like calloc().
+    Parameters:
+            1.) Pointer to Arena struct
+            2.) number of bytes needed
+    Returns:
+            Returns a pointer to the memory. Exits the shell if no memory is left.
+*/
+void *arenaAlloc(struct Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    struct ArenaBlock *block = arena->head;
+    if (block == NULL || block->size - block->used < size)
+    {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(struct ArenaBlock) + block_size);
+        if (block == NULL)
+        {
+            perror("arena malloc()");
+            exit(1);
+        }
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+/*  arenaStrdup()
+    Functionality:
+            This function copies a string into the arena.
+    Parameters:
+            1.) Pointer to Arena struct
+            2.) string to copy
+    Returns:
+            Returns the copy of the string.
+*/
+char *arenaStrdup(struct Arena *arena, const char *source)
+{
+    size_t length = strlen(source) + 1;
+    char *copy = arenaAlloc(arena, length);
+    memcpy(copy, source, length);
+    return copy;
+}
+
+/*  arenaReset()
+    Functionality:
+            This function hands all memory of the arena back at once. Extra blocks chained in for a long line are
+            freed and only the oldest block is kept for the next line.
+    Parameters:
+            1.) Pointer to Arena struct
+    Returns:
+            Does not return anything.
+*/
+void arenaReset(struct Arena *arena)
+{
+    struct ArenaBlock *block = arena->head;
+    if (block == NULL)
+    {
+        return;
+    }
+
+    while (block->next != NULL)
+    {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    block->used = 0;
+    arena->head = block;
+}
+
+/*  arenaMark()
+    Functionality:
+            This function remembers how far the arena is filled, so that arenaRewind() can hand back everything
+            allocated after this point and keep what came before.
+    Parameters:
+            1.) Pointer to Arena struct
+    Returns:
+            Returns the mark.
+*/
+struct ArenaMark arenaMark(struct Arena *arena)
+{
+    struct ArenaMark mark = {arena->head, arena->head != NULL ? arena->head->used : 0};
+    return mark;
+}
+
+/*  arenaRewind()
+    Functionality:
+            This function hands back everything allocated since a mark. Blocks chained in after the mark are freed.
+    Parameters:
+            1.) Pointer to Arena struct
+            2.) mark from arenaMark()
+    Returns:
+            Does not return anything.
+*/
+void arenaRewind(struct Arena *arena, struct ArenaMark mark)
+{
+    while (arena->head != mark.block)
+    {
+        struct ArenaBlock *next = arena->head->next;
+        if (mark.block == NULL && next == NULL)
+        {
+            // Keep the first block of the arena, like arenaReset()
+            arena->head->used = 0;
+            return;
+        }
+        free(arena->head);
+        arena->head = next;
+    }
+    if (mark.block != NULL)
+    {
+        mark.block->used = mark.used;
+    }
+}
+
+#endif
@@ -0,0 +1,1377 @@
+/*
+    This file contains the benchmark harness run by "make bench". It drives a built smallsh through a pty
+    (prompt-to-prompt latency, like a user typing), through stdin (an interactive shell fed from a pipe) and
+    through script files, and measures the hot paths of the shell: parsing, batch against interactive input,
+    expansion, the spawn paths and their latency as the shell grows, redirection bandwidth, pipelines against
+    temp files and with the splice relay, fan-out against tee, background jobs with and without placement and
+    the reaping latency of 10,000 of them, the loop interpreter with and without built ins, globbing, the memo
+    cache, coprocesses, the server mode against sh -c per task and memory use over a million lines. Every metric is measured
+    BENCH_RUNS times and the best run is kept. The shells it starts keep their history (empty at the start of
+    each run) and memo cache in a scratch directory that is removed at the end.
+
+    The results are compared with a baseline JSON file. A metric regresses when it is worse than the baseline
+    by more than the threshold (percent), and the harness then exits with status 1. It does the same when the
+    shell's anonymous memory grows by more than BENCH_MEMORY_LIMIT kilobytes over the million lines of the
+    memory metric, whatever the baseline says. If the baseline does not exist yet, or --record is given, the
+    results are written to it instead. Baselines are specific to a machine, so the file is not kept in the
+    repository.
+
+    With --untraced, the shell is also compared with a build of it made with -DSMALLSH_NO_TRACE. The two are
+    run in turns on the same script and the harness exits with status 1 if tracing, while off, costs more
+    than BENCH_TRACE_LIMIT percent of CPU time.
+
+    Usage:
+        bench [--record] [--threshold PCT] [--only NAME] [--untraced SMALLSH] SMALLSH BASELINE
+
+    There are thirty-three functions in this file:
+        1.) now()
+        2.) writeFile()
+        3.) repeatLines()
+        4.) nestedLoop()
+        5.) compareSamples()
+        6.) samplePercentile()
+        7.) waitChild()
+        8.) clearHistory()
+        9.) startScript()
+        10.) runScript()
+        11.) runStdin()
+        12.) readUntilPrompt()
+        13.) promptLatency()
+        14.) measureBest()
+        15.) benchPrompt()
+        16.) benchParse()
+        17.) benchSpawn()
+        18.) benchBandwidth()
+        19.) benchReap()
+        20.) benchScript()
+        21.) benchServe()
+        22.) benchSpawnLatency()
+        23.) benchMemory()
+        24.) benchShellPerTask()
+        25.) selected()
+        26.) recordMetric()
+        27.) addMetric()
+        28.) reapLatency()
+        29.) traceOverhead()
+        30.) loadBaseline()
+        31.) writeBaseline()
+        32.) compareBaseline()
+        33.) main()
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <pty.h>
+#include <termios.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#define BENCH_RUNS 3
+#define BENCH_MAX_METRICS 64
+#define BENCH_DEFAULT_THRESHOLD 10.0
+
+// Runs of each build per try of the tracing overhead check, tries, and the overhead it allows in percent
+#define BENCH_TRACE_RUNS 9
+#define BENCH_TRACE_TRIES 3
+#define BENCH_TRACE_LIMIT 1.0
+
+// Size of the file copied by the bandwidth metrics, and number of files in the directory the glob metric expands
+#define BENCH_FILE_MB 64
+#define BENCH_GLOB_ENTRIES 1000000
+
+// RSS growth allowed from the first to the last checkpoint of the memory metric, in kilobytes
+#define BENCH_MEMORY_LIMIT 1024
+
+/*
+    Data Members:
+        name: (string) ->               metric name, the key in the baseline file
+        unit: (string) ->               unit shown in the report
+        higher_is_better: (int) ->      1 for rates, 0 for latencies
+        value: (double) ->              measured value
+        baseline: (double) ->           value from the baseline file, or -1 if it has none
+*/
+struct Metric
+{
+    const char *name;
+    const char *unit;
+    int higher_is_better;
+    double value;
+    double baseline;
+};
+
+struct Metric metrics[BENCH_MAX_METRICS];
+int metricCount = 0;
+
+// Shell under test, the same shell built without tracing, scratch directory and the metric selected with --only
+const char *shellPath;
+const char *untracedPath = NULL;
+char scratch[] = "/tmp/smallsh-bench.XXXXXX";
+const char *onlyMetric = NULL;
+
+// Resource usage of the last shell waited for
+struct rusage childUsage;
+
+// Smallest anonymous RSS growth in kilobytes seen by benchMemory(), -1 until it has run
+long memoryGrowth = -1;
+
+/*  now()
+    Functionality:
+            This function reads the monotonic clock.
+    Parameters:
+            N/A
+    Returns:
+            Returns the time in seconds.
+*/
+double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/*  writeFile()
+    Functionality:
+            This function writes a string to a file in the scratch directory.
+    Parameters:
+            1.) file name
+            2.) contents
+    Returns:
+            Returns the path of the file, which the caller frees.
+*/
+char *writeFile(const char *name, const char *text)
+{
+    char *path;
+    if (asprintf(&path, "%s/%s", scratch, name) == -1)
+    {
+        exit(2);
+    }
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    fputs(text, file);
+    fclose(file);
+    return path;
+}
+
+/*  repeatLines()
+    Functionality:
+            This function builds a script: a prefix followed by a line repeated a number of times.
+    Parameters:
+            1.) text before the repeated lines, may be empty
+            2.) line to repeat, without the newline
+            3.) number of repetitions
+    Returns:
+            Returns the script, which the caller frees.
+*/
+char *repeatLines(const char *prefix, const char *line, int count)
+{
+    size_t prefix_length = strlen(prefix);
+    size_t line_length = strlen(line);
+    char *text = malloc(prefix_length + (line_length + 1) * count + 1);
+    memcpy(text, prefix, prefix_length);
+    char *out = text + prefix_length;
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(out, line, line_length);
+        out += line_length;
+        *out++ = '\n';
+    }
+    *out = '\0';
+    return text;
+}
+
+/*  nestedLoop()
+    Functionality:
+            This function builds a script of for loops over the ten digits nested to the given depth, so that
+            the body runs 10^depth times. The variable of the innermost loop is $i.
+    Parameters:
+            1.) depth
+            2.) loop body
+    Returns:
+            Returns the script, which the caller frees.
+*/
+char *nestedLoop(int depth, const char *body)
+{
+    char *text = malloc(depth * 48 + strlen(body) + 8);
+    char *out = text;
+    for (int i = 0; i < depth; i++)
+    {
+        out += sprintf(out, "for %c in 0 1 2 3 4 5 6 7 8 9; do ", i + 1 < depth ? 'a' + i : 'i');
+    }
+    out += sprintf(out, "%s;", body);
+    for (int i = 0; i < depth; i++)
+    {
+        out += sprintf(out, " done%s", i + 1 < depth ? ";" : "\n");
+    }
+    return text;
+}
+
+/*  compareSamples(), samplePercentile()
+    samplePercentile() sorts the samples and returns the one at the given percentile (0-100), compareSamples() is
+    its qsort() callback.
+*/
+int compareSamples(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+double samplePercentile(double *samples, int count, int percentile)
+{
+    qsort(samples, count, sizeof(double), compareSamples);
+    int index = (long)count * percentile / 100;
+    return samples[index < count ? index : count - 1];
+}
+
+/*  waitChild()
+    Functionality:
+            This function waits for a child and checks that it exited normally. Its resource usage is left in
+            childUsage.
+    Parameters:
+            1.) process ID of the child
+            2.) description for the error message
+    Returns:
+            Does not return anything. Exits the harness if the child failed.
+*/
+void waitChild(pid_t pid, const char *what)
+{
+    int status;
+    while (wait4(pid, &status, 0, &childUsage) == -1 && errno == EINTR)
+        ;
+    if (!WIFEXITED(status))
+    {
+        fprintf(stderr, "bench: %s: shell killed by signal %d\n", what, WTERMSIG(status));
+        exit(2);
+    }
+}
+
+/*  clearHistory()
+    Functionality:
+            This function removes the history log and its index from the scratch directory, so that an interactive
+            shell starts every run with an empty history instead of the lines of all the runs before it.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void clearHistory()
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/history", scratch);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/history.idx", scratch);
+    unlink(path);
+}
+
+/*  startScript()
+    Functionality:
+            This function starts the shell under test on a script, with stdout sent to /dev/null. The environment
+            variable given as NAME=value is set for the shell only.
+    Parameters:
+            1.) script
+            2.) environment setting, or NULL
+    Returns:
+            Returns the process ID of the shell.
+*/
+pid_t startScript(const char *script, const char *environment)
+{
+    char *path = writeFile("script.sh", script);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, 1);
+        if (environment != NULL)
+        {
+            putenv((char *)environment);
+        }
+        chdir(scratch);
+        execl(shellPath, shellPath, path, (char *)NULL);
+        _exit(127);
+    }
+    free(path);
+    return pid;
+}
+
+/*  runScript()
+    Functionality:
+            This function runs a script with the shell under test and waits for it (see startScript()).
+    Parameters:
+            1.) script
+            2.) environment setting, or NULL
+    Returns:
+            Returns the wall time in seconds.
+*/
+double runScript(const char *script, const char *environment)
+{
+    double start = now();
+    waitChild(startScript(script, environment), "script.sh");
+    return now() - start;
+}
+
+/*  runStdin()
+    Functionality:
+            This function feeds command lines to an interactive shell through a pipe on its stdin, the way
+            lines are read when no script is given, prompts included.
+    Parameters:
+            1.) command lines
+            2.) environment setting, or NULL
+    Returns:
+            Returns the wall time in seconds.
+*/
+double runStdin(const char *text, const char *environment)
+{
+    char *path = writeFile("input.txt", text);
+    clearHistory();
+    double start = now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int in_fd = open(path, O_RDONLY);
+        int null_fd = open("/dev/null", O_WRONLY);
+        int fds[2];
+        if (pipe(fds) == -1)
+        {
+            _exit(127);
+        }
+
+        // A writer process makes stdin a pipe rather than a file
+        if (fork() == 0)
+        {
+            close(fds[0]);
+            char buffer[65536];
+            ssize_t got;
+            while ((got = read(in_fd, buffer, sizeof(buffer))) > 0)
+            {
+                if (write(fds[1], buffer, got) != got)
+                {
+                    break;
+                }
+            }
+            _exit(0);
+        }
+        close(fds[1]);
+        dup2(fds[0], 0);
+        dup2(null_fd, 1);
+        if (environment != NULL)
+        {
+            putenv((char *)environment);
+        }
+        chdir(scratch);
+        execl(shellPath, shellPath, (char *)NULL);
+        _exit(127);
+    }
+    waitChild(pid, "stdin");
+    double elapsed = now() - start;
+    free(path);
+    return elapsed;
+}
+
+/*  readUntilPrompt()
+    Functionality:
+            This function reads the output of the shell on the pty until it ends with the ":: " prompt.
+    Parameters:
+            1.) master side of the pty
+    Returns:
+            Returns 0, or -1 if the shell stopped writing.
+*/
+int readUntilPrompt(int master)
+{
+    char buffer[4096];
+    char tail[3] = {0, 0, 0};
+    while (1)
+    {
+        ssize_t got = read(master, buffer, sizeof(buffer));
+        if (got <= 0)
+        {
+            return -1;
+        }
+        for (ssize_t i = 0; i < got; i++)
+        {
+            tail[0] = tail[1];
+            tail[1] = tail[2];
+            tail[2] = buffer[i];
+        }
+        if (memcmp(tail, ":: ", 3) == 0)
+        {
+            return 0;
+        }
+    }
+}
+
+/*  promptLatency()
+    Functionality:
+            This function starts the shell on a pty in raw mode and types a command line again and again, timing
+            each line from the moment it is written until the next prompt has been read.
+    Parameters:
+            1.) command line, without the newline
+            2.) number of lines
+    Returns:
+            Returns the median latency in microseconds.
+*/
+double promptLatency(const char *command, int count)
+{
+    struct termios settings;
+    memset(&settings, 0, sizeof(settings));
+    cfmakeraw(&settings);
+    int master;
+    clearHistory();
+    pid_t pid = forkpty(&master, NULL, &settings, NULL);
+    if (pid == -1)
+    {
+        perror("forkpty()");
+        exit(2);
+    }
+    if (pid == 0)
+    {
+        chdir(scratch);
+        execl(shellPath, shellPath, (char *)NULL);
+        _exit(127);
+    }
+
+    double *samples = malloc(count * sizeof(double));
+    size_t length = strlen(command);
+    char *line = malloc(length + 1);
+    memcpy(line, command, length);
+    line[length] = '\n';
+    if (readUntilPrompt(master) == -1)
+    {
+        fprintf(stderr, "bench: no prompt on the pty\n");
+        exit(2);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        double start = now();
+        if (write(master, line, length + 1) != (ssize_t)length + 1 || readUntilPrompt(master) == -1)
+        {
+            fprintf(stderr, "bench: shell stopped answering on the pty\n");
+            exit(2);
+        }
+        samples[i] = now() - start;
+    }
+    if (write(master, "exit\n", 5) != 5)
+    {
+        kill(pid, SIGKILL);
+    }
+    waitChild(pid, "pty");
+    close(master);
+
+    double median = samplePercentile(samples, count, 50) * 1e6;
+    free(samples);
+    free(line);
+    return median;
+}
+
+/*  measureBest()
+    Functionality:
+            This function runs a measurement BENCH_RUNS times and keeps the best value.
+    Parameters:
+            1.) function returning the value of one run
+            2.) argument passed to the function
+            3.) 1 if higher values are better
+    Returns:
+            Returns the best value.
+*/
+double measureBest(double (*measure)(const void *), const void *argument, int higher_is_better)
+{
+    double best = measure(argument);
+    for (int i = 1; i < BENCH_RUNS; i++)
+    {
+        double value = measure(argument);
+        if (higher_is_better ? value > best : value < best)
+        {
+            best = value;
+        }
+    }
+    return best;
+}
+
+/*
+    Data Members:
+        script: (string) ->         script or stdin text to run
+        environment: (string) ->    environment setting for the shell, or NULL
+        units: (double) ->          amount of work in the script (lines, bytes, spawns, ...)
+        use_stdin: (int) ->         1 to feed the text through stdin instead of a script file
+        command: (string) ->        command line typed on the pty, for the prompt metrics
+        count: (int) ->             number of lines typed on the pty, requests or tasks
+        percentile: (int) ->        percentile of the spawn latency reported
+*/
+struct Workload
+{
+    const char *script;
+    const char *environment;
+    double units;
+    int use_stdin;
+    const char *command;
+    int count;
+    int percentile;
+};
+
+/*  benchPrompt(), benchParse(), benchSpawn(), benchBandwidth(), benchReap(), benchScript()
+    Each runs one Workload and returns its value: the median prompt latency in microseconds for
+    benchPrompt(), otherwise the units of work per second (benchBandwidth() reports MB/s).
+*/
+double benchPrompt(const void *argument)
+{
+    const struct Workload *workload = argument;
+    return promptLatency(workload->command, workload->count);
+}
+
+double benchParse(const void *argument)
+{
+    const struct Workload *workload = argument;
+    return workload->units / runStdin(workload->script, workload->environment);
+}
+
+double benchSpawn(const void *argument)
+{
+    const struct Workload *workload = argument;
+    return workload->units / runScript(workload->script, workload->environment);
+}
+
+double benchBandwidth(const void *argument)
+{
+    const struct Workload *workload = argument;
+    return workload->units / runScript(workload->script, workload->environment) / (1 << 20);
+}
+
+double benchReap(const void *argument)
+{
+    return benchSpawn(argument);
+}
+
+double benchScript(const void *argument)
+{
+    const struct Workload *workload = argument;
+    return workload->units / (workload->use_stdin ? runStdin(workload->script, workload->environment)
+                                                  : runScript(workload->script, workload->environment));
+}
+
+/*  benchServe()
+    Functionality:
+            This function starts the shell in server mode and sends it requests over one connection, each
+            answered before the next is sent.
+    Parameters:
+            1.) Pointer to Workload struct, command is the request and count the number of requests
+    Returns:
+            Returns the number of requests per second.
+*/
+double benchServe(const void *argument)
+{
+    const struct Workload *workload = argument;
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s/serve.sock", scratch);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, 1);
+        execl(shellPath, shellPath, "--serve", address.sun_path, (char *)NULL);
+        _exit(127);
+    }
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    for (int tries = 0; connect(sock, (struct sockaddr *)&address, sizeof(address)) == -1; tries++)
+    {
+        if (tries == 500)
+        {
+            fprintf(stderr, "bench: server did not start\n");
+            kill(pid, SIGKILL);
+            exit(2);
+        }
+        usleep(10000);
+    }
+
+    size_t length = strlen(workload->command);
+    char request[256];
+    uint32_t header[2] = {1, length};
+    memcpy(request, header, sizeof(header));
+    memcpy(request + sizeof(header), workload->command, length);
+    double start = now();
+    for (int i = 0; i < workload->count; i++)
+    {
+        char reply[64];
+        if (send(sock, request, sizeof(header) + length, MSG_NOSIGNAL) == -1 || recv(sock, reply, sizeof(reply), 0) <= 0)
+        {
+            fprintf(stderr, "bench: server stopped answering\n");
+            exit(2);
+        }
+    }
+    double elapsed = now() - start;
+    close(sock);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return workload->count / elapsed;
+}
+
+/*  benchSpawnLatency()
+    Functionality:
+            This function runs a script that turns tracing on, spawns commands and dumps the trace to spawn.json,
+            and reads back the length of every "spawn" span: from the start of startCommand() until the child
+            has exec'd the command, on every spawn path.
+    Parameters:
+            1.) Pointer to Workload struct, count is the number of spawns in the script
+    Returns:
+            Returns the spawn latency at the percentile of the workload in microseconds.
+*/
+double benchSpawnLatency(const void *argument)
+{
+    const struct Workload *workload = argument;
+    runScript(workload->script, workload->environment);
+
+    char *path;
+    if (asprintf(&path, "%s/spawn.json", scratch) == -1)
+    {
+        exit(2);
+    }
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    double *samples = malloc(workload->count * sizeof(double));
+    int count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL && count < workload->count)
+    {
+        char *span = strstr(line, "\"cat\": \"spawn\"");
+        char *duration = span != NULL ? strstr(span, "\"dur\": ") : NULL;
+        if (duration != NULL)
+        {
+            samples[count++] = atof(duration + 7);
+        }
+    }
+    fclose(file);
+    free(path);
+    if (count == 0)
+    {
+        fprintf(stderr, "bench: no spawn events in the trace\n");
+        exit(2);
+    }
+    double latency = samplePercentile(samples, count, workload->percentile);
+    free(samples);
+    return latency;
+}
+
+/*  benchMemory()
+    Functionality:
+            This function runs a script that appends the shell's RssAnon to rss.txt at checkpoints along the
+            way. The shell maps its script file, so VmRSS grows with every page of the script it has read and
+            only the anonymous memory shows a leak. The growth from the first checkpoint to the last is kept in
+            memoryGrowth, the smallest of all runs.
+    Parameters:
+            1.) Pointer to Workload struct
+    Returns:
+            Returns the anonymous RSS at the last checkpoint in kilobytes.
+*/
+double benchMemory(const void *argument)
+{
+    const struct Workload *workload = argument;
+    char *path;
+    if (asprintf(&path, "%s/rss.txt", scratch) == -1)
+    {
+        exit(2);
+    }
+    unlink(path);
+    runScript(workload->script, workload->environment);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    long first = -1;
+    long last = -1;
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "RssAnon: %ld", &last) == 1 && first == -1)
+        {
+            first = last;
+        }
+    }
+    fclose(file);
+    free(path);
+    if (last == -1)
+    {
+        fprintf(stderr, "bench: no RSS checkpoints were written\n");
+        exit(2);
+    }
+    if (memoryGrowth < 0 || last - first < memoryGrowth)
+    {
+        memoryGrowth = last - first;
+    }
+    return last;
+}
+
+/*  benchShellPerTask()
+    Functionality:
+            This function starts a new /bin/sh -c for every task, the way tasks are run without the server.
+    Parameters:
+            1.) Pointer to Workload struct, command is the task and count the number of tasks
+    Returns:
+            Returns the number of tasks per second.
+*/
+double benchShellPerTask(const void *argument)
+{
+    const struct Workload *workload = argument;
+    double start = now();
+    for (int i = 0; i < workload->count; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(null_fd, 1);
+            execl("/bin/sh", "sh", "-c", workload->command, (char *)NULL);
+            _exit(127);
+        }
+        waitChild(pid, "sh -c");
+    }
+    return workload->count / (now() - start);
+}
+
+/*  selected()
+    Functionality:
+            This function tells whether a metric is measured, which is every metric unless --only is given.
+    Parameters:
+            1.) metric name
+    Returns:
+            Returns 1 if the metric is measured, otherwise 0.
+*/
+int selected(const char *name)
+{
+    return onlyMetric == NULL || strcmp(onlyMetric, name) == 0;
+}
+
+/*  recordMetric()
+    Functionality:
+            This function adds a measured value to the results.
+    Parameters:
+            1.) metric name
+            2.) unit
+            3.) 1 if higher values are better
+            4.) value
+    Returns:
+            Does not return anything.
+*/
+void recordMetric(const char *name, const char *unit, int higher_is_better, double value)
+{
+    struct Metric *metric = &metrics[metricCount++];
+    metric->name = name;
+    metric->unit = unit;
+    metric->higher_is_better = higher_is_better;
+    metric->value = value;
+    metric->baseline = -1;
+}
+
+/*  addMetric()
+    Functionality:
+            This function measures a metric unless --only selects another one, and adds it to the results.
+    Parameters:
+            1.) metric name
+            2.) unit
+            3.) 1 if higher values are better
+            4.) measurement function
+            5.) Pointer to Workload struct
+    Returns:
+            Does not return anything.
+*/
+void addMetric(const char *name, const char *unit, int higher_is_better, double (*measure)(const void *),
+               const struct Workload *workload)
+{
+    if (!selected(name))
+    {
+        return;
+    }
+    fprintf(stderr, "bench: %s\n", name);
+    recordMetric(name, unit, higher_is_better, measureBest(measure, workload, higher_is_better));
+}
+
+/*  reapLatency()
+    Functionality:
+            This function measures how long the shell takes to reap a crowd of background jobs that all finish at
+            once. The jobs of the script read a FIFO that the harness holds open, and the script writes
+            ready.txt once all of them are started. The harness then closes the FIFO, so every job reads end of
+            file and exits, and the script waits for them and dumps its trace. The latency of a job runs from
+            that moment until the end of its "job" span, which is written when the shell reaps it. The best p50
+            and p99 of BENCH_RUNS runs are added to the results.
+    Parameters:
+            1.) Pointer to Workload struct, count is the number of jobs in the script
+    Returns:
+            Does not return anything.
+*/
+void reapLatency(const struct Workload *workload)
+{
+    if (!selected("reap_10k_p50_ms") && !selected("reap_10k_p99_ms"))
+    {
+        return;
+    }
+    fprintf(stderr, "bench: reap_10k_p50_ms, reap_10k_p99_ms\n");
+    char *fifo;
+    char *ready;
+    char *trace;
+    if (asprintf(&fifo, "%s/reap.fifo", scratch) == -1 || asprintf(&ready, "%s/ready.txt", scratch) == -1 ||
+        asprintf(&trace, "%s/reap.json", scratch) == -1 || (mkfifo(fifo, 0600) == -1 && errno != EEXIST))
+    {
+        perror("reap.fifo");
+        exit(2);
+    }
+    double *samples = malloc(workload->count * sizeof(double));
+    double best[2] = {-1, -1};
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        unlink(ready);
+        int writer = open(fifo, O_RDWR | O_CLOEXEC);
+        pid_t pid = startScript(workload->script, workload->environment);
+        while (access(ready, F_OK) == -1)
+        {
+            if (waitpid(pid, NULL, WNOHANG) != 0)
+            {
+                fprintf(stderr, "bench: the shell exited before starting all jobs\n");
+                exit(2);
+            }
+            usleep(1000);
+        }
+        double release = now() * 1e6;
+        close(writer);
+        waitChild(pid, "reap");
+
+        FILE *file = fopen(trace, "r");
+        if (file == NULL)
+        {
+            perror(trace);
+            exit(2);
+        }
+        int count = 0;
+        char line[512];
+        while (fgets(line, sizeof(line), file) != NULL && count < workload->count)
+        {
+            char *span = strstr(line, "\"cat\": \"job\"");
+            double start, duration;
+            if (span != NULL && sscanf(span, "\"cat\": \"job\", \"ph\": \"X\", \"ts\": %lf, \"dur\": %lf", &start,
+                                       &duration) == 2)
+            {
+                samples[count++] = (start + duration - release) / 1000;
+            }
+        }
+        fclose(file);
+        if (count < workload->count)
+        {
+            fprintf(stderr, "bench: %d of %d jobs in the trace\n", count, workload->count);
+            exit(2);
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            double latency = samplePercentile(samples, count, i == 0 ? 50 : 99);
+            if (best[i] < 0 || latency < best[i])
+            {
+                best[i] = latency;
+            }
+        }
+    }
+    recordMetric("reap_10k_p50_ms", "ms", 0, best[0]);
+    recordMetric("reap_10k_p99_ms", "ms", 0, best[1]);
+    free(samples);
+    free(fifo);
+    free(ready);
+    free(trace);
+}
+
+/*  traceOverhead()
+    Functionality:
+            This function runs a script with the shell built without tracing and with the shell under test, in
+            turns BENCH_TRACE_RUNS times, and keeps the lowest CPU time of each. Taking turns spreads any drift
+            in machine load over both builds. The run-to-run noise of a busy machine is larger than the limit,
+            so a try that is over BENCH_TRACE_LIMIT is repeated, up to BENCH_TRACE_TRIES times, and only an
+            overhead seen by every try counts. The rates of the last try are added to the results.
+    Parameters:
+            1.) Pointer to Workload struct
+            2.) Pointer to double that is set to the extra CPU time of the shell under test in percent
+    Returns:
+            Returns 1, or 0 if nothing was measured because --untraced was not given or --only selects another
+            metric.
+*/
+int traceOverhead(const struct Workload *workload, double *overhead)
+{
+    if (untracedPath == NULL || (!selected("trace_off_lines_per_s") && !selected("trace_absent_lines_per_s")))
+    {
+        return 0;
+    }
+    fprintf(stderr, "bench: trace_off_lines_per_s, trace_absent_lines_per_s\n");
+    const char *traced = shellPath;
+    double best[2];
+    for (int try = 0; try < BENCH_TRACE_TRIES; try++)
+    {
+        best[0] = best[1] = -1;
+        for (int i = 0; i < 2 * BENCH_TRACE_RUNS; i++)
+        {
+            shellPath = i % 2 == 0 ? untracedPath : traced;
+            runScript(workload->script, workload->environment);
+            double cpu = childUsage.ru_utime.tv_sec + childUsage.ru_utime.tv_usec / 1e6 +
+                         childUsage.ru_stime.tv_sec + childUsage.ru_stime.tv_usec / 1e6;
+            if (best[i % 2] < 0 || cpu < best[i % 2])
+            {
+                best[i % 2] = cpu;
+            }
+        }
+        *overhead = 100.0 * (best[1] - best[0]) / best[0];
+        if (*overhead <= BENCH_TRACE_LIMIT)
+        {
+            break;
+        }
+    }
+    shellPath = traced;
+    recordMetric("trace_off_lines_per_s", "lines/s", 1, workload->units / best[1]);
+    recordMetric("trace_absent_lines_per_s", "lines/s", 1, workload->units / best[0]);
+    return 1;
+}
+
+/*  loadBaseline()
+    Functionality:
+            This function reads the baseline values of the measured metrics. The file is the one written by
+            writeBaseline(), with one metric per line.
+    Parameters:
+            1.) path of the baseline file
+    Returns:
+            Returns 0, or -1 if there is no baseline file.
+*/
+int loadBaseline(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[128];
+        double value;
+        if (sscanf(line, " \"%127[^\"]\": {\"value\": %lf", name, &value) != 2)
+        {
+            continue;
+        }
+        for (int i = 0; i < metricCount; i++)
+        {
+            if (strcmp(metrics[i].name, name) == 0)
+            {
+                metrics[i].baseline = value;
+            }
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+/*  writeBaseline()
+    Functionality:
+            This function writes the results as the new baseline.
+    Parameters:
+            1.) path of the baseline file
+    Returns:
+            Does not return anything.
+*/
+void writeBaseline(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    fprintf(file, "{\n");
+    for (int i = 0; i < metricCount; i++)
+    {
+        fprintf(file, "  \"%s\": {\"value\": %.3f, \"unit\": \"%s\", \"better\": \"%s\"}%s\n", metrics[i].name,
+                metrics[i].value, metrics[i].unit, metrics[i].higher_is_better ? "higher" : "lower",
+                i + 1 < metricCount ? "," : "");
+    }
+    fprintf(file, "}\n");
+    fclose(file);
+}
+
+/*  compareBaseline()
+    Functionality:
+            This function prints every metric next to its baseline and flags the ones that got worse by more
+            than the threshold.
+    Parameters:
+            1.) threshold in percent
+    Returns:
+            Returns the number of regressed metrics.
+*/
+int compareBaseline(double threshold)
+{
+    int regressed = 0;
+    printf("%-30s %14s %14s %9s  %s\n", "metric", "baseline", "current", "change", "unit");
+    for (int i = 0; i < metricCount; i++)
+    {
+        struct Metric *metric = &metrics[i];
+        if (metric->baseline <= 0)
+        {
+            printf("%-30s %14s %14.1f %9s  %s\n", metric->name, "-", metric->value, "new", metric->unit);
+            continue;
+        }
+
+        // Positive changes are improvements whichever way the metric points
+        double change = 100.0 * (metric->value - metric->baseline) / metric->baseline;
+        if (!metric->higher_is_better)
+        {
+            change = -change;
+        }
+        int worse = change < -threshold;
+        regressed += worse;
+        printf("%-30s %14.1f %14.1f %+8.1f%%  %s%s\n", metric->name, metric->baseline, metric->value, change,
+               metric->unit, worse ? "  REGRESSED" : "");
+    }
+    return regressed;
+}
+
+/*
+    Functionality:
+            Main function of the harness. Prepares the scratch directory and its data files, measures every
+            metric, then compares the results with the baseline or records them.
+    Parameters:
+            1.) number of command line arguments
+            2.) command line arguments
+    Returns:
+            Returns 0, 1 if a metric regressed or tracing costs too much while off, or 2 on a usage or setup
+            error.
+*/
+int main(int argc, char *argv[])
+{
+    int record = 0;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (strcmp(argv[arg], "--record") == 0)
+        {
+            record = 1;
+        }
+        else if (strcmp(argv[arg], "--threshold") == 0 && arg + 1 < argc)
+        {
+            threshold = atof(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--only") == 0 && arg + 1 < argc)
+        {
+            onlyMetric = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--untraced") == 0 && arg + 1 < argc)
+        {
+            untracedPath = realpath(argv[++arg], NULL);
+            if (untracedPath == NULL)
+            {
+                perror(argv[arg]);
+                return 2;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (argc - arg != 2)
+    {
+        fprintf(stderr, "usage: bench [--record] [--threshold PCT] [--only NAME] [--untraced SMALLSH] SMALLSH "
+                        "BASELINE\n");
+        return 2;
+    }
+    shellPath = realpath(argv[arg], NULL);
+    const char *baseline = argv[arg + 1];
+    if (shellPath == NULL || mkdtemp(scratch) == NULL)
+    {
+        perror(shellPath == NULL ? argv[arg] : scratch);
+        return 2;
+    }
+
+    // Every shell started by the harness keeps its history and memo cache in the scratch directory, away from
+    // the user's own files
+    char *history;
+    char *memo_dir;
+    if (asprintf(&history, "%s/history", scratch) == -1 || asprintf(&memo_dir, "%s/memo", scratch) == -1)
+    {
+        return 2;
+    }
+    setenv("SMALLSH_HISTORY", history, 1);
+    setenv("SMALLSH_MEMO_DIR", memo_dir, 1);
+
+    // Data files: a file for the bandwidth metrics, a small memo input and, as it takes a while to create, a
+    // directory for the glob metric only when that metric is measured
+    char *command;
+    if (asprintf(&command, "cd %s && head -c %dM /dev/urandom > big && seq 100 > small && mkdir glob && cd glob && "
+                           "seq -f 'f%%.0f.txt' %d | xargs -r touch", scratch, BENCH_FILE_MB,
+                 selected("glob_entries_per_s") ? BENCH_GLOB_ENTRIES : 0) == -1 ||
+        system(command) != 0)
+    {
+        fprintf(stderr, "bench: could not create the data files in %s\n", scratch);
+        return 2;
+    }
+    free(command);
+    double bytes = (double)BENCH_FILE_MB * (1 << 20);
+
+    // Prompt-to-prompt latency through a pty
+    struct Workload prompt_builtin = {.command = "true", .count = 2000};
+    struct Workload prompt_spawn = {.command = "/bin/true", .count = 500};
+    addMetric("prompt_builtin_us", "us", 0, benchPrompt, &prompt_builtin);
+    addMetric("prompt_spawn_us", "us", 0, benchPrompt, &prompt_spawn);
+
+    // Parse throughput through stdin, with the default and the scalar lexer
+    const char *parse_line = "true alpha \"beta $HOME gamma\" 'delta epsilon' zeta\\ eta ${USER}x theta iota kappa "
+                             "lambda mu nu xi omicron pi rho sigma tau upsilon phi chi psi omega";
+    struct Workload parse = {repeatLines("", parse_line, 200000), NULL, 200000};
+    struct Workload parse_scalar = {parse.script, "SMALLSH_SIMD=scalar", 200000};
+    addMetric("parse_lines_per_s", "lines/s", 1, benchParse, &parse);
+    addMetric("parse_scalar_lines_per_s", "lines/s", 1, benchParse, &parse_scalar);
+
+    // The same short lines from a script file (batch mode) and from stdin with a prompt for each (interactive)
+    char *short_lines = repeatLines("", "true alpha beta", 200000);
+    struct Workload batch = {short_lines, NULL, 200000};
+    struct Workload interactive = {short_lines, NULL, 200000, .use_stdin = 1};
+    addMetric("batch_lines_per_s", "lines/s", 1, benchScript, &batch);
+    addMetric("interactive_lines_per_s", "lines/s", 1, benchScript, &interactive);
+
+    // Tokens per second on generated lines of about 5 KB, 401 tokens each
+    const char *words = " word \"quoted $HOME text\" 'single quoted' esc\\ aped";
+    char *long_line = malloc(100 * strlen(words) + 8);
+    char *long_out = long_line + sprintf(long_line, "true");
+    for (int i = 0; i < 100; i++)
+    {
+        long_out += sprintf(long_out, "%s", words);
+    }
+    struct Workload parse_long = {repeatLines("", long_line, 10000), NULL, 10000 * 401};
+    struct Workload parse_long_scalar = {parse_long.script, "SMALLSH_SIMD=scalar", 10000 * 401};
+    addMetric("parse_long_tokens_per_s", "tokens/s", 1, benchParse, &parse_long);
+    addMetric("parse_long_scalar_tokens_per_s", "tokens/s", 1, benchParse, &parse_long_scalar);
+
+    // Spawn rate of each spawn path, with a large environment and with tracing on
+    char *spawns = repeatLines("", "/bin/true", 1000);
+    struct Workload spawn_fast = {spawns, NULL, 1000};
+    struct Workload spawn_fork = {spawns, "SMALLSH_SPAWN=fork", 1000};
+    struct Workload spawn_zygote = {spawns, "SMALLSH_SPAWN=zygote", 1000};
+    char *exports = malloc(500 * 32 + 16);
+    char *out = exports + sprintf(exports, "export");
+    for (int i = 0; i < 500; i++)
+    {
+        out += sprintf(out, " BENCH_VAR_%d=value%d", i, i);
+    }
+    strcpy(out, "\n");
+    struct Workload spawn_env = {repeatLines(exports, "/bin/true", 1000), NULL, 1000};
+    struct Workload spawn_trace = {repeatLines("trace start\n", "/bin/true", 1000), NULL, 1000};
+    addMetric("spawn_fast_per_s", "spawns/s", 1, benchSpawn, &spawn_fast);
+    addMetric("spawn_fork_per_s", "spawns/s", 1, benchSpawn, &spawn_fork);
+    addMetric("spawn_zygote_per_s", "spawns/s", 1, benchSpawn, &spawn_zygote);
+    addMetric("spawn_env500_per_s", "spawns/s", 1, benchSpawn, &spawn_env);
+    addMetric("spawn_traced_per_s", "spawns/s", 1, benchSpawn, &spawn_trace);
+
+    // p50/p99 latency of each spawn path, read back from the spawn spans of a trace
+    const char *spawn_modes[] = {NULL, "SMALLSH_SPAWN=fork", "SMALLSH_SPAWN=zygote"};
+    const char *latency_names[] = {"spawn_fast_p50_us", "spawn_fast_p99_us", "spawn_fork_p50_us",
+                                   "spawn_fork_p99_us", "spawn_zygote_p50_us", "spawn_zygote_p99_us"};
+    char *latency_script;
+    if (asprintf(&latency_script, "%strace dump spawn.json\n", repeatLines("trace start\n", "/bin/true", 1000)) == -1)
+    {
+        return 2;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        struct Workload latency = {latency_script, spawn_modes[i / 2], .count = 1000, .percentile = i % 2 ? 99 : 50};
+        addMetric(latency_names[i], "us", 0, benchSpawnLatency, &latency);
+    }
+
+    // Median latency of the fork and zygote paths once the shell has grown to about 10 MB, 128 MB and 1 GB, by
+    // doubling an 8 KB variable 10, 14 or 17 times. The 1 GB runs take most of the harness's time.
+    const int doublings[] = {10, 14, 17};
+    const char *grown_names[] = {"spawn_fork_rss10m_us", "spawn_zygote_rss10m_us", "spawn_fork_rss128m_us",
+                                 "spawn_zygote_rss128m_us", "spawn_fork_rss1g_us", "spawn_zygote_rss1g_us"};
+    char *fill = malloc(8192 + 4);
+    memset(fill, 'x', 8192 + 2);
+    memcpy(fill, "s=", 2);
+    strcpy(fill + 8192 + 2, "\n");
+    char *grown_spawns = repeatLines("trace start\n", "/bin/true", 100);
+    for (int i = 0; i < 6; i++)
+    {
+        char *grown_script;
+        if (asprintf(&grown_script, "%s%strace dump spawn.json\n", repeatLines(fill, "s=$s$s", doublings[i / 2]),
+                     grown_spawns) == -1)
+        {
+            return 2;
+        }
+        struct Workload grown = {grown_script, spawn_modes[1 + i % 2], .count = 100, .percentile = 50};
+        addMetric(grown_names[i], "us", 0, benchSpawnLatency, &grown);
+        free(grown_script);
+    }
+
+    // Cost of the trace points while tracing is off, on lines that pass the read, parse and built in trace points
+    struct Workload trace_off = {repeatLines("", "true alpha beta", 300000), NULL, 300000};
+    double trace_overhead;
+    int trace_checked = traceOverhead(&trace_off, &trace_overhead);
+
+    // Redirection bandwidth. A 3-stage pipeline against the same stages run one after the other through temp
+    // files, and with the in-shell splice relay as the middle stage. Writing one stream to 3 files with the
+    // shell's fan-out against | tee.
+    struct Workload redirect = {"cat < big > copy\ncat < big > copy\n", NULL, 2 * bytes};
+    struct Workload pipeline = {"cat big | cat | cat > copy\ncat big | cat | cat > copy\n", NULL, 2 * bytes};
+    struct Workload temp_files = {repeatLines("", "cat big > stage1\ncat stage1 > stage2\ncat stage2 > copy", 2), NULL,
+                                  2 * bytes};
+    struct Workload relay = {"cat big | relay | cat > copy\ncat big | relay | cat > copy\n", NULL, 2 * bytes};
+    struct Workload fan_out = {"cat big > copy > copy2 > copy3\ncat big > copy > copy2 > copy3\n", NULL, 2 * bytes};
+    struct Workload tee = {"cat big | tee copy copy2 copy3 > /dev/null\ncat big | tee copy copy2 copy3 > /dev/null\n",
+                           NULL, 2 * bytes};
+    addMetric("redirect_mb_per_s", "MB/s", 1, benchBandwidth, &redirect);
+    addMetric("pipeline_mb_per_s", "MB/s", 1, benchBandwidth, &pipeline);
+    addMetric("pipeline_tempfile_mb_per_s", "MB/s", 1, benchBandwidth, &temp_files);
+    addMetric("pipeline_relay_mb_per_s", "MB/s", 1, benchBandwidth, &relay);
+    addMetric("fanout_mb_per_s", "MB/s", 1, benchBandwidth, &fan_out);
+    addMetric("fanout_tee_mb_per_s", "MB/s", 1, benchBandwidth, &tee);
+
+    // Background jobs started and reaped, and the reaping latency of 10,000 jobs that finish at once
+    char *jobs = repeatLines("", "/bin/true &", 1000);
+    struct Workload reap = {repeatLines(jobs, "wait", 1), NULL, 1000};
+    addMetric("reap_jobs_per_s", "jobs/s", 1, benchReap, &reap);
+    char *crowd;
+    if (asprintf(&crowd, "%secho ready > ready.txt\nwait\ntrace dump reap.json\n",
+                 repeatLines("trace start\n", "cat reap.fifo &", 10000)) == -1)
+    {
+        return 2;
+    }
+    struct Workload crowd_reap = {crowd, .count = 10000};
+    reapLatency(&crowd_reap);
+
+    // CPU-bound background jobs, two per CPU, without and with round-robin placement
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char *hashes = repeatLines("", "md5sum big > /dev/null &", 2 * cpus);
+    char *unpinned_script;
+    char *pinned_script;
+    if (asprintf(&unpinned_script, "%swait\n", hashes) == -1 ||
+        asprintf(&pinned_script, "pin auto\n%swait\n", hashes) == -1)
+    {
+        return 2;
+    }
+    struct Workload unpinned = {unpinned_script, NULL, 2 * cpus};
+    struct Workload pinned = {pinned_script, NULL, 2 * cpus};
+    addMetric("jobs_unpinned_per_s", "jobs/s", 1, benchScript, &unpinned);
+    addMetric("jobs_pinned_per_s", "jobs/s", 1, benchScript, &pinned);
+
+    // Loop interpreter, variable expansion, globbing and memo hits
+    struct Workload loop_workload = {nestedLoop(6, "x=$i"), NULL, 1000000};
+    char *assign = malloc(1000 * 24 + 16);
+    char *expand = malloc(1000 * 12 + 32);
+    char *assign_out = assign;
+    char *expand_out = expand + sprintf(expand, "true");
+    for (int i = 0; i < 1000; i++)
+    {
+        assign_out += sprintf(assign_out, "%sV%d=value%d", i > 0 ? " " : "", i, i);
+        expand_out += sprintf(expand_out, " $V%d", i);
+    }
+    strcpy(assign_out, "\n");
+    struct Workload expand_workload = {repeatLines(assign, expand, 500), NULL, 500 * 1000};
+    struct Workload glob = {repeatLines("cd glob\n", "true f*.txt", 3), NULL, 3.0 * BENCH_GLOB_ENTRIES};
+    struct Workload memo = {repeatLines("", "memo cat small", 2000), NULL, 2000};
+    addMetric("loop_iterations_per_s", "iterations/s", 1, benchScript, &loop_workload);
+    addMetric("expand_vars_per_s", "expansions/s", 1, benchScript, &expand_workload);
+    addMetric("glob_entries_per_s", "entries/s", 1, benchScript, &glob);
+    addMetric("memo_hits_per_s", "commands/s", 1, benchScript, &memo);
+
+    // The same loop with the hot utilities run as built ins and as programs. The second loop has 1000 iterations
+    // because each of them spawns three processes.
+    struct Workload loop_builtins = {nestedLoop(5, "test $i -lt 5; echo $i > /dev/null; true"), NULL, 100000};
+    struct Workload loop_programs = {nestedLoop(3, "/usr/bin/test $i -lt 5; /bin/echo $i > /dev/null; /bin/true"),
+                                     NULL, 1000};
+    addMetric("loop_builtins_iterations_per_s", "iterations/s", 1, benchScript, &loop_builtins);
+    addMetric("loop_programs_iterations_per_s", "iterations/s", 1, benchScript, &loop_programs);
+
+    // Anonymous RSS at ten checkpoints over a million lines of assignments and built ins with quoting and redirections
+    const char *group = "x=value\ntrue alpha \"beta $x gamma\" 'delta' > /dev/null\necho $x $HOME > /dev/null";
+    char *chunk = repeatLines("", group, 33333);
+    char *checkpoint = repeatLines(chunk, "grep RssAnon /proc/$$/status >> rss.txt", 1);
+    checkpoint[strlen(checkpoint) - 1] = '\0';
+    struct Workload memory = {repeatLines("", checkpoint, 10), NULL, 1000000};
+    addMetric("memory_anon_kb", "kB", 0, benchMemory, &memory);
+
+    // Requests answered by one warm coprocess, one at a time and batched, against a new process per request
+    char *numbers = malloc(10000 * 6 + 1);
+    char *numbers_out = numbers;
+    for (int i = 0; i < 10000; i++)
+    {
+        numbers_out += sprintf(numbers_out, " %d", i);
+    }
+    char *coproc_script;
+    char *batched_script;
+    char *respawn_script;
+    if (asprintf(&coproc_script, "coproc C cat\nfor i in%s; do C <<< \"request $i\"; read -u C r; done\n",
+                 numbers) == -1 ||
+        asprintf(&batched_script, "coproc C cat\nfor i in%s; do C <<< \"request $i\"; done\n"
+                                  "for i in%s; do read -u C r; done\n", numbers, numbers) == -1 ||
+        asprintf(&respawn_script, "for i in%s; do cat <<< \"request $i\" > /dev/null; done\n", numbers) == -1)
+    {
+        return 2;
+    }
+    struct Workload coproc = {coproc_script, NULL, 10000};
+    struct Workload batched = {batched_script, NULL, 10000};
+    struct Workload respawn = {respawn_script, NULL, 10000};
+    addMetric("coproc_requests_per_s", "requests/s", 1, benchScript, &coproc);
+    addMetric("coproc_batched_requests_per_s", "requests/s", 1, benchScript, &batched);
+    addMetric("respawn_requests_per_s", "requests/s", 1, benchScript, &respawn);
+
+    // Requests to the server over one connection
+    struct Workload serve = {.command = "true", .count = 20000};
+    addMetric("serve_tasks_per_s", "tasks/s", 1, benchServe, &serve);
+
+    // The same tasks with a new sh -c for each
+    struct Workload shell_per_task = {.command = "true", .count = 2000};
+    addMetric("sh_c_tasks_per_s", "tasks/s", 1, benchShellPerTask, &shell_per_task);
+
+    if (asprintf(&command, "rm -rf %s", scratch) != -1 && system(command) != 0)
+    {
+        fprintf(stderr, "bench: could not remove %s\n", scratch);
+    }
+
+    int regressed = 0;
+    if (record || loadBaseline(baseline) == -1)
+    {
+        compareBaseline(threshold);
+        if (onlyMetric == NULL)
+        {
+            writeBaseline(baseline);
+            printf("bench: baseline written to %s\n", baseline);
+        }
+    }
+    else
+    {
+        regressed = compareBaseline(threshold);
+        printf("bench: %d of %d metrics regressed by more than %.1f%%\n", regressed, metricCount, threshold);
+    }
+    if (memoryGrowth >= 0)
+    {
+        printf("bench: anonymous RSS grew by %ld kB from the first to the last checkpoint, %d kB allowed\n",
+               memoryGrowth, BENCH_MEMORY_LIMIT);
+        regressed += memoryGrowth > BENCH_MEMORY_LIMIT;
+    }
+    if (trace_checked)
+    {
+        printf("bench: tracing off costs %+.2f%% CPU time against the untraced build, %.1f%% allowed\n",
+               trace_overhead, BENCH_TRACE_LIMIT);
+        regressed += trace_overhead > BENCH_TRACE_LIMIT;
+    }
+    return regressed > 0 ? 1 : 0;
+}
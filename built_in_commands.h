@@ -6,6 +6,7 @@
         1.) exitShell()
         2.) changeDirectory()
         3.) getStatus()
+        4.) hashCommand()
 */
 
 #ifndef BUILT_IN_COMMANDS_H
@@ -18,7 +19,10 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include "Command.h"
+#include "helper_functions.h"
+#include "path_cache.h"
 
 /*  exitShell()
     Functionality: 
@@ -41,23 +45,24 @@ void exitShell()
     Parameters:
             1.) cmd_args char array that holds the command(cd) at index [0] and the sirectory name held at index [1]
     Returns:
-            Does not return anything. Calls the chdir() function to change the directory
+            Returns 0, or 1 if the directory could not be changed to.
     Sources Cited:
             https://www.geeksforgeeks.org/chdir-in-c-language-with-examples/
 */
-void changeDirectory(char *cmd_args[512])
+int changeDirectory(char **cmd_args)
 {
-    if (cmd_args[1] != NULL)
+    char *dir = cmd_args[1] != NULL ? cmd_args[1] : getenv("HOME");
+    if (dir == NULL)
     {
-        chdir(cmd_args[1]);
-        // perror("No Such File or Directory\n");
+        fprintf(stderr, "cd: HOME not set\n");
+        return 1;
     }
-    else
+    if (chdir(dir) == -1)
     {
-        char dir[1024];
-        getcwd(dir, 1024);
-        chdir(getenv("HOME"));
+        fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+        return 1;
     }
+    return 0;
 }
 
 /*  getStatus()
@@ -78,14 +83,51 @@ void getStatus(int status)
     {
         // Print exit status of child
         printf("exit value %d\n", WEXITSTATUS(status));
-        fflush(stdout);
+        flushOutput();
     }
     // Otherwise child was not terminated normally
     else
     {
         printf("terminated by signal %d\n", status);
-        fflush(stdout);
+        flushOutput();
+    }
+}
+
+/*  hashCommand()
+    Functionality: 
+            This function is the hash built in. With no arguments it prints the PATH lookup cache and its hit rate.
+            "hash -r" clears the cache, and "hash name..." looks up the names and adds them to the cache.
+    Parameters:
+            1.) cmd_args char array that holds the command(hash) at index [0] and the options/names after it
+    Returns:
+            Returns 0 on success, or 1 if a name could not be found in PATH.
+*/
+int hashCommand(char **cmd_args)
+{
+    if (cmd_args[1] == NULL)
+    {
+        checkPathChanged();
+        printPathCache();
+        return 0;
+    }
+
+    if (strcmp(cmd_args[1], "-r") == 0)
+    {
+        clearPathCache();
+        return 0;
+    }
+
+    int result = 0;
+    for (int i = 1; cmd_args[i] != NULL; i++)
+    {
+        if (lookupCommand(cmd_args[i]) == NULL && strchr(cmd_args[i], '/') == NULL)
+        {
+            printf("hash: %s: not found\n", cmd_args[i]);
+            flushOutput();
+            result = 1;
+        }
     }
+    return result;
 }
 
 #endif
\ No newline at end of file
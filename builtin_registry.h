@@ -0,0 +1,450 @@
+/*
+    This file contains the table of built in commands. Every built in is registered with its name in an
+    open-addressing hash table, so finding the built in for a command is one hash and usually one compare
+    instead of a strcmp() per built in. Built ins run inside the shell and ignore the & flag. The redirections
+    of a built in are applied by saving stdin/stdout/stderr, pointing them at the files and restoring them
+    afterwards.
+
+    There are twenty functions in this file:
+        1.) runExit()
+        2.) runChangeDirectory()
+        3.) runStatus()
+        4.) runJobs()
+        5.) runWait()
+        6.) runStats()
+        7.) runParallel()
+        8.) runHash()
+        9.) runMemo()
+        10.) runCoproc()
+        11.) runRead()
+        12.) runUtility()
+        13.) registerBuiltin()
+        14.) initBuiltins()
+        15.) findBuiltin()
+        16.) replaceStream()
+        17.) restoreStreams()
+        18.) redirectStream()
+        19.) redirectBuiltin()
+        20.) runBuiltin()
+*/
+
+#ifndef BUILTIN_REGISTRY_H
+#define BUILTIN_REGISTRY_H
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "Command.h"
+#include "helper_functions.h"
+#include "built_in_commands.h"
+#include "utility_builtins.h"
+#include "path_cache.h"
+#include "stats.h"
+#include "job_table.h"
+#include "parallel.h"
+#include "history.h"
+#include "variables.h"
+#include "redirect.h"
+#include "trace.h"
+#include "placement.h"
+#include "memo.h"
+#include "coproc.h"
+
+// Power of two, kept at least twice the number of built ins so that probe runs stay short
+#define BUILTIN_SLOTS 64
+
+/*
+    Data Members:
+        name: (string) ->               command name of the built in
+        run: (function pointer) ->      runs the built in with its Command struct and the exit status
+        utility: (function pointer) ->  built in that returns an exit code (runUtility()), or NULL
+        redirects: (int) ->             1 if the built in opens its own < and > files
+*/
+struct Builtin
+{
+    const char *name;
+    void (*run)(struct Builtin *builtin, struct Command *p, int *exitStatus);
+    int (*utility)(char **cmd_args);
+    int redirects;
+};
+
+struct Builtin *builtinTable[BUILTIN_SLOTS];
+
+/*  runExit()
+    Functionality:
+            This function runs the exit built in.
+    Parameters:
+            1.) Pointer to Builtin struct
+            2.) Pointer to Command struct
+            3.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return.
+*/
+void runExit(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    exitShell();
+}
+
+/*  runChangeDirectory()
+    Functionality:
+            This function runs the cd built in.
+    Parameters:
+            1.) Pointer to Builtin struct
+            2.) Pointer to Command struct
+            3.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything.
+*/
+void runChangeDirectory(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    *exitStatus = (changeDirectory(p->cmd_args) & 0xff) << 8;
+}
+
+/*  runStatus()
+    Functionality:
+            This function runs the status built in.
+    Parameters:
+            1.) Pointer to Builtin struct
+            2.) Pointer to Command struct
+            3.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything.
+*/
+void runStatus(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    getStatus(*exitStatus);
+}
+
+/*  runJobs(), runWait(), runStats(), runParallel(), runHash(), runMemo(), runCoproc(), runRead()
+    These adapt the remaining built ins to the signature of the table.
+*/
+void runJobs(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    jobsCommand();
+    *exitStatus = 0;
+}
+
+void runWait(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    waitCommand(p->cmd_args, exitStatus);
+}
+
+void runStats(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    *exitStatus = (statsCommand(p->cmd_args) & 0xff) << 8;
+}
+
+void runParallel(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    parallelCommand(p, exitStatus);
+}
+
+void runHash(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    *exitStatus = (hashCommand(p->cmd_args) & 0xff) << 8;
+}
+
+void runMemo(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    memoCommand(p, exitStatus);
+}
+
+void runCoproc(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    coprocCommand(p, exitStatus);
+}
+
+void runRead(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    readCommand(p, exitStatus);
+}
+
+/*  runUtility()
+    Functionality:
+            This function runs a built in that returns an exit code (the utilities, history) and stores it as a wait
+            status, the same way a child running the external utility would have been reported. A utility that
+            returns UTILITY_EXTERNAL is run again as the program of the same name, with the streams the built in
+            had, and its wait status is kept.
+    Parameters:
+            1.) Pointer to Builtin struct
+            2.) Pointer to Command struct
+            3.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything.
+*/
+void runUtility(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    int code = builtin->utility(p->cmd_args);
+    *exitStatus = (code & 0xff) << 8;
+    flushOutput();
+    if (code != UTILITY_EXTERNAL)
+    {
+        return;
+    }
+
+    // The redirections are already applied to the shell's own streams, which the child inherits
+    struct Command command = {0};
+    command.cmd_args = p->cmd_args;
+    pid_t pid = startCommand(&command, -1, -1, 1);
+    *exitStatus = 127 << 8;
+    if (pid != -1)
+    {
+        while (waitpid(pid, exitStatus, 0) == -1 && errno == EINTR)
+            ;
+    }
+}
+
+/*  registerBuiltin()
+    Functionality:
+            This function adds a built in to the table, probing linearly from the hash of its name.
+    Parameters:
+            1.) command name
+            2.) function that runs the built in
+            3.) utility function for runUtility(), or NULL
+            4.) 1 if the built in opens its own < and > files
+    Returns:
+            Does not return anything.
+*/
+void registerBuiltin(const char *name, void (*run)(struct Builtin *, struct Command *, int *),
+                     int (*utility)(char **), int redirects)
+{
+    struct Builtin *builtin = malloc(sizeof(struct Builtin));
+    builtin->name = name;
+    builtin->run = run;
+    builtin->utility = utility;
+    builtin->redirects = redirects;
+
+    unsigned int slot = hashName(name) & (BUILTIN_SLOTS - 1);
+    while (builtinTable[slot] != NULL)
+    {
+        slot = (slot + 1) & (BUILTIN_SLOTS - 1);
+    }
+    builtinTable[slot] = builtin;
+}
+
+/*  initBuiltins()
+    Functionality:
+            This function registers every built in command.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void initBuiltins()
+{
+    registerBuiltin("exit", runExit, NULL, 0);
+    registerBuiltin("cd", runChangeDirectory, NULL, 0);
+    registerBuiltin("status", runStatus, NULL, 0);
+    registerBuiltin("jobs", runJobs, NULL, 0);
+    registerBuiltin("wait", runWait, NULL, 0);
+    registerBuiltin("stats", runStats, NULL, 0);
+    registerBuiltin("parallel", runParallel, NULL, 1);
+    registerBuiltin("hash", runHash, NULL, 0);
+    registerBuiltin("memo", runMemo, NULL, 1);
+    registerBuiltin("coproc", runCoproc, NULL, 1);
+    registerBuiltin("read", runRead, NULL, 0);
+    registerBuiltin("history", runUtility, historyCommand, 0);
+    registerBuiltin("export", runUtility, exportCommand, 0);
+    registerBuiltin("unset", runUtility, unsetCommand, 0);
+    registerBuiltin("trace", runUtility, traceCommand, 0);
+    registerBuiltin("pin", runUtility, placementCommand, 0);
+    registerBuiltin("nice", runUtility, placementCommand, 0);
+    registerBuiltin("ionice", runUtility, placementCommand, 0);
+    registerBuiltin("ulimit", runUtility, placementCommand, 0);
+
+    registerBuiltin("echo", runUtility, echoUtility, 0);
+    registerBuiltin("printf", runUtility, printfUtility, 0);
+    registerBuiltin("pwd", runUtility, pwdUtility, 0);
+    registerBuiltin("test", runUtility, testUtility, 0);
+    registerBuiltin("[", runUtility, testUtility, 0);
+    registerBuiltin("true", runUtility, trueUtility, 0);
+    registerBuiltin("false", runUtility, falseUtility, 0);
+    registerBuiltin("kill", runUtility, killUtility, 0);
+}
+
+/*  findBuiltin()
+    Functionality:
+            This function looks up the built in for a command name.
+    Parameters:
+            1.) command name
+    Returns:
+            Returns the Builtin struct, or NULL if the name is not a built in.
+*/
+struct Builtin *findBuiltin(const char *name)
+{
+    unsigned int slot = hashName(name) & (BUILTIN_SLOTS - 1);
+    while (builtinTable[slot] != NULL)
+    {
+        if (strcmp(builtinTable[slot]->name, name) == 0)
+        {
+            return builtinTable[slot];
+        }
+        slot = (slot + 1) & (BUILTIN_SLOTS - 1);
+    }
+    return NULL;
+}
+
+/*  replaceStream()
+    Functionality:
+            This function points stdin, stdout or stderr of the shell at another file descriptor. The first time a
+            stream is replaced its original is saved with dup() so that restoreStreams() can put it back.
+    Parameters:
+            1.) file descriptor to copy
+            2.) stream to replace (0, 1 or 2)
+            3.) array of the three saved streams, -1 for a stream that was not replaced
+    Returns:
+            Does not return anything.
+*/
+void replaceStream(int fd, int target, int *saved)
+{
+    if (saved[target] == -1)
+    {
+        saved[target] = fcntl(target, F_DUPFD_CLOEXEC, 10);
+    }
+    dup2(fd, target);
+}
+
+/*  restoreStreams()
+    Functionality:
+            This function puts back the streams saved by replaceStream().
+    Parameters:
+            1.) array of the three saved streams
+    Returns:
+            Does not return anything.
+*/
+void restoreStreams(int *saved)
+{
+    fflush(stdout);
+    for (int target = 2; target >= 0; target--)
+    {
+        if (saved[target] != -1)
+        {
+            dup2(saved[target], target);
+            close(saved[target]);
+            saved[target] = -1;
+        }
+    }
+}
+
+/*  redirectStream()
+    Functionality:
+            This function opens a file onto stdin, stdout or stderr of the shell for a built in.
+    Parameters:
+            1.) name of the file
+            2.) open() flags
+            3.) stream to replace (0, 1 or 2)
+            4.) error message if the file can not be opened
+            5.) array of the three saved streams
+    Returns:
+            Returns 0, or -1 if the file can not be opened.
+*/
+int redirectStream(const char *name, int flags, int target, const char *message, int *saved)
+{
+    int fd = open(name, flags | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        perror(message);
+        return -1;
+    }
+    replaceStream(fd, target, saved);
+    close(fd);
+    return 0;
+}
+
+/*  redirectBuiltin()
+    Functionality:
+            This function applies the redirections of a command to the shell's own stdin/stdout/stderr, in the
+            same order as redirectFiles(). If a file can not be opened the streams replaced so far are restored.
+    Parameters:
+            1.) Pointer to Command struct
+            2.) array of the three saved streams, all -1 on entry
+    Returns:
+            Returns 0, or -1 if a file can not be opened.
+*/
+int redirectBuiltin(struct Command *p, int *saved)
+{
+    fflush(stdout);
+    int failed = 0;
+    if (p->input_file != NULL)
+    {
+        failed = redirectStream(p->input_file, O_RDONLY, 0, "input open()", saved);
+    }
+    else if (p->here_string != NULL)
+    {
+        int fd = hereStringFile(p->here_string);
+        if (fd == -1)
+        {
+            perror("here-string");
+            failed = -1;
+        }
+        else
+        {
+            replaceStream(fd, 0, saved);
+            close(fd);
+        }
+    }
+    if (!failed && p->error_to_output == STDERR_BEFORE_OUTPUT)
+    {
+        replaceStream(1, 2, saved);
+    }
+    if (!failed && p->output_to_error == STDOUT_BEFORE_ERROR)
+    {
+        replaceStream(2, 1, saved);
+    }
+    if (!failed && p->output_file != NULL)
+    {
+        failed = redirectStream(p->output_file, O_WRONLY | O_CREAT | (p->output_append ? O_APPEND : O_TRUNC), 1,
+                                "output open()", saved);
+    }
+    if (!failed && p->error_file != NULL)
+    {
+        failed = redirectStream(p->error_file, O_WRONLY | O_CREAT | (p->error_append ? O_APPEND : O_TRUNC), 2,
+                                "error open()", saved);
+    }
+    if (!failed && p->error_to_output == STDERR_AFTER_OUTPUT)
+    {
+        replaceStream(1, 2, saved);
+    }
+    if (!failed && p->output_to_error == STDOUT_AFTER_ERROR)
+    {
+        replaceStream(2, 1, saved);
+    }
+    if (failed)
+    {
+        restoreStreams(saved);
+        return -1;
+    }
+    return 0;
+}
+
+/*  runBuiltin()
+    Functionality:
+            This function runs a built in inside the shell. The redirections of the command are applied to the
+            shell's own streams with redirectBuiltin() for the duration of the built in and restored afterwards.
+    Parameters:
+            1.) Pointer to Builtin struct
+            2.) Pointer to Command struct
+            3.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything. A file that cannot be opened sets the exit status to 1.
+*/
+void runBuiltin(struct Builtin *builtin, struct Command *p, int *exitStatus)
+{
+    int saved[3] = {-1, -1, -1};
+    if (!builtin->redirects && redirectBuiltin(p, saved) == -1)
+    {
+        *exitStatus = 1 << 8;
+        return;
+    }
+
+    uint64_t trace_start = traceBegin();
+    builtin->run(builtin, p, exitStatus);
+    traceEvent("builtin", builtin->name, 0, trace_start);
+
+    // Put the shell's own stdin/stdout/stderr back
+    restoreStreams(saved);
+}
+
+#endif
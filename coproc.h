@@ -0,0 +1,649 @@
+/*
+    This file contains coprocesses, commands that are started once and then kept running to answer requests
+    from later lines, so a tool with a slow startup (an interpreter, a database client) is only started once.
+    "coproc NAME cmd args" starts the command with its stdin and stdout on pipes and adds it to the job table
+    as a background job that holds the shell's ends of the pipes. $NAME_PID is set to its process ID.
+
+    "NAME <<< text" sends text and a newline to the coprocess, and "NAME word..." sends every word as a line of
+    its own. The lines are not written right away but queued, and the queue is written with one writev() call
+    at the end of the command line (a whole loop is one line), before a read from the same coprocess, or once
+    COPROC_BATCH lines are queued. The write end is non-blocking: when the pipe is full the replies that are
+    waiting are read into the coprocess' buffer, so a big batch can not deadlock against a coprocess that is
+    blocked writing its replies. "read -u NAME var..." reads one reply line. The command has to write its
+    replies unbuffered or flush them per line (cat does, python needs -u), otherwise read waits until it exits.
+
+    Once the coprocess exits and its job is reported, its stdin is closed and its name no longer shadows the
+    command of the same name, but the replies it left can still be read with read -u. The coprocess is removed
+    once they have all been read, or when a new coprocess is started with the same name.
+
+    Usage:
+        coproc NAME command [args...]   start a coprocess
+        coproc -c NAME                  close the stdin of a coprocess, so it sees end of file
+        coproc                          list the coprocesses
+        NAME <<< text                   send a line
+        NAME word...                    send every word as a line
+        read [-u NAME] [var...]         read a line from stdin or a coprocess into the variables, the last one
+                                        gets the rest of the line, REPLY if none are given
+
+    There are twelve functions in this file:
+        1.) findCoproc()
+        2.) removeCoproc()
+        3.) detachCoproc()
+        4.) fillCoproc()
+        5.) flushCoproc()
+        6.) flushCoprocs()
+        7.) sendCoproc()
+        8.) readCoprocLine()
+        9.) assignFields()
+        10.) readCommand()
+        11.) startCoproc()
+        12.) coprocCommand()
+*/
+
+#ifndef COPROC_H
+#define COPROC_H
+
+#include <sys/uio.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "Command.h"
+#include "helper_functions.h"
+#include "input_reader.h"
+#include "job_table.h"
+#include "variables.h"
+#include "spawn.h"
+#include "stats.h"
+
+// Lines queued before they are written, well below IOV_MAX
+#define COPROC_BATCH 256
+
+// Initial size of the reply buffer, it grows when a reply line does not fit
+#define COPROC_BUFFER 4096
+
+/*
+    Data Members:
+        name: (string) ->               name given to coproc
+        pid: (pid_t) ->                 process ID of the command
+        job: (Job pointer) ->           background job of the command, NULL once it has been reported as done
+        input: (int) ->                 non-blocking write end of the command's stdin, -1 once closed
+        output: (int) ->                read end of the command's stdout, -1 once end of file was read
+        lines: (string array) ->        queued lines, each ending with a newline
+        pending: (iovec array) ->       part of each queued line that has not been written yet
+        count: (int) ->                 number of queued lines
+        buffer: (char array) ->         replies read from output that have not been consumed
+        start/end: (size_t) ->          unconsumed bytes of buffer
+        capacity: (size_t) ->           size of buffer
+        next: (Coproc pointer) ->       next coprocess
+*/
+struct Coproc
+{
+    char *name;
+    pid_t pid;
+    struct Job *job;
+    int input;
+    int output;
+    char *lines[COPROC_BATCH];
+    struct iovec pending[COPROC_BATCH];
+    int count;
+    char *buffer;
+    size_t start;
+    size_t end;
+    size_t capacity;
+    struct Coproc *next;
+};
+
+struct Coproc *firstCoproc = NULL;
+
+/*  findCoproc()
+    Functionality:
+            This function looks up a coprocess by name.
+    Parameters:
+            1.) name
+    Returns:
+            Returns the Coproc struct, or NULL if there is no coprocess with that name.
+*/
+struct Coproc *findCoproc(const char *name)
+{
+    for (struct Coproc *coproc = firstCoproc; coproc != NULL; coproc = coproc->next)
+    {
+        if (strcmp(coproc->name, name) == 0)
+        {
+            return coproc;
+        }
+    }
+    return NULL;
+}
+
+/*  removeCoproc()
+    Functionality:
+            This function unlinks a coprocess whose job is done and frees it.
+    Parameters:
+            1.) Pointer to Coproc struct
+    Returns:
+            Does not return anything.
+*/
+void removeCoproc(struct Coproc *coproc)
+{
+    struct Coproc **link = &firstCoproc;
+    while (*link != coproc)
+    {
+        link = &(*link)->next;
+    }
+    *link = coproc->next;
+    if (coproc->output != -1)
+    {
+        close(coproc->output);
+    }
+    free(coproc->buffer);
+    free(coproc->name);
+    free(coproc);
+}
+
+/*  detachCoproc()
+    Functionality:
+            This function is called by removeJob() once the job of a coprocess has been reported as done. The
+            queued lines are dropped and stdin is closed. The coprocess is removed unless replies are left to
+            be read.
+    Parameters:
+            1.) Pointer to Coproc struct
+    Returns:
+            Does not return anything.
+*/
+void detachCoproc(struct Coproc *coproc)
+{
+    coproc->job = NULL;
+    for (int i = 0; i < coproc->count; i++)
+    {
+        free(coproc->lines[i]);
+    }
+    coproc->count = 0;
+    if (coproc->input != -1)
+    {
+        close(coproc->input);
+        coproc->input = -1;
+    }
+    if (coproc->output == -1 && coproc->start == coproc->end)
+    {
+        removeCoproc(coproc);
+    }
+}
+
+/*  fillCoproc()
+    Functionality:
+            This function reads from the stdout of a coprocess into its buffer, after moving the unconsumed bytes
+            to the front and growing the buffer if it is full.
+    Parameters:
+            1.) Pointer to Coproc struct
+    Returns:
+            Returns the number of bytes read, 0 at end of file, or -1 on error.
+*/
+ssize_t fillCoproc(struct Coproc *coproc)
+{
+    if (coproc->output == -1)
+    {
+        return 0;
+    }
+    if (coproc->start > 0)
+    {
+        memmove(coproc->buffer, coproc->buffer + coproc->start, coproc->end - coproc->start);
+        coproc->end -= coproc->start;
+        coproc->start = 0;
+    }
+    if (coproc->end == coproc->capacity)
+    {
+        coproc->capacity *= 2;
+        coproc->buffer = realloc(coproc->buffer, coproc->capacity);
+    }
+
+    ssize_t length;
+    while ((length = read(coproc->output, coproc->buffer + coproc->end, coproc->capacity - coproc->end)) == -1 &&
+           errno == EINTR)
+        ;
+    if (length > 0)
+    {
+        coproc->end += length;
+    }
+    else if (length == 0)
+    {
+        close(coproc->output);
+        coproc->output = -1;
+    }
+    return length;
+}
+
+/*  flushCoproc()
+    Functionality:
+            This function writes the queued lines of a coprocess with writev(). While the pipe is full the
+            replies are read into the buffer, so the coprocess can keep going. SIGPIPE is blocked during the
+            writes, a coprocess that has exited makes the flush fail instead of ending the shell.
+    Parameters:
+            1.) Pointer to Coproc struct
+    Returns:
+            Returns 0, or -1 if the lines could not be written.
+*/
+int flushCoproc(struct Coproc *coproc)
+{
+    int failed = coproc->count > 0 && coproc->input == -1 ? -1 : 0;
+    sigset_t pipe_set;
+    sigset_t saved;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipe_set, &saved);
+
+    int first = 0;
+    while (first < coproc->count && !failed)
+    {
+        ssize_t written = writev(coproc->input, coproc->pending + first, coproc->count - first);
+        if (written >= 0)
+        {
+            // Skip the lines written completely, the last one may have been written in part
+            while (first < coproc->count && (size_t)written >= coproc->pending[first].iov_len)
+            {
+                written -= coproc->pending[first++].iov_len;
+            }
+            if (first < coproc->count)
+            {
+                coproc->pending[first].iov_base = (char *)coproc->pending[first].iov_base + written;
+                coproc->pending[first].iov_len -= written;
+            }
+        }
+        else if (errno == EAGAIN)
+        {
+            struct pollfd fds[2] = {{coproc->input, POLLOUT, 0}, {coproc->output, POLLIN, 0}};
+            if (poll(fds, coproc->output != -1 ? 2 : 1, -1) > 0 && (fds[1].revents & (POLLIN | POLLHUP)))
+            {
+                fillCoproc(coproc);
+            }
+        }
+        else if (errno != EINTR)
+        {
+            failed = -1;
+        }
+    }
+
+    // Take the SIGPIPE of a failed write before it is unblocked
+    struct timespec zero = {0, 0};
+    while (sigtimedwait(&pipe_set, NULL, &zero) > 0)
+        ;
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+
+    for (int i = 0; i < coproc->count; i++)
+    {
+        free(coproc->lines[i]);
+    }
+    coproc->count = 0;
+    return failed;
+}
+
+/*  flushCoprocs()
+    Functionality:
+            This function writes the queued lines of every coprocess, it runs after each command line.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void flushCoprocs()
+{
+    for (struct Coproc *coproc = firstCoproc; coproc != NULL; coproc = coproc->next)
+    {
+        if (coproc->count > 0)
+        {
+            flushCoproc(coproc);
+        }
+    }
+}
+
+/*  sendCoproc()
+    Functionality:
+            This function queues the lines of a "NAME <<< text" or "NAME word..." command for a coprocess.
+    Parameters:
+            1.) Pointer to Coproc struct
+            2.) Pointer to Command struct
+    Returns:
+            Returns the exit code, 1 if the coprocess no longer reads its stdin.
+*/
+int sendCoproc(struct Coproc *coproc, struct Command *p)
+{
+    if (coproc->input == -1)
+    {
+        fprintf(stderr, "%s: stdin of the coprocess is closed\n", coproc->name);
+        return 1;
+    }
+
+    int failed = 0;
+    char **words = p->cmd_args + 1;
+    char *here[2] = {p->here_string, NULL};
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (char **word = pass == 0 ? words : here; *word != NULL; word++)
+        {
+            if (coproc->count == COPROC_BATCH)
+            {
+                failed |= flushCoproc(coproc);
+            }
+            size_t length = strlen(*word);
+            char *line = malloc(length + 1);
+            memcpy(line, *word, length);
+            line[length] = '\n';
+            coproc->lines[coproc->count] = line;
+            coproc->pending[coproc->count].iov_base = line;
+            coproc->pending[coproc->count].iov_len = length + 1;
+            coproc->count++;
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+/*  readCoprocLine()
+    Functionality:
+            This function takes the next reply line from the buffer of a coprocess, reading more when no full
+            line is buffered. The queued lines are written first, they may be what the reply is waiting for.
+    Parameters:
+            1.) Pointer to Coproc struct
+            2.) Pointer to size_t that receives the length of the line, without the newline
+    Returns:
+            Returns the line, which stays valid until the next read, or NULL at end of file. A last line without
+            a newline is returned as well.
+*/
+char *readCoprocLine(struct Coproc *coproc, size_t *length)
+{
+    if (coproc->count > 0)
+    {
+        flushCoproc(coproc);
+    }
+
+    // Bytes after start that are known to hold no newline, fillCoproc() may move start
+    size_t scanned = 0;
+    while (1)
+    {
+        char *line = coproc->buffer + coproc->start;
+        char *newline = memchr(line + scanned, '\n', coproc->end - coproc->start - scanned);
+        if (newline != NULL)
+        {
+            *length = newline - line;
+            coproc->start += *length + 1;
+            return line;
+        }
+        scanned = coproc->end - coproc->start;
+        if (fillCoproc(coproc) <= 0)
+        {
+            break;
+        }
+    }
+
+    if (coproc->end == coproc->start)
+    {
+        return NULL;
+    }
+    char *line = coproc->buffer + coproc->start;
+    *length = coproc->end - coproc->start;
+    coproc->start = coproc->end;
+    return line;
+}
+
+/*  assignFields()
+    Functionality:
+            This function splits a line at blanks and assigns the fields to the variables, the last variable
+            gets the rest of the line.
+    Parameters:
+            1.) names of the variables, ends with NULL, or an empty list for REPLY
+            2.) line
+            3.) length of the line
+    Returns:
+            Does not return anything.
+*/
+void assignFields(char **names, const char *line, size_t length)
+{
+    char *reply[2] = {"REPLY", NULL};
+    names = names[0] != NULL ? names : reply;
+    char *value = malloc(length + 1);
+    size_t i = 0;
+    for (int n = 0; names[n] != NULL; n++)
+    {
+        while (i < length && (line[i] == ' ' || line[i] == '\t') && names != reply)
+        {
+            i++;
+        }
+        size_t end = i;
+        if (names[n + 1] != NULL)
+        {
+            while (end < length && line[end] != ' ' && line[end] != '\t')
+            {
+                end++;
+            }
+        }
+        else
+        {
+            end = length;
+            while (end > i && (line[end - 1] == ' ' || line[end - 1] == '\t') && names != reply)
+            {
+                end--;
+            }
+        }
+        memcpy(value, line + i, end - i);
+        value[end - i] = '\0';
+        setVariable(names[n], value, 0);
+        i = end;
+    }
+    free(value);
+}
+
+/*  readCommand()
+    Functionality:
+            This function is the read built in. It reads one line from a coprocess (-u NAME) or from stdin. When
+            the shell reads its own command lines from stdin and read has no < or <<<, the line is taken from
+            the shell's input reader, which may already hold it. Otherwise stdin is read one byte at a time, so
+            nothing after the line is taken away from the next reader.
+    Parameters:
+            1.) Pointer to Command struct, cmd_args holds the command(read), the -u option and the variable names
+            2.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything. The exit status is 1 at end of file or if there is no such coprocess.
+*/
+void readCommand(struct Command *p, int *exitStatus)
+{
+    char **names = p->cmd_args + 1;
+    size_t length = 0;
+    *exitStatus = 1 << 8;
+    if (names[0] != NULL && strcmp(names[0], "-u") == 0)
+    {
+        struct Coproc *coproc = names[1] != NULL ? findCoproc(names[1]) : NULL;
+        if (coproc == NULL)
+        {
+            fprintf(stderr, "read: %s: no such coprocess\n", names[1] != NULL ? names[1] : "");
+            return;
+        }
+        char *line = readCoprocLine(coproc, &length);
+        if (line != NULL)
+        {
+            assignFields(names + 2, line, length);
+            *exitStatus = 0;
+        }
+
+        // The last reply of a coprocess that has exited was read
+        if (coproc->job == NULL && coproc->output == -1 && coproc->start == coproc->end)
+        {
+            removeCoproc(coproc);
+        }
+        return;
+    }
+
+    fflush(stdout);
+    if (shellInput.fd == 0 && p->input_file == NULL && p->here_string == NULL)
+    {
+        char *line = readLine(&shellInput, &length);
+        if (line != NULL)
+        {
+            assignFields(names, line, length);
+            *exitStatus = 0;
+        }
+        return;
+    }
+
+    size_t capacity = 128;
+    char *line = malloc(capacity);
+    ssize_t got;
+    char c;
+    while ((got = read(0, &c, 1)) == 1 || (got == -1 && errno == EINTR))
+    {
+        if (got == -1)
+        {
+            continue;
+        }
+        if (c == '\n')
+        {
+            break;
+        }
+        if (length == capacity)
+        {
+            capacity *= 2;
+            line = realloc(line, capacity);
+        }
+        line[length++] = c;
+    }
+    if (got == 1 || length > 0)
+    {
+        assignFields(names, line, length);
+        *exitStatus = 0;
+    }
+    free(line);
+}
+
+/*  startCoproc()
+    Functionality:
+            This function starts a command as a coprocess with its stdin and stdout on pipes, and adds it to the
+            job table.
+    Parameters:
+            1.) name of the coprocess
+            2.) Pointer to Command struct of the coproc command
+    Returns:
+            Returns the new Coproc struct, or NULL if the command could not be started.
+*/
+struct Coproc *startCoproc(char *name, struct Command *p)
+{
+    int to_child[2];
+    int from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) == -1)
+    {
+        perror("coproc pipe()");
+        return NULL;
+    }
+    if (pipe2(from_child, O_CLOEXEC) == -1)
+    {
+        perror("coproc pipe()");
+        close(to_child[0]);
+        close(to_child[1]);
+        return NULL;
+    }
+
+    struct Command command = *p;
+    command.cmd_args = p->cmd_args + 2;
+    command.next = NULL;
+    pid_t pid = startCommand(&command, to_child[0], from_child[1], 0);
+    close(to_child[0]);
+    close(from_child[1]);
+    if (pid == -1)
+    {
+        close(to_child[1]);
+        close(from_child[0]);
+        return NULL;
+    }
+    recordSpawn();
+    fcntl(to_child[1], F_SETFL, O_NONBLOCK);
+
+    struct Coproc *coproc = calloc(1, sizeof(struct Coproc));
+    coproc->name = strdup(name);
+    coproc->pid = pid;
+    coproc->input = to_child[1];
+    coproc->output = from_child[0];
+    coproc->capacity = COPROC_BUFFER;
+    coproc->buffer = malloc(coproc->capacity);
+    coproc->job = addJob(&pid, 1, p);
+    coproc->job->coproc = coproc;
+    coproc->next = firstCoproc;
+    firstCoproc = coproc;
+
+    char variable[strlen(name) + 5];
+    char value[16];
+    sprintf(variable, "%s_PID", name);
+    sprintf(value, "%d", pid);
+    setVariable(variable, value, 0);
+    return coproc;
+}
+
+/*  coprocCommand()
+    Functionality:
+            This function is the coproc built in. It starts a coprocess, closes the stdin of one (-c) or lists
+            them. A name can only be reused once its previous coprocess has exited.
+    Parameters:
+            1.) Pointer to Command struct
+            2.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything. The exit status is set to 1 if the coprocess can not be started.
+*/
+void coprocCommand(struct Command *p, int *exitStatus)
+{
+    char **args = p->cmd_args;
+    *exitStatus = 0;
+    if (args[1] == NULL)
+    {
+        for (struct Coproc *coproc = firstCoproc; coproc != NULL; coproc = coproc->next)
+        {
+            printf("%s %d %s\n", coproc->name, coproc->pid, coproc->job != NULL ? "Running" : "Done");
+        }
+        flushOutput();
+        return;
+    }
+
+    struct Coproc *coproc;
+    if (strcmp(args[1], "-c") == 0)
+    {
+        coproc = args[2] != NULL ? findCoproc(args[2]) : NULL;
+        if (coproc == NULL)
+        {
+            fprintf(stderr, "coproc: %s: no such coprocess\n", args[2] != NULL ? args[2] : "");
+            *exitStatus = 1 << 8;
+            return;
+        }
+        flushCoproc(coproc);
+        if (coproc->input != -1)
+        {
+            close(coproc->input);
+            coproc->input = -1;
+        }
+        return;
+    }
+
+    if (args[2] == NULL)
+    {
+        fprintf(stderr, "usage: coproc NAME command [args...]\n");
+        *exitStatus = 1 << 8;
+        return;
+    }
+    coproc = findCoproc(args[1]);
+    if (coproc != NULL && coproc->job != NULL)
+    {
+        fprintf(stderr, "coproc: %s is still running\n", args[1]);
+        *exitStatus = 1 << 8;
+        return;
+    }
+
+    // Replace a coprocess of the same name that has exited
+    if (coproc != NULL)
+    {
+        removeCoproc(coproc);
+    }
+    if (startCoproc(args[1], p) == NULL)
+    {
+        *exitStatus = 1 << 8;
+    }
+}
+
+#endif
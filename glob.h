@@ -0,0 +1,626 @@
+/*
+    This file contains the glob expansion of words. An unquoted * matches any run of characters, ? matches one
+    character, [abc], [a-z] and [!a-z] (or [^a-z]) match one character of a set, and a path component that is
+    exactly ** matches any number of directories, including none. A word that matches nothing is passed on
+    unchanged. Names starting with a dot are only matched by a pattern component that starts with a dot, and
+    ** does not descend into hidden directories or follow symbolic links.
+
+    Directories are read with getdents64() into one packed buffer per directory: every entry is stored as its
+    d_type byte followed by the NUL terminated name, with an array of offsets into the buffer. Listings are kept
+    in directory order and only the matches are sorted (in place, by byte value), so a pattern that picks a few
+    names out of a huge directory does not pay for sorting all of it.
+    The listings are cached for the life of one command line, so patterns that share a directory ("*.c *.h"
+    or "x*.log y*.log") read it only once. The cache is dropped before the next line is parsed.
+
+    There are eleven functions in this file:
+        1.) matchBracket()
+        2.) matchPattern()
+        3.) hasGlobChars()
+        4.) compareMatches()
+        5.) readListing()
+        6.) resetGlobCache()
+        7.) findListing()
+        8.) isDirectory()
+        9.) addMatch()
+        10.) globWalk()
+        11.) expandGlob()
+*/
+
+#ifndef GLOB_H
+#define GLOB_H
+
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "path_cache.h"
+
+// Initial number of slots in the listing cache, always a power of two
+#define GLOB_CACHE_SLOTS 64
+
+// Size of the buffer handed to getdents64()
+#define GLOB_READ_SIZE (256 * 1024)
+
+/*
+    Data Members:
+        path: (string) ->           directory as it appears in the matches ("" for the current directory)
+        names: (char array) ->      packed entries, each a d_type byte followed by the NUL terminated name
+        offsets: (uint32 array) ->  offset of every name in names, in directory order
+        count: (int) ->             number of entries, "." and ".." are left out
+*/
+struct DirListing
+{
+    char *path;
+    char *names;
+    uint32_t *offsets;
+    int count;
+};
+
+/*
+    Data Members:
+        matches: (string array) ->  paths matched so far
+        count: (int) ->             number of paths in matches
+        capacity: (int) ->          number of paths matches has room for
+*/
+struct GlobResult
+{
+    char **matches;
+    int count;
+    int capacity;
+};
+
+// Open-addressing table of the directories read for the current line
+struct DirListing **globCache = NULL;
+size_t globCacheSlots = 0;
+size_t globCacheUsed = 0;
+
+/*  matchBracket()
+    Functionality:
+            This function matches one character against a [...] set.
+    Parameters:
+            1.) pattern, just after the [
+            2.) character to match
+            3.) Pointer that receives the pattern just after the closing ]
+    Returns:
+            Returns 1 if the character is in the set (or not in a negated set), 0 if it is not, and -1 if the
+            set is not closed, in which case the [ is an ordinary character.
+*/
+int matchBracket(const char *pattern, unsigned char c, const char **end)
+{
+    int negate = *pattern == '!' || *pattern == '^';
+    if (negate)
+    {
+        pattern++;
+    }
+
+    int found = 0;
+    int first = 1;
+    while (*pattern != ']' || first)
+    {
+        if (*pattern == '\0')
+        {
+            return -1;
+        }
+        unsigned char low = *pattern == '\\' && pattern[1] != '\0' ? *++pattern : *pattern;
+        unsigned char high = low;
+        pattern++;
+        if (*pattern == '-' && pattern[1] != ']' && pattern[1] != '\0')
+        {
+            high = pattern[1] == '\\' && pattern[2] != '\0' ? pattern[2] : pattern[1];
+            pattern += pattern[1] == '\\' && pattern[2] != '\0' ? 3 : 2;
+        }
+        if (c >= low && c <= high)
+        {
+            found = 1;
+        }
+        first = 0;
+    }
+    *end = pattern + 1;
+    return found != negate;
+}
+
+/*  matchPattern()
+    Functionality:
+            This function matches a name against one component of a pattern. A * is matched by remembering
+            where it was and retrying from one character further on a mismatch, so no recursion is needed.
+    Parameters:
+            1.) pattern component
+            2.) name
+    Returns:
+            Returns 1 if the name matches, otherwise 0.
+*/
+int matchPattern(const char *pattern, const char *name)
+{
+    const char *star = NULL;
+    const char *retry = NULL;
+
+    while (*name != '\0')
+    {
+        const char *next = pattern + 1;
+        int matched = 0;
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            retry = name;
+            continue;
+        }
+        if (*pattern == '?')
+        {
+            matched = 1;
+        }
+        else if (*pattern == '[')
+        {
+            matched = matchBracket(pattern + 1, *name, &next);
+            if (matched == -1)
+            {
+                matched = *name == '[';
+                next = pattern + 1;
+            }
+        }
+        else if (*pattern == '\\' && pattern[1] != '\0')
+        {
+            matched = pattern[1] == *name;
+            next = pattern + 2;
+        }
+        else
+        {
+            matched = *pattern != '\0' && *pattern == *name;
+        }
+
+        if (matched)
+        {
+            pattern = next;
+            name++;
+        }
+        else if (star != NULL)
+        {
+            // Let the last * take one more character
+            pattern = star + 1;
+            name = ++retry;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+/*  hasGlobChars()
+    Functionality:
+            This function checks if a pattern component contains an unescaped *, ? or [.
+    Parameters:
+            1.) pattern component
+    Returns:
+            Returns 1 if it does, otherwise 0.
+*/
+int hasGlobChars(const char *pattern)
+{
+    for (; *pattern != '\0'; pattern++)
+    {
+        if (*pattern == '\\' && pattern[1] != '\0')
+        {
+            pattern++;
+        }
+        else if (*pattern == '*' || *pattern == '?' || *pattern == '[')
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  compareMatches()
+    Functionality:
+            This function is the qsort() compare function for the matched paths.
+    Parameters:
+            1.) Pointer to the first path
+            2.) Pointer to the second path
+    Returns:
+            Returns less than, equal to or greater than 0 like strcmp().
+*/
+int compareMatches(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*  readListing()
+    Functionality:
+            This function reads a directory with getdents64() into a packed listing.
+    Parameters:
+            1.) directory as it appears in the matches, "" for the current directory
+    Returns:
+            Returns the listing. A directory that can not be read gives an empty listing.
+    Sources Cited:
+            https://man7.org/linux/man-pages/man2/getdents.2.html
+*/
+struct DirListing *readListing(const char *path)
+{
+    static char *buffer = NULL;
+    if (buffer == NULL)
+    {
+        buffer = malloc(GLOB_READ_SIZE);
+    }
+
+    struct DirListing *listing = calloc(1, sizeof(struct DirListing));
+    listing->path = strdup(path);
+    int fd = open(path[0] != '\0' ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return listing;
+    }
+
+    size_t used = 0;
+    size_t size = 0;
+    int capacity = 0;
+    long got;
+    while ((got = syscall(SYS_getdents64, fd, buffer, GLOB_READ_SIZE)) > 0)
+    {
+        for (long position = 0; position < got;)
+        {
+            // struct linux_dirent64: d_ino, d_off, d_reclen, d_type, d_name
+            char *entry = buffer + position;
+            unsigned short record;
+            memcpy(&record, entry + 16, sizeof(record));
+            unsigned char type = entry[18];
+            char *name = entry + 19;
+            position += record;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            size_t length = strlen(name) + 1;
+            if (used + length + 1 > size)
+            {
+                size = size == 0 ? 64 * 1024 : size * 2;
+                listing->names = realloc(listing->names, size);
+            }
+            if (listing->count == capacity)
+            {
+                capacity = capacity == 0 ? 1024 : capacity * 2;
+                listing->offsets = realloc(listing->offsets, capacity * sizeof(uint32_t));
+            }
+            listing->names[used] = type;
+            memcpy(listing->names + used + 1, name, length);
+            listing->offsets[listing->count++] = used + 1;
+            used += length + 1;
+        }
+    }
+    close(fd);
+    return listing;
+}
+
+/*  resetGlobCache()
+    Functionality:
+            This function drops the listings read for the previous command line.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void resetGlobCache()
+{
+    if (globCacheUsed == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < globCacheSlots; i++)
+    {
+        if (globCache[i] != NULL)
+        {
+            free(globCache[i]->path);
+            free(globCache[i]->names);
+            free(globCache[i]->offsets);
+            free(globCache[i]);
+            globCache[i] = NULL;
+        }
+    }
+    globCacheUsed = 0;
+}
+
+/*  findListing()
+    Functionality:
+            This function returns the cached listing of a directory, reading it on the first use in this line.
+            The table is doubled once it is half full.
+    Parameters:
+            1.) directory as it appears in the matches, "" for the current directory
+    Returns:
+            Returns the listing.
+*/
+struct DirListing *findListing(const char *path)
+{
+    if (globCacheUsed * 2 >= globCacheSlots)
+    {
+        struct DirListing **old = globCache;
+        size_t old_slots = globCacheSlots;
+        globCacheSlots = old_slots == 0 ? GLOB_CACHE_SLOTS : old_slots * 2;
+        globCache = calloc(globCacheSlots, sizeof(struct DirListing *));
+        for (size_t i = 0; i < old_slots; i++)
+        {
+            if (old[i] != NULL)
+            {
+                size_t slot = hashName(old[i]->path) & (globCacheSlots - 1);
+                while (globCache[slot] != NULL)
+                {
+                    slot = (slot + 1) & (globCacheSlots - 1);
+                }
+                globCache[slot] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    size_t slot = hashName(path) & (globCacheSlots - 1);
+    while (globCache[slot] != NULL)
+    {
+        if (strcmp(globCache[slot]->path, path) == 0)
+        {
+            return globCache[slot];
+        }
+        slot = (slot + 1) & (globCacheSlots - 1);
+    }
+    globCache[slot] = readListing(path);
+    globCacheUsed++;
+    return globCache[slot];
+}
+
+/*  isDirectory()
+    Functionality:
+            This function checks if an entry of a listing is a directory. The d_type byte answers it without a
+            system call, stat() is only needed for symbolic links and file systems that do not fill in d_type.
+    Parameters:
+            1.) d_type of the entry
+            2.) path of the entry
+            3.) 1 to follow a symbolic link to a directory, 0 to treat it as a file
+    Returns:
+            Returns 1 if the entry is a directory, otherwise 0.
+*/
+int isDirectory(unsigned char type, const char *path, int follow)
+{
+    struct stat info;
+    if (type == DT_DIR)
+    {
+        return 1;
+    }
+    if (type == DT_UNKNOWN)
+    {
+        return (follow ? stat(path, &info) : lstat(path, &info)) == 0 && S_ISDIR(info.st_mode);
+    }
+    if (type == DT_LNK && follow)
+    {
+        return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+    }
+    return 0;
+}
+
+/*  addMatch()
+    Functionality:
+            This function appends a copy of a path to the matches.
+    Parameters:
+            1.) Pointer to GlobResult struct
+            2.) path
+            3.) length of the path
+    Returns:
+            Does not return anything.
+*/
+void addMatch(struct GlobResult *result, const char *path, size_t length)
+{
+    if (result->count == result->capacity)
+    {
+        result->capacity = result->capacity == 0 ? 64 : result->capacity * 2;
+        result->matches = realloc(result->matches, result->capacity * sizeof(char *));
+    }
+    char *copy = arenaAlloc(&lineArena, length + 1);
+    memcpy(copy, path, length);
+    result->matches[result->count++] = copy;
+}
+
+/*  globWalk()
+    Functionality:
+            This function matches the pattern components from index onwards below a directory. Components
+            without glob characters are appended to the path without reading the directory, and the final path
+            is checked with lstat(). A ** component tries the rest of the pattern in the directory itself and in
+            every subdirectory below it.
+    Parameters:
+            1.) Pointer to GlobResult struct
+            2.) buffer holding the directory matched so far, "" or ending with /
+            3.) length of the directory in the buffer
+            4.) size of the buffer
+            5.) array of pattern components, an empty last component stands for a trailing /
+            6.) number of components
+            7.) index of the component to match
+            8.) 1 if the directory was reached by the ** at index, otherwise 0
+    Returns:
+            Does not return anything.
+*/
+void globWalk(struct GlobResult *result, char *path, size_t length, size_t size, char **components, int count,
+              int index, int below)
+{
+    char *component = components[index];
+    int last = index == count - 1;
+
+    // Trailing slash, the directory itself is the match
+    if (last && component[0] == '\0')
+    {
+        addMatch(result, path, length);
+        return;
+    }
+
+    if (!hasGlobChars(component))
+    {
+        // Copy the component without its backslashes
+        size_t end = length;
+        for (char *c = component; *c != '\0' && end + 2 < size; c++)
+        {
+            if (*c == '\\' && c[1] != '\0')
+            {
+                c++;
+            }
+            path[end++] = *c;
+        }
+        path[end] = '\0';
+
+        struct stat info;
+        if (last)
+        {
+            if (lstat(path, &info) == 0)
+            {
+                addMatch(result, path, end);
+            }
+        }
+        else if (stat(path, &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            path[end++] = '/';
+            path[end] = '\0';
+            globWalk(result, path, end, size, components, count, index + 1, 0);
+        }
+        path[length] = '\0';
+        return;
+    }
+
+    int globstar = strcmp(component, "**") == 0;
+    if (globstar)
+    {
+        // ** matching no directory at all, "a/**" alone lists everything below a
+        if (last)
+        {
+            if (length > 0 && !below)
+            {
+                addMatch(result, path, length);
+            }
+        }
+        else
+        {
+            globWalk(result, path, length, size, components, count, index + 1, 0);
+        }
+    }
+
+    // The listing stays valid while the walk goes deeper, the cache only ever grows during a line
+    struct DirListing *listing = findListing(path);
+    int hidden = component[0] == '.' || (component[0] == '\\' && component[1] == '.');
+    for (int i = 0; i < listing->count; i++)
+    {
+        char *name = listing->names + listing->offsets[i];
+        if (name[0] == '.' && !hidden)
+        {
+            continue;
+        }
+        if (!globstar && !matchPattern(component, name))
+        {
+            continue;
+        }
+
+        size_t name_length = strlen(name);
+        if (length + name_length + 2 >= size)
+        {
+            continue;
+        }
+        memcpy(path + length, name, name_length + 1);
+        size_t end = length + name_length;
+        unsigned char type = name[-1];
+
+        if (globstar)
+        {
+            // Every directory below is searched, but symbolic links are not followed
+            if (isDirectory(type, path, 0))
+            {
+                if (last)
+                {
+                    addMatch(result, path, end);
+                }
+                path[end] = '/';
+                path[end + 1] = '\0';
+                globWalk(result, path, end + 1, size, components, count, index, 1);
+            }
+            else if (last)
+            {
+                addMatch(result, path, end);
+            }
+        }
+        else if (last)
+        {
+            addMatch(result, path, end);
+        }
+        else if (isDirectory(type, path, 1))
+        {
+            path[end] = '/';
+            path[end + 1] = '\0';
+            globWalk(result, path, end + 1, size, components, count, index + 1, 0);
+        }
+    }
+    path[length] = '\0';
+}
+
+/*  expandGlob()
+    Functionality:
+            This function expands a pattern into the sorted list of paths it matches.
+    Parameters:
+            1.) pattern, with quoted glob characters escaped by a backslash
+            2.) Pointer to int that receives the number of matches
+    Returns:
+            Returns the array of matches allocated from the per-line arena, or NULL if nothing matched.
+*/
+char **expandGlob(const char *pattern, int *count)
+{
+    // Split the pattern into its components, "a//b" is the same as "a/b"
+    size_t length = strlen(pattern);
+    char *copy = arenaAlloc(&lineArena, length + 1);
+    memcpy(copy, pattern, length);
+    char **components = arenaAlloc(&lineArena, (length / 2 + 2) * sizeof(char *));
+    int parts = 0;
+    char *start = copy + (copy[0] == '/');
+    for (char *c = start;; c++)
+    {
+        if (*c == '/' || *c == '\0')
+        {
+            int end = *c == '\0';
+            *c = '\0';
+            if (c > start || end)
+            {
+                components[parts++] = start;
+            }
+            if (end)
+            {
+                break;
+            }
+            start = c + 1;
+        }
+    }
+
+    char path[PATH_MAX];
+    size_t prefix = 0;
+    if (pattern[0] == '/')
+    {
+        path[prefix++] = '/';
+    }
+    path[prefix] = '\0';
+
+    struct GlobResult result = {NULL, 0, 0};
+    globWalk(&result, path, prefix, sizeof(path), components, parts, 0, 0);
+
+    *count = result.count;
+    if (result.count == 0)
+    {
+        return NULL;
+    }
+    qsort(result.matches, result.count, sizeof(char *), compareMatches);
+    char **matches = arenaAlloc(&lineArena, result.count * sizeof(char *));
+    memcpy(matches, result.matches, result.count * sizeof(char *));
+    free(result.matches);
+    return matches;
+}
+
+#endif
@@ -1,10 +1,11 @@
 /*
-    This file contains helper functions to assist with finding/replacing substrings and 
-    freeing up memory.
+    This file contains helper functions to assist with flushing status output, building argument
+    vectors and freeing up memory.
 
     There are five functions in this file:
-        1.) replaceString()
-        2.) freeCommandMemory()
+        1.) flushOutput()
+        2.) setCommandArgs()
+        3.) freeCommandMemory()
 */
 
 #ifndef HELPER_FUNCTIONS
@@ -18,78 +19,61 @@
 #include <string.h>
 #include <stdlib.h>
 #include "Command.h"
+#include "arena.h"
 
-/*  replaceString()
+// Flag set when running a script or -c string, stdout is then fully buffered
+int batchMode = 0;
+
+/*  flushOutput()
     Functionality: 
-            This is a helper function used to search a string for a substring, and replace that substring with a different one. 
-            The function is specifically used to search the user command line input for the '$$' variable and replace it with the process ID
-            of the parent process. 
+            This function flushes status messages to stdout. In batch mode the flush is skipped so that the messages
+            of many lines are written together, stdout is still flushed before every child is started.
     Parameters:
-            1.) source string (string to search for substring)
-            2.) size of source string
-            3.) substring to search for
-            4.) substring to replace with
+            N/A
     Returns:
-            Returns a new string which contains the user input that has replaced the $$ expansion variable with the parent process ID.
-    Cited Sources:
-            I utilized thw following resource to help with the implementation of this function. The youtube vidoe is an explanation of the source code link.
-            https://pastebin.com/srLi6QZ1
-            https://www.youtube.com/watch?v=0qSU0nxIZiE&t=631s
+            Does not return anything.
 */
-char *replaceString(char *source, size_t size, char *substr, char *replace)
+void flushOutput()
 {
-    char *substring = strstr(source, substr);
-    if (substring == NULL)
-    {
-        return NULL;
-    }
-
-    // Make sure size of source string is larger than what you need to replace it with
-    if (size < strlen(source) + strlen(replace) - strlen(substr) + 1)
+    if (batchMode == 0)
     {
-        printf("Size is too small!\n");
         fflush(stdout);
-        return NULL;
     }
+}
 
-    // Utilize memove to allocate memory for replacment substring
-    memmove(
-        substring + strlen(replace),
-        substring + strlen(substr),
-        strlen(substring) - strlen(substr) + 1);
-
-    memcpy(substring, replace, strlen(replace));
-    return substring + strlen(replace);
+/*  setCommandArgs()
+    Functionality: 
+            This function copies the arguments of one command into an argument vector allocated from the per-line
+            arena. The vector is sized to the number of arguments plus the NULL that execvp() needs at the end.
+    Parameters:
+            1.) Pointer to Command struct
+            2.) array of argument strings
+            3.) number of arguments in the array
+    Returns:
+            Does not return anything. Sets the cmd_args data member of the Command struct.
+*/
+void setCommandArgs(struct Command *p, char **args, int count)
+{
+    p->cmd_args = arenaAlloc(&lineArena, (count + 1) * sizeof(char *));
+    memcpy(p->cmd_args, args, count * sizeof(char *));
+    p->cmd_args[count] = NULL;
 }
 
 /*  freeCommandMemory()
     Functionality: 
-            This function sets the values of all arguments, input file, and output file to NULL. It also frees the memory
-            that was allocated for the Command struct.
+            This function hands back the memory of a parsed command line. The Command structs of every stage,
+            their argument vectors and the input/output file names all live in the per-line arena, so the whole
+            line is released at once by resetting the arena.
     Parameters:
             1.) Pointer to Command struct
     Returns:
-            Does not return anything. Frees for struct and sets all arguments to NULL.
+            Does not return anything. Resets the per-line arena.
 */
 void freeCommandMemory(struct Command *p)
 {
-    for (int i = 0; p->cmd_args[i] != NULL; i++)
-    {
-        p->cmd_args[i] = NULL;
-    }
-
-    if (p->input_file != NULL)
-    {
-        p->input_file = NULL;
-    }
-
-    if (p->output_file != NULL)
-    {
-        p->output_file = NULL;
-    }
-
-    // Free memory set aside for Command struct
-    free(p);
+    // Every stage of the pipeline was allocated from the same arena
+    (void)p;
+    arenaReset(&lineArena);
 }
 
 #endif
\ No newline at end of file
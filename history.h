@@ -0,0 +1,724 @@
+/*
+    This file contains the persistent command history. Every interactive line is appended to a log file
+    (SMALLSH_HISTORY, default ~/.smallsh_history) as one record holding the time, the cwd, the exit status and
+    the line. The log is only ever appended to with a single write() per record and is never fsync()ed.
+    At startup the log is memory-mapped instead of being read, so the size of the history does not slow down
+    starting the shell.
+
+    "history search" is answered from a trigram index kept next to the log (<log>.idx). The index maps every
+    three byte sequence to the sorted list of entries that contain it, so a search only looks at the entries
+    that hold every trigram of the pattern. Entries appended after the index was built are scanned directly,
+    and the index is rebuilt once that unindexed tail gets large.
+
+    Usage:
+        history [N]                 print the whole history, or the last N entries
+        history search PATTERN      print the entries containing PATTERN, newest first
+
+    There are thirteen functions in this file:
+        1.) mapFile()
+        2.) mapHistory()
+        3.) openHistory()
+        4.) historyRecord()
+        5.) addHistory()
+        6.) compareTrigramKeys()
+        7.) rebuildHistoryIndex()
+        8.) findTrigram()
+        9.) hasPosting()
+        10.) collectTail()
+        11.) printHistoryEntry()
+        12.) searchHistory()
+        13.) historyCommand()
+*/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include "helper_functions.h"
+
+#define HISTORY_MAGIC 0x48534d53u
+#define HISTORY_INDEX_MAGIC 0x58444948u
+
+// Unindexed entries searched by scanning before the index is rebuilt
+#define HISTORY_TAIL_LIMIT 1024
+
+/*
+    Data Members:
+        magic: (uint32) ->          HISTORY_MAGIC, marks a complete record
+        size: (uint32) ->           size of the whole record including padding to 8 bytes
+        time: (int64) ->            time the line was run, in seconds since the epoch
+        status: (int32) ->          wait status of the line (childExitStatus after it ran)
+        cwd_length: (uint32) ->     length of the cwd
+        line_length: (uint32) ->    length of the line
+        reserved: (uint32) ->       0
+    The header is followed by the cwd and the line, each NUL terminated.
+*/
+struct HistoryRecord
+{
+    uint32_t magic;
+    uint32_t size;
+    int64_t time;
+    int32_t status;
+    uint32_t cwd_length;
+    uint32_t line_length;
+    uint32_t reserved;
+};
+
+/*
+    Data Members:
+        magic: (uint32) ->          HISTORY_INDEX_MAGIC
+        trigrams: (uint32) ->       number of HistoryTrigram entries
+        log_bytes: (uint64) ->      size of the log when the index was built
+        entries: (uint64) ->        number of entries in that part of the log
+        postings: (uint64) ->       number of entry numbers in the posting lists
+    The header is followed by the log offset of every entry (uint64), the HistoryTrigram table sorted by
+    trigram, and the posting lists (uint32 entry numbers, sorted).
+*/
+struct HistoryIndex
+{
+    uint32_t magic;
+    uint32_t trigrams;
+    uint64_t log_bytes;
+    uint64_t entries;
+    uint64_t postings;
+};
+
+/*
+    Data Members:
+        trigram: (uint32) ->    three bytes of a line packed into an int
+        count: (uint32) ->      number of entries that contain the trigram
+        start: (uint64) ->      index of the first entry number in the posting lists
+*/
+struct HistoryTrigram
+{
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t start;
+};
+
+/*
+    Data Members:
+        fd: (int) ->                        log file opened for appending, -1 until openHistory()
+        path/index_path: (string) ->        paths of the log and the index
+        log: (string) ->                    mapped log
+        log_size: (size_t) ->               number of mapped bytes of the log
+        index_map: (string) ->              mapped index file, NULL if there is no valid index
+        index_size: (size_t) ->             size of the mapped index
+        index: (HistoryIndex pointer) ->    header of the index
+        offsets: (uint64 array) ->          log offset of every indexed entry
+        table: (HistoryTrigram array) ->    trigram table of the index
+        postings: (uint32 array) ->         posting lists of the index
+*/
+struct History
+{
+    int fd;
+    char *path;
+    char *index_path;
+    char *log;
+    size_t log_size;
+    char *index_map;
+    size_t index_size;
+    struct HistoryIndex *index;
+    uint64_t *offsets;
+    struct HistoryTrigram *table;
+    uint32_t *postings;
+};
+
+struct History shellHistory = {-1};
+
+/*  mapFile()
+    Functionality:
+            This function maps a whole file read-only.
+    Parameters:
+            1.) path of the file
+            2.) Pointer to size_t that receives the size of the file
+    Returns:
+            Returns the mapping, or NULL if the file is missing or empty.
+*/
+char *mapFile(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    struct stat info;
+    char *data = NULL;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            data = NULL;
+        }
+        *size = info.st_size;
+    }
+    close(fd);
+    return data;
+}
+
+/*  mapHistory()
+    Functionality:
+            This function maps the log again if it has grown (other shells append to it too), and maps the
+            index if it has not been mapped yet. An index that does not match the log is ignored.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void mapHistory()
+{
+    struct stat info;
+    if (fstat(shellHistory.fd, &info) == 0 && (size_t)info.st_size != shellHistory.log_size)
+    {
+        if (shellHistory.log != NULL)
+        {
+            munmap(shellHistory.log, shellHistory.log_size);
+        }
+        shellHistory.log = NULL;
+        shellHistory.log_size = 0;
+        if (info.st_size > 0)
+        {
+            shellHistory.log = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, shellHistory.fd, 0);
+            if (shellHistory.log == MAP_FAILED)
+            {
+                shellHistory.log = NULL;
+            }
+            else
+            {
+                shellHistory.log_size = info.st_size;
+            }
+        }
+    }
+
+    if (shellHistory.index_map != NULL)
+    {
+        return;
+    }
+    char *map = mapFile(shellHistory.index_path, &shellHistory.index_size);
+    struct HistoryIndex *index = (struct HistoryIndex *)map;
+    if (map == NULL)
+    {
+        return;
+    }
+    if (shellHistory.index_size < sizeof(struct HistoryIndex) || index->magic != HISTORY_INDEX_MAGIC ||
+        index->log_bytes > shellHistory.log_size ||
+        shellHistory.index_size != sizeof(struct HistoryIndex) + index->entries * sizeof(uint64_t) +
+                                       index->trigrams * sizeof(struct HistoryTrigram) +
+                                       index->postings * sizeof(uint32_t))
+    {
+        munmap(map, shellHistory.index_size);
+        return;
+    }
+
+    shellHistory.index_map = map;
+    shellHistory.index = index;
+    shellHistory.offsets = (uint64_t *)(map + sizeof(struct HistoryIndex));
+    shellHistory.table = (struct HistoryTrigram *)(shellHistory.offsets + index->entries);
+    shellHistory.postings = (uint32_t *)(shellHistory.table + index->trigrams);
+}
+
+/*  openHistory()
+    Functionality:
+            This function opens the log for appending and maps the log and its index.
+    Parameters:
+            N/A
+    Returns:
+            Returns 0, or -1 if the log can not be opened.
+*/
+int openHistory()
+{
+    if (shellHistory.fd != -1)
+    {
+        return 0;
+    }
+
+    char *path = getenv("SMALLSH_HISTORY");
+    char *home = getenv("HOME");
+    if (path != NULL)
+    {
+        shellHistory.path = strdup(path);
+    }
+    else
+    {
+        shellHistory.path = malloc(strlen(home != NULL ? home : ".") + 32);
+        sprintf(shellHistory.path, "%s/.smallsh_history", home != NULL ? home : ".");
+    }
+    shellHistory.index_path = malloc(strlen(shellHistory.path) + 8);
+    sprintf(shellHistory.index_path, "%s.idx", shellHistory.path);
+
+    shellHistory.fd = open(shellHistory.path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (shellHistory.fd == -1)
+    {
+        return -1;
+    }
+    mapHistory();
+    return 0;
+}
+
+/*  historyRecord()
+    Functionality:
+            This function checks the record at an offset of the mapped log.
+    Parameters:
+            1.) offset of the record
+    Returns:
+            Returns the record, or NULL if there is no complete record at the offset.
+*/
+struct HistoryRecord *historyRecord(uint64_t offset)
+{
+    if (offset + sizeof(struct HistoryRecord) > shellHistory.log_size)
+    {
+        return NULL;
+    }
+    struct HistoryRecord *record = (struct HistoryRecord *)(shellHistory.log + offset);
+    if (record->magic != HISTORY_MAGIC || record->size < sizeof(struct HistoryRecord) ||
+        offset + record->size > shellHistory.log_size ||
+        sizeof(struct HistoryRecord) + record->cwd_length + record->line_length + 2 > record->size)
+    {
+        return NULL;
+    }
+    return record;
+}
+
+/*  addHistory()
+    Functionality:
+            This function appends one line to the log with a single write().
+    Parameters:
+            1.) command line
+            2.) wait status of the line
+    Returns:
+            Does not return anything.
+*/
+void addHistory(const char *line, int status)
+{
+    if (shellHistory.fd == -1 || line == NULL || line[0] == '\0')
+    {
+        return;
+    }
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        cwd[0] = '\0';
+    }
+
+    struct HistoryRecord header = {0};
+    header.magic = HISTORY_MAGIC;
+    header.time = time(NULL);
+    header.status = status;
+    header.cwd_length = strlen(cwd);
+    header.line_length = strlen(line);
+    header.size = (sizeof(struct HistoryRecord) + header.cwd_length + header.line_length + 2 + 7) & ~7u;
+
+    char *record = calloc(1, header.size);
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), cwd, header.cwd_length);
+    memcpy(record + sizeof(header) + header.cwd_length + 1, line, header.line_length);
+    if (write(shellHistory.fd, record, header.size) == -1)
+    {
+        perror("history");
+    }
+    free(record);
+}
+
+/*  compareTrigramKeys()
+    Functionality:
+            This function compares two (trigram << 32 | entry number) keys for qsort().
+    Parameters:
+            1.) Pointer to first key
+            2.) Pointer to second key
+    Returns:
+            Returns -1, 0 or 1.
+*/
+int compareTrigramKeys(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*  rebuildHistoryIndex()
+    Functionality:
+            This function builds the trigram index of the whole log. Every (trigram, entry number) pair is
+            packed into one 64 bit key, the keys are sorted and duplicates dropped, which leaves the posting
+            lists in trigram order. The index is written to a temporary file and renamed over the old one.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void rebuildHistoryIndex()
+{
+    size_t entries = 0;
+    size_t offset_capacity = 1024;
+    uint64_t *offsets = malloc(offset_capacity * sizeof(uint64_t));
+    size_t key_count = 0;
+    size_t key_capacity = 16384;
+    uint64_t *keys = malloc(key_capacity * sizeof(uint64_t));
+
+    uint64_t offset = 0;
+    struct HistoryRecord *record;
+    while ((record = historyRecord(offset)) != NULL)
+    {
+        if (entries == offset_capacity)
+        {
+            offset_capacity *= 2;
+            offsets = realloc(offsets, offset_capacity * sizeof(uint64_t));
+        }
+        offsets[entries] = offset;
+
+        const unsigned char *line = (unsigned char *)(record + 1) + record->cwd_length + 1;
+        for (uint32_t i = 0; i + 3 <= record->line_length; i++)
+        {
+            if (key_count == key_capacity)
+            {
+                key_capacity *= 2;
+                keys = realloc(keys, key_capacity * sizeof(uint64_t));
+            }
+            uint64_t trigram = line[i] << 16 | line[i + 1] << 8 | line[i + 2];
+            keys[key_count++] = trigram << 32 | entries;
+        }
+        entries++;
+        offset += record->size;
+    }
+
+    qsort(keys, key_count, sizeof(uint64_t), compareTrigramKeys);
+
+    // Drop duplicates and split the keys into the trigram table and the posting lists
+    struct HistoryTrigram *table = malloc((key_count + 1) * sizeof(struct HistoryTrigram));
+    uint32_t *postings = malloc((key_count + 1) * sizeof(uint32_t));
+    size_t trigrams = 0;
+    size_t posting_count = 0;
+    for (size_t i = 0; i < key_count; i++)
+    {
+        if (i > 0 && keys[i] == keys[i - 1])
+        {
+            continue;
+        }
+        uint32_t trigram = keys[i] >> 32;
+        if (trigrams == 0 || table[trigrams - 1].trigram != trigram)
+        {
+            table[trigrams].trigram = trigram;
+            table[trigrams].count = 0;
+            table[trigrams].start = posting_count;
+            trigrams++;
+        }
+        table[trigrams - 1].count++;
+        postings[posting_count++] = (uint32_t)keys[i];
+    }
+    free(keys);
+
+    struct HistoryIndex header = {HISTORY_INDEX_MAGIC, trigrams, offset, entries, posting_count};
+    char *temp_path = malloc(strlen(shellHistory.index_path) + 16);
+    sprintf(temp_path, "%s.%d", shellHistory.index_path, getpid());
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    FILE *out = fd != -1 ? fdopen(fd, "w") : NULL;
+    if (out != NULL)
+    {
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(offsets, sizeof(uint64_t), entries, out);
+        fwrite(table, sizeof(struct HistoryTrigram), trigrams, out);
+        fwrite(postings, sizeof(uint32_t), posting_count, out);
+        if (fclose(out) == 0 && rename(temp_path, shellHistory.index_path) == 0)
+        {
+            if (shellHistory.index_map != NULL)
+            {
+                munmap(shellHistory.index_map, shellHistory.index_size);
+                shellHistory.index_map = NULL;
+                shellHistory.index = NULL;
+            }
+        }
+        else
+        {
+            unlink(temp_path);
+        }
+    }
+    free(temp_path);
+    free(offsets);
+    free(table);
+    free(postings);
+    mapHistory();
+}
+
+/*  findTrigram()
+    Functionality:
+            This function looks up a trigram in the index with a binary search.
+    Parameters:
+            1.) trigram packed into an int
+    Returns:
+            Returns the HistoryTrigram struct, or NULL if no entry contains the trigram.
+*/
+struct HistoryTrigram *findTrigram(uint32_t trigram)
+{
+    size_t low = 0;
+    size_t high = shellHistory.index->trigrams;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (shellHistory.table[middle].trigram < trigram)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low < shellHistory.index->trigrams && shellHistory.table[low].trigram == trigram)
+    {
+        return &shellHistory.table[low];
+    }
+    return NULL;
+}
+
+/*  hasPosting()
+    Functionality:
+            This function checks if an entry number is in the posting list of a trigram.
+    Parameters:
+            1.) Pointer to HistoryTrigram struct
+            2.) entry number
+    Returns:
+            Returns 1 if the entry contains the trigram, otherwise 0.
+*/
+int hasPosting(struct HistoryTrigram *trigram, uint32_t entry)
+{
+    uint32_t *list = shellHistory.postings + trigram->start;
+    size_t low = 0;
+    size_t high = trigram->count;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (list[middle] < entry)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low < trigram->count && list[low] == entry;
+}
+
+/*  collectTail()
+    Functionality:
+            This function finds the offsets of the entries that were appended after the index was built.
+    Parameters:
+            1.) Pointer to size_t that receives the number of entries
+    Returns:
+            Returns the array of offsets, to be freed by the caller.
+*/
+uint64_t *collectTail(size_t *count)
+{
+    uint64_t offset = shellHistory.index != NULL ? shellHistory.index->log_bytes : 0;
+    size_t capacity = 64;
+    uint64_t *tail = malloc(capacity * sizeof(uint64_t));
+    struct HistoryRecord *record;
+
+    *count = 0;
+    while ((record = historyRecord(offset)) != NULL)
+    {
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            tail = realloc(tail, capacity * sizeof(uint64_t));
+        }
+        tail[(*count)++] = offset;
+        offset += record->size;
+    }
+    return tail;
+}
+
+/*  printHistoryEntry()
+    Functionality:
+            This function prints one entry with its number, time, exit status, cwd and line.
+    Parameters:
+            1.) entry number, counted from 1
+            2.) Pointer to HistoryRecord struct
+    Returns:
+            Does not return anything.
+*/
+void printHistoryEntry(uint64_t number, struct HistoryRecord *record)
+{
+    char when[32];
+    time_t seconds = record->time;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+
+    char status[16];
+    if (WIFSIGNALED(record->status))
+    {
+        sprintf(status, "sig %d", WTERMSIG(record->status));
+    }
+    else
+    {
+        sprintf(status, "%d", WEXITSTATUS(record->status));
+    }
+
+    char *cwd = (char *)(record + 1);
+    printf("%6lu  %s  %6s  %s  %s\n", (unsigned long)number, when, status, cwd, cwd + record->cwd_length + 1);
+}
+
+/*  searchHistory()
+    Functionality:
+            This function prints every entry whose line contains the pattern, newest first. The unindexed tail
+            is scanned directly. In the indexed part the shortest posting list of the pattern's trigrams gives
+            the candidates, which must appear in every other list and are then checked with memmem(). Patterns
+            shorter than three bytes are checked against every entry.
+    Parameters:
+            1.) pattern
+    Returns:
+            Returns the number of entries printed.
+*/
+long searchHistory(const char *pattern)
+{
+    size_t pattern_length = strlen(pattern);
+    size_t tail_count;
+    uint64_t *tail = collectTail(&tail_count);
+    uint64_t indexed = shellHistory.index != NULL ? shellHistory.index->entries : 0;
+    long found = 0;
+
+    for (size_t i = tail_count; i-- > 0;)
+    {
+        struct HistoryRecord *record = historyRecord(tail[i]);
+        char *line = (char *)(record + 1) + record->cwd_length + 1;
+        if (memmem(line, record->line_length, pattern, pattern_length) != NULL)
+        {
+            printHistoryEntry(indexed + i + 1, record);
+            found++;
+        }
+    }
+    free(tail);
+
+    if (shellHistory.index == NULL)
+    {
+        return found;
+    }
+
+    // Trigrams of the pattern, the rarest one drives the search
+    size_t trigram_count = pattern_length >= 3 ? pattern_length - 2 : 0;
+    struct HistoryTrigram **lists = malloc((trigram_count + 1) * sizeof(struct HistoryTrigram *));
+    size_t rarest = 0;
+    for (size_t i = 0; i < trigram_count; i++)
+    {
+        const unsigned char *p = (const unsigned char *)pattern + i;
+        lists[i] = findTrigram(p[0] << 16 | p[1] << 8 | p[2]);
+        if (lists[i] == NULL)
+        {
+            free(lists);
+            return found;
+        }
+        if (lists[i]->count < lists[rarest]->count)
+        {
+            rarest = i;
+        }
+    }
+
+    size_t candidates = trigram_count > 0 ? lists[rarest]->count : indexed;
+    for (size_t c = candidates; c-- > 0;)
+    {
+        uint32_t entry = trigram_count > 0 ? shellHistory.postings[lists[rarest]->start + c] : c;
+        int matches = 1;
+        for (size_t i = 0; i < trigram_count && matches; i++)
+        {
+            matches = i == rarest || hasPosting(lists[i], entry);
+        }
+        if (!matches)
+        {
+            continue;
+        }
+
+        struct HistoryRecord *record = historyRecord(shellHistory.offsets[entry]);
+        if (record == NULL)
+        {
+            continue;
+        }
+        char *line = (char *)(record + 1) + record->cwd_length + 1;
+        if (memmem(line, record->line_length, pattern, pattern_length) != NULL)
+        {
+            printHistoryEntry(entry + 1, record);
+            found++;
+        }
+    }
+    free(lists);
+    return found;
+}
+
+/*  historyCommand()
+    Functionality:
+            This function is the history built in. It prints the history or searches it, and rebuilds the index
+            first if too many entries have been added since it was built.
+    Parameters:
+            1.) cmd_args char array that holds the command(history) at index [0] and the options after it
+    Returns:
+            Returns 0, or 1 if nothing was found or the history can not be opened.
+*/
+int historyCommand(char **cmd_args)
+{
+    if (openHistory() == -1)
+    {
+        perror(shellHistory.path);
+        return 1;
+    }
+    mapHistory();
+
+    size_t tail_count;
+    uint64_t *tail = collectTail(&tail_count);
+    uint64_t indexed = shellHistory.index != NULL ? shellHistory.index->entries : 0;
+    if (tail_count > HISTORY_TAIL_LIMIT && tail_count > indexed / 8)
+    {
+        free(tail);
+        rebuildHistoryIndex();
+        tail = collectTail(&tail_count);
+        indexed = shellHistory.index != NULL ? shellHistory.index->entries : 0;
+    }
+
+    if (cmd_args[1] != NULL && strcmp(cmd_args[1], "search") == 0)
+    {
+        free(tail);
+        if (cmd_args[2] == NULL)
+        {
+            fprintf(stderr, "history: usage: history search PATTERN\n");
+            return 2;
+        }
+        return searchHistory(cmd_args[2]) > 0 ? 0 : 1;
+    }
+
+    // Print the last N entries, or all of them
+    uint64_t total = indexed + tail_count;
+    uint64_t first = 0;
+    if (cmd_args[1] != NULL)
+    {
+        long wanted = atol(cmd_args[1]);
+        if (wanted <= 0)
+        {
+            free(tail);
+            fprintf(stderr, "history: usage: history [N] | history search PATTERN\n");
+            return 2;
+        }
+        first = (uint64_t)wanted < total ? total - wanted : 0;
+    }
+    for (uint64_t i = first; i < total; i++)
+    {
+        uint64_t offset = i < indexed ? shellHistory.offsets[i] : tail[i - indexed];
+        struct HistoryRecord *record = historyRecord(offset);
+        if (record != NULL)
+        {
+            printHistoryEntry(i + 1, record);
+        }
+    }
+    free(tail);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,278 @@
+/*
+    This file contains the line reader the shell gets its command lines from. Input is read in large blocks
+    (or memory-mapped when a script file is given), and lines of any length are handed out one at a time.
+    The same reader serves the interactive prompt, "smallsh script.sh" and "smallsh -c 'command'".
+
+    There are six functions in this file:
+        1.) openInputFd()
+        2.) openInputString()
+        3.) openInputFile()
+        4.) fillInput()
+        5.) readLine()
+        6.) closeInput()
+*/
+
+#ifndef INPUT_READER_H
+#define INPUT_READER_H
+
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+// Size of each read() from a file descriptor
+#define INPUT_BLOCK_SIZE (64 * 1024)
+
+/*
+    Data Members:
+        fd: (int) ->            file descriptor read from, -1 for a mapped file or a -c string
+        data: (string) ->       mapped file, -c string, or buffer the blocks are read into
+        length: (size_t) ->     number of valid bytes in data
+        capacity: (size_t) ->   size of the read buffer, 0 when data is not owned by the reader
+        pos: (size_t) ->        offset of the next line in data
+        mapped: (int) ->        flag to keep track of if data was mapped with mmap()
+        eof: (int) ->           flag set once fd has reached end of file
+        wake_fd: (int) ->       file descriptor polled together with fd, -1 for none
+        on_wake: (function) ->  called when wake_fd becomes readable while waiting for input
+*/
+struct InputReader
+{
+    int fd;
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t pos;
+    int mapped;
+    int eof;
+    int wake_fd;
+    void (*on_wake)();
+};
+
+// Reader holding the shell's command lines
+struct InputReader shellInput;
+
+/*  openInputFd()
+    Functionality:
+            This function sets up the reader to read blocks from an open file descriptor, e.g. stdin.
+    Parameters:
+            1.) Pointer to InputReader struct
+            2.) file descriptor to read from
+    Returns:
+            Does not return anything.
+*/
+void openInputFd(struct InputReader *reader, int fd)
+{
+    memset(reader, 0, sizeof(struct InputReader));
+    reader->fd = fd;
+    reader->wake_fd = -1;
+    reader->capacity = INPUT_BLOCK_SIZE;
+    reader->data = malloc(reader->capacity);
+}
+
+/*  openInputString()
+    Functionality:
+            This function sets up the reader to hand out the lines of a string, used for "smallsh -c".
+    Parameters:
+            1.) Pointer to InputReader struct
+            2.) string holding one or more command lines
+    Returns:
+            Does not return anything.
+*/
+void openInputString(struct InputReader *reader, char *text)
+{
+    memset(reader, 0, sizeof(struct InputReader));
+    reader->fd = -1;
+    reader->wake_fd = -1;
+    reader->data = text;
+    reader->length = strlen(text);
+    reader->eof = 1;
+}
+
+/*  openInputFile()
+    Functionality:
+            This function opens a script file. Regular files are mapped with mmap() so that the lines can be handed
+            out without copying the file, anything else (pipes, /dev/stdin, ...) is read in blocks.
+    Parameters:
+            1.) Pointer to InputReader struct
+            2.) path of the script file
+    Returns:
+            Returns 0 on success, or -1 if the file could not be opened.
+    Sources Cited:
+            https://man7.org/linux/man-pages/man2/mmap.2.html
+*/
+int openInputFile(struct InputReader *reader, char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            close(fd);
+            memset(reader, 0, sizeof(struct InputReader));
+            reader->fd = -1;
+            reader->wake_fd = -1;
+            reader->data = map;
+            reader->length = info.st_size;
+            reader->mapped = 1;
+            reader->eof = 1;
+            madvise(map, info.st_size, MADV_SEQUENTIAL);
+            return 0;
+        }
+    }
+
+    openInputFd(reader, fd);
+    return 0;
+}
+
+/*  fillInput()
+    Functionality:
+            This function moves the unread bytes to the front of the buffer, grows the buffer if it is full, and
+            reads the next block from the file descriptor. While waiting for input the wake file descriptor is
+            polled too, and on_wake() is called every time it becomes readable.
+    Parameters:
+            1.) Pointer to InputReader struct
+    Returns:
+            Returns the number of bytes read, 0 at end of file, or -1 if read() failed (e.g. EINTR).
+*/
+ssize_t fillInput(struct InputReader *reader)
+{
+    if (reader->pos > 0)
+    {
+        memmove(reader->data, reader->data + reader->pos, reader->length - reader->pos);
+        reader->length -= reader->pos;
+        reader->pos = 0;
+    }
+
+    // A single line is longer than the buffer
+    if (reader->length == reader->capacity)
+    {
+        reader->capacity *= 2;
+        reader->data = realloc(reader->data, reader->capacity);
+    }
+
+    // Wait for input, handling wake-ups (e.g. finished background jobs) in the meantime
+    while (reader->wake_fd != -1)
+    {
+        struct pollfd fds[2] = {{reader->fd, POLLIN, 0}, {reader->wake_fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) == -1)
+        {
+            // Keep waiting if the signal was the one behind wake_fd, otherwise let the prompt be shown again
+            struct pollfd wake = {reader->wake_fd, POLLIN, 0};
+            if (errno == EINTR && poll(&wake, 1, 0) == 1)
+            {
+                continue;
+            }
+            errno = EINTR;
+            return -1;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            reader->on_wake();
+        }
+        if (fds[0].revents != 0)
+        {
+            break;
+        }
+    }
+
+    ssize_t result = read(reader->fd, reader->data + reader->length, reader->capacity - reader->length);
+    if (result > 0)
+    {
+        reader->length += result;
+    }
+    else if (result == 0)
+    {
+        reader->eof = 1;
+    }
+    return result;
+}
+
+/*  readLine()
+    Functionality:
+            This function returns the next line of input without the trailing newline. The line is not NUL
+            terminated and is only valid until the next call, so callers copy it.
+    Parameters:
+            1.) Pointer to InputReader struct
+            2.) Pointer to size_t that receives the length of the line
+    Returns:
+            Returns a pointer to the line, or NULL once all input has been read. If read() was interrupted by a
+            signal an empty line is returned so the prompt is shown again.
+*/
+char *readLine(struct InputReader *reader, size_t *length)
+{
+    while (1)
+    {
+        char *start = reader->data + reader->pos;
+        size_t available = reader->length - reader->pos;
+        char *newline = memchr(start, '\n', available);
+
+        if (newline != NULL)
+        {
+            *length = newline - start;
+            reader->pos += *length + 1;
+            return start;
+        }
+
+        if (reader->eof)
+        {
+            // Last line without a newline
+            if (available > 0)
+            {
+                *length = available;
+                reader->pos = reader->length;
+                return start;
+            }
+            return NULL;
+        }
+
+        if (fillInput(reader) == -1)
+        {
+            if (errno == EINTR)
+            {
+                *length = 0;
+                return reader->data + reader->pos;
+            }
+            perror("read()");
+            reader->eof = 1;
+        }
+    }
+}
+
+/*  closeInput()
+    Functionality:
+            This function releases a reader opened with openInputFile(): the mapping is removed, or the file
+            descriptor is closed and the read buffer freed.
+    Parameters:
+            1.) Pointer to InputReader struct
+    Returns:
+            Does not return anything.
+*/
+void closeInput(struct InputReader *reader)
+{
+    if (reader->mapped)
+    {
+        munmap(reader->data, reader->length);
+    }
+    else if (reader->capacity > 0)
+    {
+        close(reader->fd);
+        free(reader->data);
+    }
+    memset(reader, 0, sizeof(struct InputReader));
+    reader->fd = -1;
+    reader->wake_fd = -1;
+}
+
+#endif
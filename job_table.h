@@ -0,0 +1,474 @@
+/*
+    This file contains the job table for background commands. Every command or pipeline started with & is
+    added as a job, with the process IDs of its stages, the command line and its start time (a coprocess also
+    keeps its pipes in its job, see coproc.h). A SIGCHLD handler
+    writes to a self-pipe that the shell polls together with stdin, so finished children are reaped as soon
+    as they exit instead of only once per prompt.
+
+    There are twelve functions in this file:
+        1.) handleSigCHLD()
+        2.) initJobTable()
+        3.) elapsedSeconds()
+        4.) findJobProcess()
+        5.) addJob()
+        6.) removeJob()
+        7.) recordExit()
+        8.) reportJobs()
+        9.) reapJobs()
+        10.) waitForJob()
+        11.) jobsCommand()
+        12.) waitCommand()
+*/
+
+#ifndef JOB_TABLE_H
+#define JOB_TABLE_H
+
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include "helper_functions.h"
+#include "built_in_commands.h"
+#include "stats.h"
+#include "variables.h"
+#include "trace.h"
+
+#define JOB_BUCKETS 1024
+
+#define JOB_RUNNING 0
+#define JOB_DONE 1
+
+/*
+    Data Members:
+        id: (int) ->                    job number shown by the jobs builtin
+        pids: (pid_t array) ->          process IDs of every stage of the job
+        count: (int) ->                 number of stages
+        remaining: (int) ->             number of stages that have not been reaped yet
+        command: (string) ->            command line the job was started with
+        start: (timespec) ->            time the job was started
+        end: (timespec) ->              time the last stage was reaped
+        state: (int) ->                 JOB_RUNNING or JOB_DONE
+        status: (int) ->                wait status of the last stage
+        coproc: (Coproc pointer) ->     coprocess started by the coproc built in, or NULL
+        prev/next: (Job pointer) ->     neighbours in the order the jobs were started
+*/
+struct Job
+{
+    int id;
+    pid_t *pids;
+    int count;
+    int remaining;
+    char *command;
+    struct timespec start;
+    struct timespec end;
+    int state;
+    int status;
+    struct Coproc *coproc;
+    struct Job *prev;
+    struct Job *next;
+};
+
+/*
+    Data Members:
+        pid: (pid_t) ->                     process ID of one stage
+        name: (string) ->                   command name of the stage, used for the stats built in
+        job: (Job pointer) ->               job the process belongs to
+        next: (JobProcess pointer) ->       next process in the same bucket
+*/
+struct JobProcess
+{
+    pid_t pid;
+    char *name;
+    struct Job *job;
+    struct JobProcess *next;
+};
+
+struct JobProcess *jobProcesses[JOB_BUCKETS];
+struct Job *firstJob = NULL;
+struct Job *lastJob = NULL;
+int nextJobId = 1;
+int runningJobs = 0;
+
+// Self-pipe written by handleSigCHLD(), the read end is polled with stdin
+int childPipe[2] = {-1, -1};
+
+// Defined in coproc.h
+struct Coproc;
+void detachCoproc(struct Coproc *coproc);
+
+/*  handleSigCHLD()
+    Functionality:
+            This function handles SIGCHLD by writing a byte to the self-pipe. Reaping is done later by reapJobs(),
+            outside of the signal handler.
+    Parameters:
+            1.) signal int sent to the shell
+    Returns:
+            Does not return anything.
+*/
+void handleSigCHLD(int sig)
+{
+    int saved_errno = errno;
+    char byte = 0;
+    write(childPipe[1], &byte, 1);
+    errno = saved_errno;
+}
+
+/*  initJobTable()
+    Functionality:
+            This function creates the non-blocking self-pipe and installs the SIGCHLD handler. SA_RESTART keeps
+            foreground waitpid() calls from being interrupted when a background job finishes.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void initJobTable()
+{
+    if (pipe2(childPipe, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        perror("pipe()");
+        exit(1);
+    }
+
+    struct sigaction SIGCHLD_action = {{0}};
+    SIGCHLD_action.sa_handler = handleSigCHLD;
+    sigfillset(&SIGCHLD_action.sa_mask);
+    SIGCHLD_action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &SIGCHLD_action, NULL);
+}
+
+/*  elapsedSeconds()
+    Functionality:
+            This function returns the number of seconds between two monotonic clock readings.
+    Parameters:
+            1.) Pointer to start time
+            2.) Pointer to end time
+    Returns:
+            Returns the elapsed time in seconds.
+*/
+double elapsedSeconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*  findJobProcess()
+    Functionality:
+            This function finds the link that points to the table entry of a process ID.
+    Parameters:
+            1.) process ID
+    Returns:
+            Returns the link to the entry, or a link holding NULL if the process ID is not in the table.
+*/
+struct JobProcess **findJobProcess(pid_t pid)
+{
+    struct JobProcess **link = &jobProcesses[pid % JOB_BUCKETS];
+    while (*link != NULL && (*link)->pid != pid)
+    {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/*  addJob()
+    Functionality:
+            This function adds a background job with the process IDs of its stages to the table and prints
+            the process ID of the last stage, which is also kept for $!.
+    Parameters:
+            1.) array of process IDs, one per stage
+            2.) number of process IDs
+            3.) Pointer to the first Command struct of the job, for the command line and stage names
+    Returns:
+            Returns the new Job struct.
+*/
+struct Job *addJob(pid_t *pids, int count, struct Command *head)
+{
+    char *command = head->line;
+    struct Job *job = calloc(1, sizeof(struct Job));
+    job->id = nextJobId++;
+    job->pids = malloc(count * sizeof(pid_t));
+    memcpy(job->pids, pids, count * sizeof(pid_t));
+    job->count = count;
+    job->remaining = count;
+    job->command = strdup(command != NULL ? command : "");
+    job->state = JOB_RUNNING;
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+
+    struct Command *stage = head;
+    for (int i = 0; i < count; i++)
+    {
+        struct JobProcess *process = malloc(sizeof(struct JobProcess));
+        process->pid = pids[i];
+        process->name = strdup(stage != NULL && stage->cmd_args[0] != NULL ? stage->cmd_args[0] : "");
+        stage = stage != NULL ? stage->next : NULL;
+        process->job = job;
+        process->next = jobProcesses[pids[i] % JOB_BUCKETS];
+        jobProcesses[pids[i] % JOB_BUCKETS] = process;
+    }
+
+    // Append to the list in the order the jobs were started
+    job->prev = lastJob;
+    if (lastJob != NULL)
+    {
+        lastJob->next = job;
+    }
+    else
+    {
+        firstJob = job;
+    }
+    lastJob = job;
+    runningJobs++;
+
+    lastBackgroundPid = pids[count - 1];
+    printf("background pid is %d\n", pids[count - 1]);
+    flushOutput();
+    return job;
+}
+
+/*  removeJob()
+    Functionality:
+            This function unlinks a finished job from the table and frees it. The pipes of a coprocess are
+            handed to detachCoproc().
+    Parameters:
+            1.) Pointer to Job struct
+    Returns:
+            Does not return anything.
+*/
+void removeJob(struct Job *job)
+{
+    for (int i = 0; i < job->count; i++)
+    {
+        struct JobProcess **link = findJobProcess(job->pids[i]);
+        if (*link != NULL)
+        {
+            struct JobProcess *process = *link;
+            *link = process->next;
+            free(process->name);
+            free(process);
+        }
+    }
+
+    if (job->prev != NULL)
+    {
+        job->prev->next = job->next;
+    }
+    else
+    {
+        firstJob = job->next;
+    }
+    if (job->next != NULL)
+    {
+        job->next->prev = job->prev;
+    }
+    else
+    {
+        lastJob = job->prev;
+    }
+
+    if (job->coproc != NULL)
+    {
+        detachCoproc(job->coproc);
+    }
+    free(job->pids);
+    free(job->command);
+    free(job);
+}
+
+/*  recordExit()
+    Functionality:
+            This function records a reaped process in the table and adds its resource usage to the stats.
+            The job is marked done once all of its stages have been reaped, and its status is the status of
+            the last stage.
+    Parameters:
+            1.) process ID that was reaped
+            2.) wait status of the process
+            3.) Pointer to rusage struct filled in by wait4()
+    Returns:
+            Returns the Job struct the process belonged to, or NULL if it was not a background job.
+*/
+struct Job *recordExit(pid_t pid, int status, struct rusage *usage)
+{
+    struct JobProcess *process = *findJobProcess(pid);
+    if (process == NULL)
+    {
+        return NULL;
+    }
+    recordUsage(process->name, &process->job->start, usage);
+    traceEvent("job", process->name, pid, traceTime(&process->job->start));
+
+    struct Job *job = process->job;
+    if (pid == job->pids[job->count - 1])
+    {
+        job->status = status;
+    }
+    job->remaining--;
+    if (job->remaining == 0)
+    {
+        job->state = JOB_DONE;
+        clock_gettime(CLOCK_MONOTONIC, &job->end);
+        runningJobs--;
+    }
+    return job;
+}
+
+/*  reportJobs()
+    Functionality:
+            This function prints the completion notice of every finished job and removes it from the table.
+    Parameters:
+            N/A
+    Returns:
+            Returns the number of notices printed.
+*/
+int reportJobs()
+{
+    int reported = 0;
+    struct Job *job = firstJob;
+    while (job != NULL)
+    {
+        struct Job *next = job->next;
+        if (job->state == JOB_DONE)
+        {
+            printf("background process %d is done: ", job->pids[job->count - 1]);
+            getStatus(job->status);
+            removeJob(job);
+            reported++;
+        }
+        job = next;
+    }
+    return reported;
+}
+
+/*  reapJobs()
+    Functionality:
+            This function drains the self-pipe and reaps every finished child with wait4() and WNOHANG in a loop,
+            then prints the notices of the jobs that are done.
+    Parameters:
+            N/A
+    Returns:
+            Returns the number of notices printed.
+*/
+int reapJobs()
+{
+    char buffer[256];
+    while (read(childPipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0)
+    {
+        recordExit(pid, status, &usage);
+    }
+    return reportJobs();
+}
+
+/*  waitForJob()
+    Functionality:
+            This function blocks until a background job is done. The notices of all jobs that finish in the
+            meantime are printed as usual.
+    Parameters:
+            1.) job to wait for, or NULL to wait for whichever job finishes next
+    Returns:
+            Returns the wait status of the job, or -1 if there was nothing to wait for.
+*/
+int waitForJob(struct Job *target)
+{
+    while (runningJobs > 0)
+    {
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        struct Job *job = recordExit(pid, status, &usage);
+        if (job != NULL && job->state == JOB_DONE && (target == NULL || job == target))
+        {
+            int result = job->status;
+            reportJobs();
+            return result;
+        }
+    }
+    reportJobs();
+    return -1;
+}
+
+/*  jobsCommand()
+    Functionality:
+            This function is the jobs built in. It lists every background job that is still running with its
+            job number, process ID, running time and command line.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything. Prints the job table.
+*/
+void jobsCommand()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (struct Job *job = firstJob; job != NULL; job = job->next)
+    {
+        printf("[%d] %d %s %.3fs %s\n", job->id, job->pids[job->count - 1],
+               job->state == JOB_RUNNING ? "Running" : "Done",
+               elapsedSeconds(&job->start, job->state == JOB_RUNNING ? &now : &job->end), job->command);
+    }
+    flushOutput();
+}
+
+/*  waitCommand()
+    Functionality:
+            This function is the wait built in. "wait" waits for every background job, "wait pid" waits for the
+            job with that process ID and "wait -n" waits for the next job to finish.
+    Parameters:
+            1.) cmd_args char array that holds the command(wait) at index [0] and the option/process ID after it
+            2.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything. Updates the exit status with the status of the job waited on.
+*/
+void waitCommand(char **cmd_args, int *exitStatus)
+{
+    int status = -1;
+
+    if (cmd_args[1] == NULL)
+    {
+        while (runningJobs > 0)
+        {
+            status = waitForJob(NULL);
+        }
+    }
+    else if (strcmp(cmd_args[1], "-n") == 0)
+    {
+        status = waitForJob(NULL);
+    }
+    else
+    {
+        pid_t pid = atoi(cmd_args[1]);
+        struct JobProcess *process = pid > 0 ? *findJobProcess(pid) : NULL;
+        if (process == NULL)
+        {
+            printf("wait: pid %s is not a child of this shell\n", cmd_args[1]);
+            flushOutput();
+            return;
+        }
+        status = waitForJob(process->job);
+    }
+
+    if (status != -1)
+    {
+        *exitStatus = status;
+    }
+}
+
+#endif
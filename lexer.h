@@ -0,0 +1,675 @@
+/*
+    This file contains the single-pass lexer that splits a command line into words and operators.
+    Words may be quoted ('...' keeps everything literal, "..." still expands $ and allows \" \\ \$),
+    a backslash escapes the next character, and every $$, $?, $!, $NAME and ${NAME} outside single quotes is
+    expanded by expandVariable() in variables.h. The unquoted operators are | < > & ; >> 2> 2>> &> &>> <<< and
+    the duplications N>&M (1>&2 or >&2, 2>&1, and 1>&1 and 2>&2 which do nothing), where 1 and 2 only count
+    when they start the operator. >&word is the same as &>word. An unquoted # at the start of a word begins a
+    comment. There is no limit on the number of words.
+
+    A word with an unquoted *, ? or [ also gets a glob pattern for expandGlob() in glob.h, in which the glob
+    characters that were quoted or escaped are escaped with a backslash. Lines without any of the three
+    characters skip this bookkeeping.
+
+    The hot loop skips runs of ordinary characters with SSE2 or AVX2 compares (picked at startup),
+    with a scalar lookup table as the fallback. SMALLSH_SIMD=scalar|sse2|avx2 forces one of them.
+
+    There are eleven functions in this file:
+        1.) buildLexSet()
+        2.) scanScalar()
+        3.) scanSSE2()
+        4.) scanAVX2()
+        5.) initLexer()
+        6.) lexDuplicate()
+        7.) lexOperator()
+        8.) markLiterals()
+        9.) markExpansion()
+        10.) globPattern()
+        11.) tokenizeLine()
+*/
+
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "arena.h"
+#include "variables.h"
+
+#define TOKEN_WORD 0
+#define TOKEN_PIPE 1
+#define TOKEN_INPUT 2
+#define TOKEN_OUTPUT 3
+#define TOKEN_BACKGROUND 4
+#define TOKEN_APPEND 5
+#define TOKEN_ERROR 6
+#define TOKEN_ERROR_APPEND 7
+#define TOKEN_ERROR_TO_OUTPUT 8
+#define TOKEN_OUTPUT_ALL 9
+#define TOKEN_APPEND_ALL 10
+#define TOKEN_HERE_STRING 11
+#define TOKEN_SEMI 12
+#define TOKEN_OUTPUT_TO_ERROR 13
+// Returned by lexOperator() for 1>&1 and 2>&2, which leave no token
+#define TOKEN_NOTHING -1
+// Returned by lexOperator() for a duplication of any other descriptor
+#define TOKEN_BAD_DESCRIPTOR -2
+
+// Text of every token type, indexed by type, used in syntax errors
+const char *tokenNames[] = {"word", "|", "<", ">", "&", ">>", "2>", "2>>", "2>&1", "&>", "&>>", "<<<", ";", ">&2"};
+
+#define LEXER_MAX_SET 20
+
+// Bytes the vector scans check one at a time before they set up the compares
+#define LEXER_SCALAR_PREFIX 16
+
+/*
+    Data Members:
+        type: (int) ->      TOKEN_WORD or one of the operator types
+        text: (string) ->   text of a word after quote removal and expansion, NULL for operators
+        pattern: (string) -> glob pattern of a word with an unquoted *, ? or [, otherwise NULL
+        source: (string) ->  the word as it appears in the line, before quote removal and expansion
+        source_length: (size_t) -> length of source
+*/
+struct Token
+{
+    int type;
+    char *text;
+    char *pattern;
+    const char *source;
+    size_t source_length;
+};
+
+/*
+    Data Members:
+        active: (int) ->            1 if the line contains a *, ? or [, otherwise nothing is tracked
+        glob: (int) ->              1 if the current word has an unquoted *, ? or [
+        literal: (string array) ->  positions in the word buffer of characters that have to match literally
+        count: (int) ->             number of positions in literal for the current word
+*/
+struct GlobMarks
+{
+    int active;
+    int glob;
+    char **literal;
+    int count;
+};
+
+/*
+    Data Members:
+        chars: (string) ->              characters that end a run of ordinary characters
+        count: (int) ->                 number of characters in chars
+        table: (unsigned char array) -> lookup table for the scalar scan, 1 for every char in chars
+*/
+struct LexSet
+{
+    const char *chars;
+    int count;
+    unsigned char table[256];
+};
+
+// Characters that need attention outside of quotes and inside double quotes
+struct LexSet unquotedSet;
+struct LexSet doubleQuotedSet;
+
+// Scan routine picked by initLexer()
+size_t (*scanSpecial)(const char *text, size_t length, struct LexSet *set);
+
+/*  buildLexSet()
+    Functionality:
+            This function fills in a LexSet struct for a set of special characters.
+    Parameters:
+            1.) Pointer to LexSet struct
+            2.) string of special characters
+    Returns:
+            Does not return anything.
+*/
+void buildLexSet(struct LexSet *set, const char *chars)
+{
+    memset(set, 0, sizeof(struct LexSet));
+    set->chars = chars;
+    set->count = strlen(chars);
+    for (int i = 0; i < set->count; i++)
+    {
+        set->table[(unsigned char)chars[i]] = 1;
+    }
+}
+
+/*  scanScalar()
+    Functionality:
+            This function returns the length of the run of ordinary characters at the start of text, one byte
+            at a time using the lookup table of the set.
+    Parameters:
+            1.) text to scan
+            2.) number of bytes left in text
+            3.) Pointer to LexSet struct
+    Returns:
+            Returns the offset of the first special character, or length if there is none.
+*/
+size_t scanScalar(const char *text, size_t length, struct LexSet *set)
+{
+    size_t i = 0;
+    while (i < length && !set->table[(unsigned char)text[i]])
+    {
+        i++;
+    }
+    return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*  scanSSE2()
+    Functionality:
+            This function does the same as scanScalar() 16 bytes at a time. Every chunk is compared with each
+            special character and the first match is found from the movemask of the combined compares.
+            The first LEXER_SCALAR_PREFIX bytes, which hold most words whole, and the tail that does not fill a
+            chunk are checked by scanScalar().
+    Parameters:
+            1.) text to scan
+            2.) number of bytes left in text
+            3.) Pointer to LexSet struct
+    Returns:
+            Returns the offset of the first special character, or length if there is none.
+*/
+__attribute__((target("sse2"))) size_t scanSSE2(const char *text, size_t length, struct LexSet *set)
+{
+    // Most words are shorter than a chunk, so the first bytes are checked one at a time
+    size_t i = scanScalar(text, length < LEXER_SCALAR_PREFIX ? length : LEXER_SCALAR_PREFIX, set);
+    if (i < LEXER_SCALAR_PREFIX)
+    {
+        return i;
+    }
+    if (length - i >= 16)
+    {
+        __m128i needles[LEXER_MAX_SET];
+        for (int k = 0; k < set->count; k++)
+        {
+            needles[k] = _mm_set1_epi8(set->chars[k]);
+        }
+
+        for (; i + 16 <= length; i += 16)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+            __m128i hits = _mm_setzero_si128();
+            for (int k = 0; k < set->count; k++)
+            {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[k]));
+            }
+            int mask = _mm_movemask_epi8(hits);
+            if (mask != 0)
+            {
+                return i + __builtin_ctz(mask);
+            }
+        }
+    }
+    return i + scanScalar(text + i, length - i, set);
+}
+
+/*  scanAVX2()
+    Functionality:
+            This function is the 32 byte wide version of scanSSE2(), used when the CPU supports AVX2.
+    Parameters:
+            1.) text to scan
+            2.) number of bytes left in text
+            3.) Pointer to LexSet struct
+    Returns:
+            Returns the offset of the first special character, or length if there is none.
+*/
+__attribute__((target("avx2"))) size_t scanAVX2(const char *text, size_t length, struct LexSet *set)
+{
+    size_t i = scanScalar(text, length < LEXER_SCALAR_PREFIX ? length : LEXER_SCALAR_PREFIX, set);
+    if (i < LEXER_SCALAR_PREFIX)
+    {
+        return i;
+    }
+    if (length - i >= 32)
+    {
+        __m256i needles[LEXER_MAX_SET];
+        for (int k = 0; k < set->count; k++)
+        {
+            needles[k] = _mm256_set1_epi8(set->chars[k]);
+        }
+
+        for (; i + 32 <= length; i += 32)
+        {
+            __m256i chunk = _mm256_loadu_si256((const __m256i *)(text + i));
+            __m256i hits = _mm256_setzero_si256();
+            for (int k = 0; k < set->count; k++)
+            {
+                hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, needles[k]));
+            }
+            unsigned int mask = _mm256_movemask_epi8(hits);
+            if (mask != 0)
+            {
+                return i + __builtin_ctz(mask);
+            }
+        }
+    }
+    return i + scanSSE2(text + i, length - i, set);
+}
+
+#endif
+
+/*  initLexer()
+    Functionality:
+            This function builds the special character sets and picks the widest scan routine the CPU supports,
+            unless SMALLSH_SIMD asks for a specific one.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void initLexer()
+{
+    buildLexSet(&unquotedSet, " \t\r\n'\"\\$|<>&;*?[");
+    buildLexSet(&doubleQuotedSet, "\"\\$");
+
+    char *simd = getenv("SMALLSH_SIMD");
+    scanSpecial = scanScalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (simd != NULL && strcmp(simd, "scalar") == 0)
+    {
+        scanSpecial = scanScalar;
+    }
+    else if (simd == NULL || strcmp(simd, "sse2") != 0)
+    {
+        if (__builtin_cpu_supports("avx2"))
+        {
+            scanSpecial = scanAVX2;
+        }
+        else if (__builtin_cpu_supports("sse2"))
+        {
+            scanSpecial = scanSSE2;
+        }
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        scanSpecial = scanSSE2;
+    }
+#else
+    (void)simd;
+#endif
+}
+
+/*  lexDuplicate()
+    Functionality:
+            This function reads the >&M part of a duplication. Only stdout and stderr can be duplicated, the
+            shell does not keep any other descriptors open for its commands.
+    Parameters:
+            1.) text starting at the >
+            2.) length of the text
+            3.) descriptor that is replaced, 1 or 2
+            4.) number of characters in front of the >, 1 if the descriptor was written and otherwise 0
+            5.) Pointer that receives the length of the operator
+    Returns:
+            Returns TOKEN_OUTPUT_TO_ERROR, TOKEN_ERROR_TO_OUTPUT, TOKEN_NOTHING if both descriptors are the same, or
+            TOKEN_BAD_DESCRIPTOR.
+*/
+int lexDuplicate(const char *text, size_t length, int from, size_t prefix, size_t *size)
+{
+    size_t end = 2;
+    while (end < length && text[end] >= '0' && text[end] <= '9')
+    {
+        end++;
+    }
+    *size = prefix + end;
+    if (end != 3 || (text[2] != '1' && text[2] != '2'))
+    {
+        return TOKEN_BAD_DESCRIPTOR;
+    }
+    if (text[2] - '0' == from)
+    {
+        return TOKEN_NOTHING;
+    }
+    return from == 1 ? TOKEN_OUTPUT_TO_ERROR : TOKEN_ERROR_TO_OUTPUT;
+}
+
+/*  lexOperator()
+    Functionality:
+            This function recognises the operator at the start of the text, taking the longest match.
+    Parameters:
+            1.) text at the start of a token
+            2.) number of bytes left in text
+            3.) Pointer to size_t that receives the length of the operator
+    Returns:
+            Returns the token type of the operator, TOKEN_NOTHING or TOKEN_BAD_DESCRIPTOR for a duplication (see
+            lexDuplicate()), or TOKEN_WORD if the text does not start with an operator.
+*/
+int lexOperator(const char *text, size_t length, size_t *size)
+{
+    char next = length > 1 ? text[1] : '\0';
+    char third = length > 2 ? text[2] : '\0';
+    *size = 1;
+    switch (text[0])
+    {
+    case '|':
+        return TOKEN_PIPE;
+    case ';':
+        return TOKEN_SEMI;
+    case '<':
+        if (next == '<' && third == '<')
+        {
+            *size = 3;
+            return TOKEN_HERE_STRING;
+        }
+        return TOKEN_INPUT;
+    case '>':
+        if (next == '>')
+        {
+            *size = 2;
+            return TOKEN_APPEND;
+        }
+        if (next == '&')
+        {
+            // >&word sends both streams to the file like &>word
+            if (third < '0' || third > '9')
+            {
+                *size = 2;
+                return TOKEN_OUTPUT_ALL;
+            }
+            return lexDuplicate(text, length, 1, 0, size);
+        }
+        return TOKEN_OUTPUT;
+    case '&':
+        if (next == '>')
+        {
+            *size = third == '>' ? 3 : 2;
+            return third == '>' ? TOKEN_APPEND_ALL : TOKEN_OUTPUT_ALL;
+        }
+        return TOKEN_BACKGROUND;
+    case '1':
+    case '2':
+        if (next != '>')
+        {
+            return TOKEN_WORD;
+        }
+        if (third == '&')
+        {
+            return lexDuplicate(text + 1, length - 1, text[0] - '0', 1, size);
+        }
+        if (text[0] == '1')
+        {
+            *size = third == '>' ? 3 : 2;
+            return third == '>' ? TOKEN_APPEND : TOKEN_OUTPUT;
+        }
+        if (third == '>')
+        {
+            *size = 3;
+            return TOKEN_ERROR_APPEND;
+        }
+        *size = 2;
+        return TOKEN_ERROR;
+    }
+    return TOKEN_WORD;
+}
+
+/*  markLiterals()
+    Functionality:
+            This function records the glob characters (and backslashes) of quoted or escaped text written to the
+            word buffer, so the glob pattern of the word matches them literally.
+    Parameters:
+            1.) Pointer to GlobMarks struct
+            2.) start of the text in the word buffer
+            3.) end of the text in the word buffer
+    Returns:
+            Does not return anything.
+*/
+static inline void markLiterals(struct GlobMarks *marks, char *from, char *to)
+{
+    if (!marks->active)
+    {
+        return;
+    }
+    for (; from < to; from++)
+    {
+        if (*from == '*' || *from == '?' || *from == '[' || *from == '\\')
+        {
+            marks->literal[marks->count++] = from;
+        }
+    }
+}
+
+/*  markExpansion()
+    Functionality:
+            This function looks at the value of an unquoted $ expansion. Its glob characters are live like in
+            other shells, but a backslash in the value is matched literally.
+    Parameters:
+            1.) Pointer to GlobMarks struct
+            2.) start of the value in the word buffer
+            3.) end of the value in the word buffer
+    Returns:
+            Does not return anything.
+*/
+static inline void markExpansion(struct GlobMarks *marks, char *from, char *to)
+{
+    for (; from < to; from++)
+    {
+        if (*from == '*' || *from == '?' || *from == '[')
+        {
+            marks->glob = 1;
+        }
+        else if (*from == '\\' && marks->active)
+        {
+            marks->literal[marks->count++] = from;
+        }
+    }
+}
+
+/*  globPattern()
+    Functionality:
+            This function builds the glob pattern of a word, putting a backslash in front of every position
+            recorded by markLiterals() and markExpansion().
+    Parameters:
+            1.) Pointer to GlobMarks struct
+            2.) word
+            3.) length of the word
+    Returns:
+            Returns the pattern, which is the word itself if nothing had to be escaped.
+*/
+char *globPattern(struct GlobMarks *marks, char *word, size_t length)
+{
+    if (marks->count == 0)
+    {
+        return word;
+    }
+
+    char *pattern = arenaAlloc(&lineArena, length + marks->count + 1);
+    char *out = pattern;
+    int next = 0;
+    for (char *c = word; c < word + length; c++)
+    {
+        if (next < marks->count && marks->literal[next] == c)
+        {
+            *out++ = '\\';
+            next++;
+        }
+        *out++ = *c;
+    }
+    return pattern;
+}
+
+/*  tokenizeLine()
+    Functionality:
+            This function splits a command line into tokens in a single pass. The words are written into one buffer
+            taken from the per-line arena, which is sized up front from the expansion of every $ in the line.
+            Words with unquoted glob characters also get their glob pattern.
+    Parameters:
+            1.) command line
+            2.) length of the command line
+            3.) process ID of the shell as a string
+            4.) Pointer that receives the array of tokens
+    Returns:
+            Returns the number of tokens, -1 if a quote was not closed, or -2 if a duplication names a descriptor
+            other than 1 or 2.
+*/
+int tokenizeLine(const char *line, size_t length, const char *process_id, struct Token **result)
+{
+    // Room for every $ to be expanded, even the ones that turn out to be quoted
+    size_t expansion = 0;
+    for (const char *d = memchr(line, '$', length); d != NULL; d = memchr(d + 1, '$', line + length - d - 1))
+    {
+        size_t pos = d - line;
+        expansion += expandVariable(line, length, &pos, NULL, process_id);
+    }
+
+    size_t buffer_size = 2 * length + expansion + 2;
+    char *out = arenaAlloc(&lineArena, buffer_size);
+    struct Token *tokens = arenaAlloc(&lineArena, (length + 1) * sizeof(struct Token));
+
+    // Glob characters are only tracked when the line has any
+    struct GlobMarks marks = {0};
+    marks.active = memchr(line, '*', length) != NULL || memchr(line, '?', length) != NULL ||
+                   memchr(line, '[', length) != NULL;
+    if (marks.active)
+    {
+        marks.literal = arenaAlloc(&lineArena, buffer_size * sizeof(char *));
+    }
+    int count = 0;
+    size_t i = 0;
+
+    while (1)
+    {
+        // Skip the blanks between tokens
+        while (i < length && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r' || line[i] == '\n'))
+        {
+            i++;
+        }
+        if (i >= length || line[i] == '#')
+        {
+            break;
+        }
+
+        // Operators
+        size_t size;
+        int type = lexOperator(line + i, length - i, &size);
+        if (type == TOKEN_BAD_DESCRIPTOR)
+        {
+            return -2;
+        }
+        if (type == TOKEN_NOTHING)
+        {
+            i += size;
+            continue;
+        }
+        if (type != TOKEN_WORD)
+        {
+            tokens[count].type = type;
+            tokens[count].text = NULL;
+            count++;
+            i += size;
+            continue;
+        }
+
+        // Word, made of unquoted, single quoted and double quoted parts
+        char c;
+        char *word = out;
+        size_t source = i;
+        marks.glob = 0;
+        marks.count = 0;
+        while (i < length)
+        {
+            size_t run = scanSpecial(line + i, length - i, &unquotedSet);
+            memcpy(out, line + i, run);
+            out += run;
+            i += run;
+            if (i >= length)
+            {
+                break;
+            }
+
+            c = line[i];
+            if (c == '\'')
+            {
+                const char *close = memchr(line + i + 1, '\'', length - i - 1);
+                if (close == NULL)
+                {
+                    return -1;
+                }
+                size_t quoted = close - (line + i + 1);
+                memcpy(out, line + i + 1, quoted);
+                markLiterals(&marks, out, out + quoted);
+                out += quoted;
+                i += quoted + 2;
+            }
+            else if (c == '"')
+            {
+                char *quoted = out;
+                i++;
+                while (1)
+                {
+                    run = scanSpecial(line + i, length - i, &doubleQuotedSet);
+                    memcpy(out, line + i, run);
+                    out += run;
+                    i += run;
+                    if (i >= length)
+                    {
+                        return -1;
+                    }
+                    if (line[i] == '"')
+                    {
+                        markLiterals(&marks, quoted, out);
+                        i++;
+                        break;
+                    }
+                    if (line[i] == '$')
+                    {
+                        expandVariable(line, length, &i, &out, process_id);
+                    }
+                    else
+                    {
+                        // Inside double quotes a backslash only escapes " \ and $
+                        if (i + 1 < length && strchr("\"\\$", line[i + 1]) != NULL)
+                        {
+                            i++;
+                        }
+                        *out++ = line[i++];
+                    }
+                }
+            }
+            else if (c == '\\')
+            {
+                if (i + 1 < length)
+                {
+                    *out++ = line[i + 1];
+                    markLiterals(&marks, out - 1, out);
+                }
+                i += 2;
+            }
+            else if (c == '$')
+            {
+                char *value = out;
+                expandVariable(line, length, &i, &out, process_id);
+                markExpansion(&marks, value, out);
+            }
+            else if (c == '*' || c == '?' || c == '[')
+            {
+                marks.glob = 1;
+                *out++ = c;
+                i++;
+            }
+            else
+            {
+                // Blank or operator ends the word
+                break;
+            }
+        }
+
+        tokens[count].pattern = marks.glob ? globPattern(&marks, word, out - word) : NULL;
+        *out++ = '\0';
+        tokens[count].type = TOKEN_WORD;
+        tokens[count].text = word;
+        tokens[count].source = line + source;
+        tokens[count].source_length = i - source;
+        count++;
+    }
+
+    *result = tokens;
+    return count;
+}
+
+#endif
@@ -1,14 +1,21 @@
 /*
     This file contains the main entry function of the program. This file utilizes the
-    Command.h file where the Command struct is defined, as well as the helper_functions.h file and the built_in_commands.h file.
+    Command.h file where the Command struct is defined, as well as the helper_functions.h file, the built_in_commands.h file and the
+    builtin_registry.h file that maps command names to built ins.
 
     There function in this file:
         1.) handleSigINT()
         2.) handleSigSTP()
-        3.) getCommand()
-        4.) main()
+        3.) wakeForJobs()
+        4.) parseTokens()
+        5.) getCommand()
+        6.) runCommand()
+        7.) runInput()
+        8.) main()
 */
 
+#define _GNU_SOURCE
+
 #include <sys/wait.h>
 #include <signal.h>
 #include <stdio.h>
@@ -17,12 +24,28 @@
 #include <string.h>
 #include <stdlib.h>
 #include "Command.h"
+#include "arena.h"
+#include "input_reader.h"
+#include "variables.h"
+#include "lexer.h"
+#include "glob.h"
 #include "helper_functions.h"
 #include "built_in_commands.h"
+#include "redirect.h"
+#include "spawn.h"
+#include "stats.h"
+#include "job_table.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "history.h"
+#include "trace.h"
+#include "placement.h"
+#include "builtin_registry.h"
+#include "script.h"
+#include "serve.h"
 
 
 int noBackgroundMode = 0;
-int arg_flag;
 int childExitStatus;
 
 /*  handleSigINT()
@@ -53,8 +76,6 @@ void handleSigINT(int sig)
 */
 void handleSigSTP(int sig)
 {
-        // Trigger the arg_flag so that the command prompt ignores the & input
-        arg_flag = 1;
         if (noBackgroundMode == 0)
         {
                 char *message = "\nEntering foreground-only mode (& is now ignored)\n";
@@ -71,121 +92,414 @@ void handleSigSTP(int sig)
         }
 }
 
+/*  wakeForJobs()
+    Functionality: 
+            This function is called by the line reader when a child exits while the shell waits for input.
+            It reaps the finished jobs, and shows the prompt again if any notices were printed over it.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void wakeForJobs()
+{
+        if (reapJobs() > 0 && batchMode == 0)
+        {
+                printf(":: ");
+                fflush(stdout);
+        }
+}
+
+/*  parseTokens()
+    Functionality: 
+            This function turns the tokens of one command into Command structs, one for every stage of a
+            pipeline. It assigns the arguments, the redirections and the background flag, and replaces glob
+            patterns by the paths they match. Lines read by getCommand() and the commands of a compiled program
+            both come through here.
+    Parameters:
+            1.) array of tokens
+            2.) number of tokens
+    Returns:
+            returns the newly created Command struct, allocated from the per-line arena. Its cmd_args[0] is NULL
+            if there is nothing to run.
+*/
+struct Command *parseTokens(struct Token *tokens, int count)
+{
+        // Previous token to spot a trailing &
+        int prev_type = TOKEN_WORD;
+
+        // Allocate memory for a new Command struct from the per-line arena
+        struct Command *new_command = arenaAlloc(&lineArena, sizeof(struct Command));
+        // Stage of the pipeline that tokens are currently added to
+        struct Command *stage = new_command;
+        // Arguments of the current stage, copied into a vector of the exact size once the stage ends
+        char **args;
+        int arg = 0;
+
+        // Without globs no stage can hold more arguments than there are tokens, glob matches grow the vector
+        int capacity = count + 1;
+        args = arenaAlloc(&lineArena, capacity * sizeof(char *));
+
+        for (int i = 0; i < count; i++)
+        {
+                int type = tokens[i].type;
+
+                // A "|" ends the current stage and starts the next stage of the pipeline
+                if (type == TOKEN_PIPE)
+                {
+                        setCommandArgs(stage, args, arg);
+                        stage->next = arenaAlloc(&lineArena, sizeof(struct Command));
+                        stage = stage->next;
+                        arg = 0;
+                }
+                // "2>&1" sends stderr wherever stdout goes, before or after a later > file
+                // After ">&2" stdout already goes to stderr, so it changes nothing (and the same the other way round)
+                else if (type == TOKEN_ERROR_TO_OUTPUT)
+                {
+                        if (stage->output_to_error == 0)
+                        {
+                                stage->error_to_output = stage->output_file == NULL ? STDERR_BEFORE_OUTPUT : STDERR_AFTER_OUTPUT;
+                                stage->error_file = NULL;
+                        }
+                }
+                // ">&2" sends stdout wherever stderr goes, before or after a later 2> file
+                else if (type == TOKEN_OUTPUT_TO_ERROR)
+                {
+                        if (stage->error_to_output == 0)
+                        {
+                                stage->output_to_error = stage->error_file == NULL ? STDOUT_BEFORE_ERROR : STDOUT_AFTER_ERROR;
+                                stage->output_file = NULL;
+                                stage->tee_count = 0;
+                        }
+                }
+                // The other redirections take the next word as the file name (or the here-string)
+                else if (type != TOKEN_WORD && type != TOKEN_BACKGROUND)
+                {
+                        if (i + 1 >= count || tokens[i + 1].type != TOKEN_WORD)
+                        {
+                                printf("syntax error near unexpected token '%s'\n",
+                                       i + 1 >= count ? "newline" : tokenNames[tokens[i + 1].type]);
+                                flushOutput();
+                                arg = 0;
+                                stage = new_command;
+                                stage->next = NULL;
+                                break;
+                        }
+                        i++;
+                        if (type == TOKEN_INPUT)
+                        {
+                                // set Command struct input_file data member 
+                                stage->input_file = tokens[i].text;
+                                stage->here_string = NULL;
+                        }
+                        else if (type == TOKEN_HERE_STRING)
+                        {
+                                stage->here_string = tokens[i].text;
+                                stage->input_file = NULL;
+                        }
+                        else if (type == TOKEN_ERROR || type == TOKEN_ERROR_APPEND)
+                        {
+                                stage->error_file = tokens[i].text;
+                                stage->error_append = type == TOKEN_ERROR_APPEND;
+                                stage->error_to_output = 0;
+                        }
+                        else
+                        {
+                                int append = type == TOKEN_APPEND || type == TOKEN_APPEND_ALL;
+                                stage->output_to_error = 0;
+                                if (type == TOKEN_OUTPUT_ALL || type == TOKEN_APPEND_ALL)
+                                {
+                                        stage->error_to_output = STDERR_AFTER_OUTPUT;
+                                        stage->error_file = NULL;
+                                }
+                                // set Command struct output_file data member, further files fan out
+                                if (stage->output_file == NULL)
+                                {
+                                        stage->output_file = tokens[i].text;
+                                        stage->output_append = append;
+                                }
+                                else
+                                {
+                                        if (stage->tee_files == NULL)
+                                        {
+                                                stage->tee_files = arenaAlloc(&lineArena, count * sizeof(struct OutputFile));
+                                        }
+                                        stage->tee_files[stage->tee_count].name = tokens[i].text;
+                                        stage->tee_files[stage->tee_count].append = append;
+                                        stage->tee_count++;
+                                }
+                        }
+                }
+                // cmd_args[0] should store the actual command while the other values should be the arguments
+                else if (type == TOKEN_WORD)
+                {
+                        // A glob pattern is replaced by the paths it matches, or kept as is if nothing matches
+                        int matched = 0;
+                        char **matches = tokens[i].pattern != NULL ? expandGlob(tokens[i].pattern, &matched) : NULL;
+                        if (matched > 0)
+                        {
+                                if (arg + matched + count - i + 1 > capacity)
+                                {
+                                        capacity = 2 * (arg + matched + count - i + 1);
+                                        char **grown = arenaAlloc(&lineArena, capacity * sizeof(char *));
+                                        memcpy(grown, args, arg * sizeof(char *));
+                                        args = grown;
+                                }
+                                memcpy(args + arg, matches, matched * sizeof(char *));
+                                arg += matched;
+                        }
+                        else
+                        {
+                                args[arg] = tokens[i].text;
+                                arg++;
+                        }
+                }
+                prev_type = tokens[i].type;
+        }
+        // Copy the arguments of the last stage, the vector ends with NULL
+        setCommandArgs(stage, args, arg);
+        // Once at the end of the user input, check Flag for Running in Background
+        // The flag belongs to the first stage and applies to the whole pipeline
+        if (count > 0 && prev_type == TOKEN_BACKGROUND && noBackgroundMode == 0)
+        {
+                new_command->background = 1;
+        }
+        else
+        {
+                new_command->background = 0;
+        }
+
+        traceEvent("parse", new_command->cmd_args[0], 0, traceTime(&lineStart));
+
+        // Return the newly created Command struct
+        return new_command;
+}
+
 /*  getCommand()
     Functionality: 
-             This function gives the shell command prompt to the user and then processes the input using the strtok 
-             function. Depending on what the input from the user, the function assigns values to the data members of the 
+             This function gives the shell command prompt to the user and then processes the input using the 
+             tokenizeLine() function. Depending on what the input from the user, the function assigns values to the data members of the 
              Command struct that is created. It also sets necessary flags for input/output and background processes.
+            Lines come from the shellInput reader and can be of any length. The prompt is only printed when the
+            shell is not running a script or a -c string. A line that uses if, for, while, functions or ; is
+            compiled with the lines that complete it, and the Command struct then only carries the program.
     Parameters:
             1.) process ID of the parent process
     Returns:
             returns the newly created Command struct that holds all the data members associated with the command, 
-            command arguments, flags, and input/output files. 
+            command arguments, flags, and input/output files. Returns NULL once all input has been read.
 */
 struct Command *getCommand(char *process_id)
 {
-        // char array to hold the user input
-        char input[2048];
-        int size = 512;
+        // Length of the user input
+        size_t length;
 
-        // Expansion variable substring
-        char *var = "$$";
+        // Tokens of the line
+        struct Token *tokens;
+        int count;
 
-        // current toke, previous token, and seperators to distinguish tokens.
-        char *cmd_token;
-        char *prev_cmd_token = "";
-        const char separator[10] = " \t\n\0";
+        // Print smallsh prompt
+        if (batchMode == 0)
+        {
+                printf(":: ");
+                fflush(stdout);
+        }
 
-        // Allocate memory for a new Command struct
-        struct Command *new_command = (struct Command *)malloc(sizeof(struct Command));
+        // Use readLine() to read the next line of input
+        uint64_t read_start = traceBegin();
+        char *line = readLine(&shellInput, &length);
+        if (line == NULL)
+        {
+                return NULL;
+        }
 
-        // Flags to determine if a token is a valid argument
-        int i = 0;
-        int arg = 0;
-        arg_flag = 0;
+        // Time spent from here until the child is started is the shell's own overhead
+        clock_gettime(CLOCK_MONOTONIC, &lineStart);
+        traceEvent("read", NULL, 0, read_start);
 
-        // Print smallsh prompt
-        printf(":: ");
-        fflush(stdout);
+        // Keep a copy of the line as typed for the job table
+        char *typed = arenaAlloc(&lineArena, length + 1);
+        memcpy(typed, line, length);
 
-        // Use fgets() to read input from stdin
-        fgets(input, size, stdin);
+        // Split the line into words and operators, expanding every $$
+        count = tokenizeLine(line, length, process_id, &tokens);
+        // Directory listings read for globs are only kept for one line
+        resetGlobCache();
+        if (count < 0)
+        {
+                printf("syntax error: %s\n", count == -1 ? "unterminated quote" : "bad file descriptor");
+                flushOutput();
+                count = 0;
+        }
 
-        // Return empty Command struct if first char is '#'
-        if (strncmp(input, "#", 1) == 0)
+        struct Command *new_command;
+        if (startsProgram(tokens, count))
         {
-                new_command->cmd_args[arg] = "#";
-                return new_command;
+                // The program is compiled from the line as typed, tokenized again with the lines read after it
+                new_command = arenaAlloc(&lineArena, sizeof(struct Command));
+                new_command->cmd_args = arenaAlloc(&lineArena, sizeof(char *));
+                new_command->program = compileProgram(typed, length, process_id);
         }
+        else
+        {
+                new_command = parseTokens(tokens, count);
+        }
+        new_command->line = typed;
+        return new_command;
+}
+
+/*  runCommand()
+    Functionality: 
+            This function runs a parsed command: a shell function, a built in, a list of assignments, a
+            pipeline or a single child process, which is waited for unless it runs in the background.
+    Parameters:
+            1.) Pointer to Command struct, cmd_args[0] is not NULL
+            2.) process ID of the parent process
+    Returns:
+            Does not return anything. The exit status is left in childExitStatus.
+*/
+void runCommand(struct Command *p, const char *process_id)
+{
+        // Child Process ID
+        pid_t spawnid;
 
-        // Call replaceString from helper_functions.h
-        // The function will search user input for the expansion variable and replace it with process ID
-        replaceString(input, 2048, var, process_id);
+        // Move pin/nice/ionice/ulimit prefixes into the placement of each stage
+        if (takePlacements(p) == -1)
+        {
+                childExitStatus = 1 << 8;
+                return;
+        }
 
-        // Use strtok to find first space-seperated token of input
-        cmd_token = strtok(input, separator);
-        while (cmd_token != NULL)
+        // Shell functions, coprocess requests and built in commands run inside the shell, pipelines, placed and fanned out commands always run as children
+        int in_shell = p->next == NULL && p->placement == NULL && p->tee_count == 0;
+        struct FunctionDefinition *function = in_shell ? findFunction(p->cmd_args[0]) : NULL;
+        struct Coproc *coproc = in_shell && function == NULL && firstCoproc != NULL ? findCoproc(p->cmd_args[0]) : NULL;
+        // A coprocess that has exited no longer shadows the command of the same name
+        coproc = coproc != NULL && coproc->job != NULL ? coproc : NULL;
+        struct Builtin *builtin = in_shell && function == NULL && coproc == NULL ? findBuiltin(p->cmd_args[0]) : NULL;
+        if (function != NULL)
+        {
+                callFunction(function, p, process_id);
+        }
+        // NAME <<< text queues a line for the coprocess NAME
+        else if (coproc != NULL)
+        {
+                childExitStatus = sendCoproc(coproc, p) << 8;
+        }
+        else if (builtin != NULL)
+        {
+                p->background = 0;
+                runBuiltin(builtin, p, &childExitStatus);
+        }
+        // A line made only of NAME=value words sets shell variables
+        else if (p->next == NULL && isAssignmentList(p->cmd_args))
         {
-                if (i == 0)
+                assignCommand(p->cmd_args);
+        }
+        // Run every stage of a pipeline as one job
+        else if (p->next != NULL)
+        {
+                runPipeline(p, &childExitStatus);
+        }
+        // Otherwise the command is not a built in 
+        else
+        {
+                // Start the child process, posix_spawn() is used unless it has to fall back to fork()
+                spawnid = startCommand(p, -1, -1, p->background != 1);
+
+                // Error on fork
+                if (spawnid == -1)
                 {
-                        // Check for Comment or NULL
-                        if (strcmp(cmd_token, "#") == 0 || cmd_token == NULL)
-                        {
-                                break;
-                        }
+                        exit(1);
+                }
+                else if (p->background == 1)
+                {
+                         // Used for when background flag is set, the job table reaps the child
+                        addJob(&spawnid, 1, p);
                 }
+                else 
+                {
+                        // Otherwise run as foreground and wait for process to complete
+                        recordSpawn();
+                        struct timespec start = lineStart;
+                        struct rusage usage;
+                        uint64_t wait_start = traceBegin();
+                        pid_t child = spawnid;
+                        spawnid = wait4(spawnid, &childExitStatus, 0, &usage);
+                        recordUsage(p->cmd_args[0], &start, &usage);
+                        traceEvent("run", p->cmd_args[0], child, wait_start);
+                        traceEvent("wait", p->cmd_args[0], 0, wait_start);
+                }
+        
+        }
+}
 
-                // Check for Input File Name by comparing previous token to "<"
-                if (strcmp(prev_cmd_token, "<") == 0)
+/*  runInput()
+    Functionality: 
+            This function runs the command lines of shellInput until all input has been read. Every line is
+            parsed into a Command struct, run, added to the history and handed back, and finished background
+            jobs are reaped after each line.
+    Parameters:
+            1.) process ID of the shell as a string
+    Returns:
+            Does not return anything.
+*/
+void runInput(char *process_id)
+{
+        while (1)
+        {
+                // Create new Command struct with getCommand function
+                struct Command *p = getCommand(process_id);
+
+                // All input has been read
+                if (p == NULL)
                 {
-                        // set Command struct input_file data member 
-                        new_command->input_file = strdup(cmd_token);
-                        arg_flag = 1;
+                        return;
                 }
 
-                // Check for Output File Name by comparing previous token to ">"
-                if (strcmp(prev_cmd_token, ">") == 0)
+                // Run a compiled program, then drop it unless it defined functions that still use it
+                if (p->program != NULL)
+                {
+                        runProgram(p->program, process_id);
+                        releaseProgram(p->program);
+                }
+                // Check for Null command
+                else if (p->cmd_args[0] == NULL)
+                {
+                        freeCommandMemory(p);
+                        continue;
+                }
+                else
                 {
-                        // set Command struct output_file data member
-                        new_command->output_file = strdup(cmd_token);
-                        arg_flag = 1;
+                        runCommand(p, process_id);
                 }
+                // Write the lines queued for coprocesses
+                flushCoprocs();
 
-                // If the current token is not an input/out file or the & flag then add it to the cmd_args array
-                if (arg_flag == 0 && strcmp(cmd_token, "<") != 0 && strcmp(cmd_token, ">") != 0 && strcmp(cmd_token, "&") != 0)
+                // Append the line to the history log with its exit status
+                if (batchMode == 0)
                 {
-                        // cmd_args[0] should store the actual command while the other values should be the arguments
-                        new_command->cmd_args[arg] = strdup(cmd_token);
-                        arg++;
+                        addHistory(p->line, childExitStatus);
                 }
 
-                // Keep track of what number token strtok is on and also the previous token
-                i++;
-                prev_cmd_token = cmd_token;
-                cmd_token = strtok(NULL, separator);
-        }
-        // Set last argument to NULL
-        new_command->cmd_args[arg] = NULL;
-        // Once at the end of the user input, check Flag for Running in Background
-        if (strcmp(prev_cmd_token, "&") == 0 && noBackgroundMode == 0)
-        {
-                new_command->background = 1;
-        }
-        else
-        {
-                new_command->background = 0;
-        }
+                // Reap every finished background job and print its notice
+                reapJobs();
 
-        // Return the newly created Command struct
-        return new_command;
+                // Hand back the memory allocated for the Command struct
+                freeCommandMemory(p);
+                    
+        }
 }
 
 /*
     Functionality: 
             Main function for program. Forks the process id of the shell, and depending on if it is a child or
             parent process, the function either calls a built in command or calls exec function.
+            "smallsh script.sh" runs the lines of a script and "smallsh -c 'command'" runs the given string. Both
+            skip the prompt and buffer status output, otherwise command lines are read from stdin.
     Parameters:
-            N/A
+            1.) number of command line arguments
+            2.) command line arguments
     Returns:
             Return exit status
     Sources Cited:
@@ -193,8 +507,51 @@ struct Command *getCommand(char *process_id)
             SIG Handling https://c-for-dummies.com/blog/?p=3457
             Background processes: https://repl.it/@cs344/42waitpidnohangc
 */
-int main()
+int main(int argc, char *argv[])
 {
+        // Socket of the server mode, see serve.h
+        char *serve_path = NULL;
+
+        // Pick where command lines are read from
+        if (argc > 3 && strcmp(argv[1], "--connect") == 0)
+        {
+                exit(connectShell(argv[2], argv[3]));
+        }
+        else if (argc > 2 && strcmp(argv[1], "--serve") == 0)
+        {
+                serve_path = argv[2];
+                batchMode = 1;
+        }
+        else if (argc > 2 && strcmp(argv[1], "-c") == 0)
+        {
+                openInputString(&shellInput, argv[2]);
+                batchMode = 1;
+        }
+        else if (argc > 1)
+        {
+                if (openInputFile(&shellInput, argv[1]) == -1)
+                {
+                        perror(argv[1]);
+                        exit(1);
+                }
+                batchMode = 1;
+        }
+        else
+        {
+                openInputFd(&shellInput, 0);
+        }
+
+        // Reap background jobs as soon as they finish, even while waiting at the prompt
+        initJobTable();
+        shellInput.wake_fd = childPipe[0];
+        shellInput.on_wake = wakeForJobs;
+
+        // Status messages are flushed together in batch mode instead of after every line
+        if (batchMode == 1)
+        {
+                setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+        }
+
         // Process ID for the command shell
         pid_t process_id;
         process_id = getpid();
@@ -202,8 +559,19 @@ int main()
         char process[32];
         sprintf(process, "%d", process_id);
 
-        // Child Process ID
-        pid_t spawnid;
+        // Load the environment into the variable table, $? reads childExitStatus
+        initVariables(&childExitStatus);
+        // Choose between the posix_spawn() fast path and fork(), the sessions of a server do not share a zygote
+        setSpawnMode(serve_path == NULL);
+        // Pick the scan routine of the lexer
+        initLexer();
+        // Fill the table of built in commands
+        initBuiltins();
+        // Map the history log, only interactive lines are recorded
+        if (batchMode == 0)
+        {
+                openHistory();
+        }
 
         // SIGINT sigaction struct with default sa_handler and no flags
         struct sigaction SIGINT_action = {{0}};
@@ -222,144 +590,12 @@ int main()
         sigaction(SIGTSTP, &SIGSTP_action, NULL);
 
 
-        int status = 1;
-        while (status)
+        // Serve clients on the socket instead of reading command lines
+        if (serve_path != NULL)
         {
-                // Create new Command struct with getCommand function
-                struct Command *p = getCommand(process);
-
-                // Check for Null command
-                if (p->cmd_args[0] == NULL || strcmp(p->cmd_args[0], "#") == 0)
-                {
-                        continue;
-                }
-                // Check for exit built in command
-                if(strcmp(p->cmd_args[0], "exit") == 0)
-                {
-                        exitShell();
-                }
-                // Check for cd built in command
-                else if(strcmp(p->cmd_args[0], "cd") == 0)
-                {
-                        changeDirectory(p->cmd_args);
-                }
-                // Check for status built in command
-                else if(strcmp(p->cmd_args[0], "status") == 0)
-                {
-                        p->background = 0;
-                        getStatus(childExitStatus);
-                }
-                // Otherwise the command is not a built in 
-                else
-                {
-                        // use fork() to create the child process
-                        spawnid = fork();
-
-                        // Switch statement to determine what to do with child
-                        switch (spawnid)
-                        {
-                        // Error on fork
-                        case -1:
-                                perror("fork() failed!");
-                                exit(1);
-                                break;
-                        // current process is child
-                        case 0:
-                                // Handle SIGINT for background process
-                                if (p->background != 1)
-                                {
-                                        SIGINT_action.sa_handler = handleSigINT;
-                                }
-                                // Open input file if one was specified
-                                if (p->input_file != NULL)
-                                {
-                                        int inputFile = open(p->input_file, O_RDONLY);
-                                        if (inputFile == -1)
-                                        {
-                                                perror("input open()");
-                                                fflush(stdout);
-                                                break;
-                                        }
-
-                                        // Create copy of file descriptor using dup2()
-                                        int result = dup2(inputFile, 0);
-                                        if (result == -1)
-                                        {
-                                                perror("input dup2()");
-                                                fflush(stdout);
-                                                exit(2);
-                                        }
-                                        close(inputFile);
-                                }
-
-                                // Handle output file if one was specified
-                                if (p->output_file != NULL)
-                                {
-                                        int outputFile = open(p->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                                        if (outputFile == -1)
-                                        {
-                                                perror("output open()");
-                                                fflush(stdout);
-                                                exit(1);
-                                        }
-
-                                         // Create copy of file descriptor using dup2()
-                                        int result = dup2(outputFile, 1);
-                                        if (result == -1)
-                                        {
-                                                perror("output dup2()");
-                                                fflush(stdout);
-                                                exit(2);
-                                        }
-                                        close(outputFile);
-                                }
-
-                                // set SIGINT sa_handler to handleSigINT function
-                                SIGINT_action.sa_handler = handleSigINT;
-
-                                // Run command using the execvp function. Passing p->cmd_args as parameters.
-                                // p._cmd_args[0] stores command name and other indices store arguments
-                                if(execvp(p->cmd_args[0], p->cmd_args) < 0)
-                                {
-                                        // Print error if execvp returns -1
-                                        perror("execve");
-                                        exit(2);
-                                }
-                                
-                                break;
-                        // Default action for if process is a parent process
-                        default:
-                                if (p->background == 1)
-                                {
-                                         // Used for when background flag is set
-                                        printf("background pid is %d\n", spawnid);
-                                        fflush(stdout);
-                                }
-                                else 
-                                {
-                                        // Otherwise run as foreground and wait for process to complete
-                                        spawnid = waitpid(spawnid, &childExitStatus, 0);
-                                }
-                              
-                                break;
-                        }
-                
-                }
-                // Run process in background by calling waitpid with WNOWANG flag
-                spawnid = waitpid(-1, &childExitStatus, WNOHANG);
-
-                // If there is another background process then display message and end it.
-                if (spawnid > 0)
-                {
-                        printf("background process %d is done: ", spawnid);
-                        fflush(stdout);
-                        getStatus(childExitStatus);
-                        spawnid = waitpid(-1, &childExitStatus, WNOHANG);
-                }
-
-                // Free memory allocated for Command struct
-                freeCommandMemory(p);
-                    
+                exit(serveShell(serve_path, process));
         }
-        exit(0);
+
+        runInput(process);
+        exitShell();
 }
\ No newline at end of file
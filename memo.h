@@ -0,0 +1,622 @@
+/*
+    This file contains the memo built in, a cache of the output of deterministic commands. "memo cmd args"
+    builds a key from the arguments, the cwd, the variables named in SMALLSH_MEMO_ENV (default PATH) and the
+    identity (device, inode, size, mtime) of the command's executable, its < file and every argument that names
+    an existing file. The key is hashed to the name of an entry in the cache directory (SMALLSH_MEMO_DIR,
+    default ~/.smallsh_memo). On a hit the stored stdout is copied to the output with sendfile() and the stored
+    exit status is set, without starting a process. On a miss the command runs with its stdout going to a new
+    entry, which is then copied to the output the same way, so the output of a missed command appears once the
+    command is done. stderr is never cached.
+
+    Every entry holds the whole key and is only used if the key matches, so a hash collision is a miss. A hit
+    updates the mtime of the entry, and once the cache grows past SMALLSH_MEMO_SIZE (default 256M, K/M/G
+    suffixes allowed) the entries with the oldest mtime are removed first. Commands killed by a signal and
+    commands that are not found are run without being cached.
+
+    Usage:
+        memo command [args...]      run the command through the cache
+        memo                        print the hit/miss counts and the size of the cache
+        memo -c                     remove every entry
+
+    There are twelve functions in this file:
+        1.) appendKey()
+        2.) appendIdentity()
+        3.) buildMemoKey()
+        4.) memoEntryName()
+        5.) memoDirectory()
+        6.) memoLimit()
+        7.) compareMemoEntries()
+        8.) evictMemo()
+        9.) replayMemo()
+        10.) storeMemo()
+        11.) printMemoStats()
+        12.) memoCommand()
+*/
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "Command.h"
+#include "helper_functions.h"
+#include "path_cache.h"
+#include "variables.h"
+#include "spawn.h"
+#include "stats.h"
+#include "trace.h"
+#include "parallel.h"
+
+#define MEMO_MAGIC 0x6f6d656d
+#define MEMO_DEFAULT_SIZE (256L << 20)
+
+/*
+    Data Members:
+        magic: (uint32_t) ->        MEMO_MAGIC
+        status: (int32_t) ->        wait status of the command
+        key_length: (uint64_t) ->   length of the key that follows the header, the output follows the key
+*/
+struct MemoHeader
+{
+    uint32_t magic;
+    int32_t status;
+    uint64_t key_length;
+};
+
+/*
+    Data Members:
+        data: (char array) ->   bytes of the key
+        length: (size_t) ->     number of bytes used
+        capacity: (size_t) ->   room in data
+*/
+struct MemoKey
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+/*
+    Data Members:
+        name: (string) ->       file name of the entry
+        used: (timespec) ->     mtime, the last time the entry was stored or replayed
+        size: (off_t) ->        size of the entry in bytes
+*/
+struct MemoEntry
+{
+    char *name;
+    struct timespec used;
+    off_t size;
+};
+
+// Counts reported by "memo", and the size of the cache once it has been scanned (-1 before)
+long memoHits = 0;
+long memoMisses = 0;
+long memoBypassed = 0;
+long long memoBytes = -1;
+
+/*  appendKey()
+    Functionality:
+            This function appends bytes and a NUL separator to a key.
+    Parameters:
+            1.) Pointer to MemoKey struct
+            2.) bytes to append
+            3.) number of bytes
+    Returns:
+            Does not return anything.
+*/
+void appendKey(struct MemoKey *key, const void *data, size_t length)
+{
+    if (key->length + length + 1 > key->capacity)
+    {
+        key->capacity = 2 * (key->length + length + 1);
+        key->data = realloc(key->data, key->capacity);
+    }
+    memcpy(key->data + key->length, data, length);
+    key->length += length;
+    key->data[key->length++] = '\0';
+}
+
+/*  appendIdentity()
+    Functionality:
+            This function appends the device, inode, size and mtime of a file to a key, so a key changes as
+            soon as the file is modified or replaced.
+    Parameters:
+            1.) Pointer to MemoKey struct
+            2.) tag that says what the file is used as
+            3.) Pointer to stat struct of the file
+    Returns:
+            Does not return anything.
+*/
+void appendIdentity(struct MemoKey *key, const char *tag, struct stat *info)
+{
+    int64_t identity[5] = {info->st_dev, info->st_ino, info->st_size, info->st_mtim.tv_sec, info->st_mtim.tv_nsec};
+    appendKey(key, tag, strlen(tag));
+    appendKey(key, identity, sizeof(identity));
+}
+
+/*  buildMemoKey()
+    Functionality:
+            This function builds the key of a command: its arguments, the cwd, the selected variables and the
+            identity of the executable, the < file and the arguments that name existing files.
+    Parameters:
+            1.) Pointer to Command struct of the memo command
+            2.) Pointer to MemoKey struct to fill in
+    Returns:
+            Returns 0, or -1 if the command can not be cached (it is not found, or its input can not be read).
+*/
+int buildMemoKey(struct Command *p, struct MemoKey *key)
+{
+    struct stat info;
+    char **args = p->cmd_args + 1;
+    char *path = strchr(args[0], '/') != NULL ? args[0] : lookupCommand(args[0]);
+    if (path == NULL || stat(path, &info) == -1)
+    {
+        return -1;
+    }
+    appendIdentity(key, "exe", &info);
+
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        appendKey(key, args[i], strlen(args[i]));
+        if (i > 0 && stat(args[i], &info) == 0 && S_ISREG(info.st_mode))
+        {
+            appendIdentity(key, "arg", &info);
+        }
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        return -1;
+    }
+    appendKey(key, cwd, strlen(cwd));
+
+    // Variables named in SMALLSH_MEMO_ENV, separated by spaces, colons or commas
+    char *names = getenv("SMALLSH_MEMO_ENV");
+    names = names != NULL ? names : "PATH";
+    while (*names != '\0')
+    {
+        size_t length = strcspn(names, " :,");
+        if (length > 0)
+        {
+            struct Variable *variable = getVariable(names, length);
+            appendKey(key, names, length);
+            appendKey(key, variable != NULL ? variable->value : "", variable != NULL ? strlen(variable->value) : 0);
+        }
+        names += length + (names[length] != '\0');
+    }
+
+    if (p->input_file != NULL)
+    {
+        if (stat(p->input_file, &info) == -1)
+        {
+            return -1;
+        }
+        appendIdentity(key, "input", &info);
+    }
+    else if (p->here_string != NULL)
+    {
+        appendKey(key, "here", 4);
+        appendKey(key, p->here_string, strlen(p->here_string));
+    }
+    return 0;
+}
+
+/*  memoEntryName()
+    Functionality:
+            This function hashes a key to the file name of its entry, 32 hex digits from two 64-bit FNV-1a hashes
+            with different offset bases.
+    Parameters:
+            1.) Pointer to MemoKey struct
+            2.) buffer of at least 33 bytes
+    Returns:
+            Does not return anything.
+*/
+void memoEntryName(struct MemoKey *key, char *name)
+{
+    uint64_t first = 0xcbf29ce484222325ULL;
+    uint64_t second = 0x84222325cbf29ce4ULL;
+    for (size_t i = 0; i < key->length; i++)
+    {
+        first = (first ^ (unsigned char)key->data[i]) * 0x100000001b3ULL;
+        second = (second ^ (unsigned char)key->data[key->length - 1 - i]) * 0x100000001b3ULL;
+    }
+    sprintf(name, "%016llx%016llx", (unsigned long long)first, (unsigned long long)second);
+}
+
+/*  memoDirectory()
+    Functionality:
+            This function returns the cache directory and creates it the first time.
+    Parameters:
+            N/A
+    Returns:
+            Returns the path, or NULL if the directory can not be created.
+*/
+char *memoDirectory()
+{
+    static char *directory = NULL;
+    if (directory == NULL)
+    {
+        char *path = getenv("SMALLSH_MEMO_DIR");
+        char *home = getenv("HOME");
+        if (path != NULL)
+        {
+            directory = strdup(path);
+        }
+        else
+        {
+            directory = malloc(strlen(home != NULL ? home : ".") + 32);
+            sprintf(directory, "%s/.smallsh_memo", home != NULL ? home : ".");
+        }
+    }
+    if (mkdir(directory, 0700) == -1 && errno != EEXIST)
+    {
+        perror(directory);
+        return NULL;
+    }
+    return directory;
+}
+
+/*  memoLimit()
+    Functionality:
+            This function returns the size limit of the cache from SMALLSH_MEMO_SIZE.
+    Parameters:
+            N/A
+    Returns:
+            Returns the limit in bytes.
+*/
+long long memoLimit()
+{
+    char *text = getenv("SMALLSH_MEMO_SIZE");
+    if (text == NULL)
+    {
+        return MEMO_DEFAULT_SIZE;
+    }
+    char *end;
+    long long limit = strtoll(text, &end, 10);
+    switch (*end)
+    {
+    case 'G':
+    case 'g':
+        limit <<= 10;
+        // fall through
+    case 'M':
+    case 'm':
+        limit <<= 10;
+        // fall through
+    case 'K':
+    case 'k':
+        limit <<= 10;
+    }
+    return limit;
+}
+
+/*  compareMemoEntries()
+    Functionality:
+            This function orders entries from the least to the most recently used, for qsort().
+    Parameters:
+            1.) Pointer to the first MemoEntry struct
+            2.) Pointer to the second MemoEntry struct
+    Returns:
+            Returns a negative number, zero or a positive number.
+*/
+int compareMemoEntries(const void *a, const void *b)
+{
+    const struct MemoEntry *first = a;
+    const struct MemoEntry *second = b;
+    if (first->used.tv_sec != second->used.tv_sec)
+    {
+        return first->used.tv_sec < second->used.tv_sec ? -1 : 1;
+    }
+    return (first->used.tv_nsec > second->used.tv_nsec) - (first->used.tv_nsec < second->used.tv_nsec);
+}
+
+/*  evictMemo()
+    Functionality:
+            This function scans the cache directory, adds up the size of the entries and removes the least
+            recently used ones until the cache fits the limit. Temporary files of entries still being written
+            are left alone.
+    Parameters:
+            1.) cache directory
+            2.) size limit in bytes, or -1 to only count
+    Returns:
+            Returns the number of entries left.
+*/
+long evictMemo(const char *directory, long long limit)
+{
+    int dir_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = dir_fd != -1 ? fdopendir(dir_fd) : NULL;
+    if (dir == NULL)
+    {
+        if (dir_fd != -1)
+        {
+            close(dir_fd);
+        }
+        return 0;
+    }
+
+    struct MemoEntry *entries = NULL;
+    long count = 0;
+    long capacity = 0;
+    memoBytes = 0;
+    struct dirent *found;
+    while ((found = readdir(dir)) != NULL)
+    {
+        struct stat info;
+        if (strlen(found->d_name) != 32 || fstatat(dir_fd, found->d_name, &info, AT_SYMLINK_NOFOLLOW) == -1 ||
+            !S_ISREG(info.st_mode))
+        {
+            continue;
+        }
+        if (count == capacity)
+        {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            entries = realloc(entries, capacity * sizeof(struct MemoEntry));
+        }
+        entries[count].name = strdup(found->d_name);
+        entries[count].used = info.st_mtim;
+        entries[count].size = info.st_size;
+        memoBytes += info.st_size;
+        count++;
+    }
+
+    qsort(entries, count, sizeof(struct MemoEntry), compareMemoEntries);
+    long removed = 0;
+    for (long i = 0; i < count; i++)
+    {
+        if (limit >= 0 && memoBytes > limit && unlinkat(dir_fd, entries[i].name, 0) == 0)
+        {
+            memoBytes -= entries[i].size;
+            removed++;
+        }
+        free(entries[i].name);
+    }
+    free(entries);
+    closedir(dir);
+    return count - removed;
+}
+
+/*  replayMemo()
+    Functionality:
+            This function looks up the entry of a key. If it holds the same key, its output is copied to the
+            output file descriptor and its mtime is updated for the LRU order.
+    Parameters:
+            1.) path of the entry
+            2.) Pointer to MemoKey struct
+            3.) output file descriptor
+            4.) Pointer to the int that receives the stored wait status
+    Returns:
+            Returns 1 on a hit, otherwise 0.
+*/
+int replayMemo(const char *path, struct MemoKey *key, int out_fd, int *status)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return 0;
+    }
+
+    struct MemoHeader header;
+    int hit = read(fd, &header, sizeof(header)) == sizeof(header) && header.magic == MEMO_MAGIC &&
+              header.key_length == key->length;
+    if (hit)
+    {
+        char *stored = malloc(key->length);
+        hit = read(fd, stored, key->length) == (ssize_t)key->length && memcmp(stored, key->data, key->length) == 0;
+        free(stored);
+    }
+    if (hit)
+    {
+        futimens(fd, NULL);
+        copyOutput(fd, out_fd, sizeof(header) + key->length);
+        *status = header.status;
+    }
+    close(fd);
+    return hit;
+}
+
+/*  storeMemo()
+    Functionality:
+            This function runs the command of a miss with its stdout going to a new entry. When the command
+            exits normally the entry is renamed into place, then its output is copied to the output file
+            descriptor and the cache is trimmed to its limit.
+    Parameters:
+            1.) Pointer to Command struct of the memo command
+            2.) cache directory
+            3.) path of the entry
+            4.) Pointer to MemoKey struct
+            5.) output file descriptor
+            6.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything.
+*/
+void storeMemo(struct Command *p, const char *directory, const char *path, struct MemoKey *key, int out_fd,
+               int *exitStatus)
+{
+    char *temp = malloc(strlen(directory) + 16);
+    sprintf(temp, "%s/tmp.XXXXXX", directory);
+    int fd = mkostemp(temp, O_CLOEXEC);
+    struct MemoHeader header = {MEMO_MAGIC, 0, key->length};
+    if (fd == -1 || write(fd, &header, sizeof(header)) != sizeof(header) ||
+        write(fd, key->data, key->length) != (ssize_t)key->length)
+    {
+        perror("memo");
+        if (fd != -1)
+        {
+            close(fd);
+            unlink(temp);
+        }
+        free(temp);
+        *exitStatus = 1 << 8;
+        return;
+    }
+
+    // The child writes behind the key, it shares the offset of the file
+    struct Command command = *p;
+    command.cmd_args = p->cmd_args + 1;
+    command.output_file = NULL;
+    command.output_append = 0;
+    command.output_to_error = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = startCommand(&command, -1, fd, 1);
+    if (pid == -1)
+    {
+        close(fd);
+        unlink(temp);
+        free(temp);
+        *exitStatus = 1 << 8;
+        return;
+    }
+    recordSpawn();
+    struct rusage usage;
+    uint64_t wait_start = traceBegin();
+    while (wait4(pid, exitStatus, 0, &usage) == -1 && errno == EINTR)
+        ;
+    recordUsage(command.cmd_args[0], &start, &usage);
+    traceEvent("run", command.cmd_args[0], pid, wait_start);
+
+    header.status = *exitStatus;
+    if (WIFEXITED(*exitStatus) && pwrite(fd, &header, sizeof(header), 0) == sizeof(header) && rename(temp, path) == 0)
+    {
+        struct stat info;
+        if (memoBytes >= 0 && fstat(fd, &info) == 0)
+        {
+            memoBytes += info.st_size;
+        }
+        copyOutput(fd, out_fd, sizeof(header) + key->length);
+        if (memoBytes < 0 || memoBytes > memoLimit())
+        {
+            evictMemo(directory, memoLimit());
+        }
+    }
+    else
+    {
+        copyOutput(fd, out_fd, sizeof(header) + key->length);
+        unlink(temp);
+    }
+    close(fd);
+    free(temp);
+}
+
+/*  printMemoStats()
+    Functionality:
+            This function prints the hit and miss counts and the size of the cache.
+    Parameters:
+            1.) cache directory
+    Returns:
+            Does not return anything.
+*/
+void printMemoStats(const char *directory)
+{
+    long entries = evictMemo(directory, -1);
+    long lookups = memoHits + memoMisses;
+    printf("memo: %ld hits, %ld misses (%.1f%% hit rate), %ld not cached\n", memoHits, memoMisses,
+           lookups > 0 ? 100.0 * memoHits / lookups : 0.0, memoBypassed);
+    printf("memo: %ld entries, %lld of %lld bytes in %s\n", entries, memoBytes, memoLimit(), directory);
+    flushOutput();
+}
+
+/*  memoCommand()
+    Functionality:
+            This function is the memo built in. It replays the output and exit status of the command from the
+            cache, or runs the command and stores them.
+    Parameters:
+            1.) Pointer to Command struct of the memo command, its > file receives the output
+            2.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything.
+*/
+void memoCommand(struct Command *p, int *exitStatus)
+{
+    char *directory = memoDirectory();
+    if (directory == NULL)
+    {
+        *exitStatus = 1 << 8;
+        return;
+    }
+    if (p->cmd_args[1] == NULL)
+    {
+        printMemoStats(directory);
+        *exitStatus = 0;
+        return;
+    }
+    if (strcmp(p->cmd_args[1], "-c") == 0 && p->cmd_args[2] == NULL)
+    {
+        evictMemo(directory, 0);
+        *exitStatus = 0;
+        return;
+    }
+
+    int out_fd = 1;
+    fflush(stdout);
+    if (p->output_file != NULL)
+    {
+        out_fd = open(p->output_file, O_WRONLY | O_CREAT | (p->output_append ? O_APPEND : O_TRUNC) | O_CLOEXEC, 0644);
+        if (out_fd == -1)
+        {
+            perror("output open()");
+            *exitStatus = 1 << 8;
+            return;
+        }
+    }
+    // With >&2 the output goes to stderr
+    else if (p->output_to_error)
+    {
+        out_fd = 2;
+    }
+
+    uint64_t trace_start = traceBegin();
+    struct MemoKey key = {0};
+    if (buildMemoKey(p, &key) == -1)
+    {
+        // Not cacheable, the command still runs and reports its own errors
+        memoBypassed++;
+        struct Command command = *p;
+        command.cmd_args = p->cmd_args + 1;
+        command.output_file = NULL;
+        command.output_to_error = 0;
+        pid_t pid = startCommand(&command, -1, out_fd == 1 ? -1 : out_fd, 1);
+        if (pid != -1)
+        {
+            while (waitpid(pid, exitStatus, 0) == -1 && errno == EINTR)
+                ;
+        }
+    }
+    else
+    {
+        char name[33];
+        memoEntryName(&key, name);
+        char *path = malloc(strlen(directory) + 40);
+        sprintf(path, "%s/%s", directory, name);
+        if (replayMemo(path, &key, out_fd, exitStatus))
+        {
+            memoHits++;
+            traceEvent("memo", p->cmd_args[1], 0, trace_start);
+        }
+        else
+        {
+            memoMisses++;
+            storeMemo(p, directory, path, &key, out_fd, exitStatus);
+        }
+        free(path);
+    }
+    free(key.data);
+    if (out_fd > 2)
+    {
+        close(out_fd);
+    }
+}
+
+#endif
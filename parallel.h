@@ -0,0 +1,443 @@
+/*
+    This file contains the parallel built in, which fans a list of commands out over the CPU cores.
+    At most N commands run at once, a new one is started as soon as a slot frees up, and the output of
+    every command is collected in its own temporary file so that it is printed in one piece.
+
+    Usage:
+        parallel [-j N] command {} ::: arg1 arg2 ...     run the command once per argument, {} is replaced by the
+                                                         argument (or the argument is appended if there is no {})
+        parallel [-j N] < file                           run every line of the file as a command
+        cmd | parallel [-j N]                            run every line of stdin as a command
+
+    There are six functions in this file:
+        1.) expandTemplate()
+        2.) splitCommandLine()
+        3.) copyOutput()
+        4.) startParallelJob()
+        5.) finishParallelJob()
+        6.) parallelCommand()
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <sys/sendfile.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "Command.h"
+#include "arena.h"
+#include "input_reader.h"
+#include "helper_functions.h"
+#include "built_in_commands.h"
+#include "spawn.h"
+#include "job_table.h"
+#include "stats.h"
+#include "trace.h"
+#include "placement.h"
+
+/*
+    Data Members:
+        pid: (pid_t) ->         process ID of the running command, 0 for a free slot
+        output: (int) ->        file descriptor of the temporary file holding the command's stdout
+        name: (string) ->       command name, used for the stats built in
+        start: (timespec) ->    time the command was started
+*/
+struct ParallelSlot
+{
+    pid_t pid;
+    int output;
+    char *name;
+    struct timespec start;
+};
+
+/*  expandTemplate()
+    Functionality:
+            This function builds the argument vector for one argument of "parallel cmd ::: args". Every {} in the
+            template is replaced by the argument, and if no {} was found the argument is appended at the end.
+    Parameters:
+            1.) template tokens, ending with NULL
+            2.) number of template tokens
+            3.) argument to substitute
+    Returns:
+            Returns the argument vector allocated from the per-line arena, ending with NULL.
+*/
+char **expandTemplate(char **tokens, int count, char *argument)
+{
+    char **argv = arenaAlloc(&lineArena, (count + 2) * sizeof(char *));
+    size_t arg_len = strlen(argument);
+    int substituted = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        // Count the {} in the token to size the expanded string
+        int matches = 0;
+        for (char *found = strstr(tokens[i], "{}"); found != NULL; found = strstr(found + 2, "{}"))
+        {
+            matches++;
+        }
+        if (matches == 0)
+        {
+            argv[i] = tokens[i];
+            continue;
+        }
+
+        char *expanded = arenaAlloc(&lineArena, strlen(tokens[i]) + matches * arg_len + 1);
+        char *out = expanded;
+        char *in = tokens[i];
+        char *found;
+        while ((found = strstr(in, "{}")) != NULL)
+        {
+            memcpy(out, in, found - in);
+            out += found - in;
+            memcpy(out, argument, arg_len);
+            out += arg_len;
+            in = found + 2;
+        }
+        strcpy(out, in);
+        argv[i] = expanded;
+        substituted = 1;
+    }
+
+    if (!substituted)
+    {
+        argv[count++] = argument;
+    }
+    argv[count] = NULL;
+    return argv;
+}
+
+/*  splitCommandLine()
+    Functionality:
+            This function splits one line of a command list into space separated tokens.
+    Parameters:
+            1.) line (not NUL terminated)
+            2.) length of the line
+    Returns:
+            Returns the argument vector allocated from the per-line arena, ending with NULL.
+*/
+char **splitCommandLine(char *line, size_t length)
+{
+    char *copy = arenaAlloc(&lineArena, length + 1);
+    memcpy(copy, line, length);
+    copy[length] = '\0';
+
+    char **argv = arenaAlloc(&lineArena, (length / 2 + 2) * sizeof(char *));
+    int count = 0;
+    for (char *token = strtok(copy, " \t"); token != NULL; token = strtok(NULL, " \t"))
+    {
+        argv[count++] = token;
+    }
+    argv[count] = NULL;
+    return argv;
+}
+
+/*  copyOutput()
+    Functionality:
+            This function copies the collected output of a finished command to the output file descriptor with
+            sendfile(), falling back to read()/write() where sendfile() is not supported.
+    Parameters:
+            1.) file descriptor of the temporary file
+            2.) file descriptor to copy to
+            3.) offset in the temporary file the output starts at
+    Returns:
+            Does not return anything.
+*/
+void copyOutput(int from, int to, off_t offset)
+{
+    ssize_t copied;
+    while ((copied = sendfile(to, from, &offset, 1 << 20)) > 0)
+        ;
+    if (copied == 0)
+    {
+        return;
+    }
+
+    char buffer[65536];
+    lseek(from, offset, SEEK_SET);
+    while ((copied = read(from, buffer, sizeof(buffer))) > 0)
+    {
+        if (write(to, buffer, copied) == -1)
+        {
+            return;
+        }
+    }
+}
+
+/*  startParallelJob()
+    Functionality:
+            This function starts one command of the list in a free slot, with its stdout sent to a new
+            temporary file.
+    Parameters:
+            1.) Pointer to the free ParallelSlot struct
+            2.) argument vector of the command
+    Returns:
+            Returns 0 if the command was started, otherwise -1.
+*/
+int startParallelJob(struct ParallelSlot *slot, char **argv)
+{
+    if (argv[0] == NULL)
+    {
+        return -1;
+    }
+
+    FILE *temp = tmpfile();
+    if (temp == NULL)
+    {
+        perror("parallel tmpfile()");
+        return -1;
+    }
+    slot->output = dup(fileno(temp));
+    fclose(temp);
+    fcntl(slot->output, F_SETFD, FD_CLOEXEC);
+
+    struct Command command = {0};
+    command.cmd_args = argv;
+    assignAutoPlacement(&command);
+    slot->name = argv[0];
+    clock_gettime(CLOCK_MONOTONIC, &slot->start);
+    slot->pid = startCommand(&command, -1, slot->output, 1);
+    if (slot->pid == -1)
+    {
+        close(slot->output);
+        slot->pid = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/*  finishParallelJob()
+    Functionality:
+            This function prints the collected output of a finished command, records its resource usage
+            and frees its slot.
+    Parameters:
+            1.) Pointer to the ParallelSlot struct of the command
+            2.) file descriptor the output is copied to
+            3.) Pointer to rusage struct filled in by wait4()
+    Returns:
+            Does not return anything.
+*/
+void finishParallelJob(struct ParallelSlot *slot, int out_fd, struct rusage *usage)
+{
+    recordUsage(slot->name, &slot->start, usage);
+    traceEvent("run", slot->name, slot->pid, traceTime(&slot->start));
+    copyOutput(slot->output, out_fd, 0);
+    close(slot->output);
+    slot->pid = 0;
+}
+
+/*  parallelCommand()
+    Functionality:
+            This function is the parallel built in. It starts the commands of the list while keeping at most
+            N of them running (default: number of online CPUs), prints the output of each command once it is
+            done, and ends with a summary of the exit statuses in the format of the status built in.
+    Parameters:
+            1.) Pointer to Command struct of the parallel command (its < file holds the command list, otherwise
+                stdin does)
+            2.) Pointer to the int that holds the exit status shown by the status built in
+    Returns:
+            Does not return anything. The exit status is set to the last failed command, or success.
+*/
+void parallelCommand(struct Command *p, int *exitStatus)
+{
+    char **cmd_args = p->cmd_args;
+    long slots = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+
+    if (cmd_args[1] != NULL && strcmp(cmd_args[1], "-j") == 0 && cmd_args[2] != NULL)
+    {
+        slots = atol(cmd_args[2]);
+        first = 3;
+    }
+    else if (cmd_args[1] != NULL && strncmp(cmd_args[1], "-j", 2) == 0 && cmd_args[1][2] != '\0')
+    {
+        slots = atol(cmd_args[1] + 2);
+        first = 2;
+    }
+    if (slots < 1)
+    {
+        slots = 1;
+    }
+
+    // Split "cmd {} ::: args" into the template and the argument list
+    int separator = -1;
+    for (int i = first; cmd_args[i] != NULL; i++)
+    {
+        if (strcmp(cmd_args[i], ":::") == 0)
+        {
+            separator = i;
+            break;
+        }
+    }
+
+    // The command list comes from the < file or <<< text, else from stdin, which may be the shell's own input
+    struct InputReader list;
+    struct InputReader *source = &list;
+    if (separator == -1)
+    {
+        if (cmd_args[first] != NULL)
+        {
+            printf("parallel: usage: parallel [-j N] command {} ::: args... | parallel [-j N] [< file]\n");
+            flushOutput();
+            return;
+        }
+        if (p->input_file != NULL)
+        {
+            if (openInputFile(&list, p->input_file) == -1)
+            {
+                perror(p->input_file);
+                return;
+            }
+        }
+        else if (p->here_string != NULL)
+        {
+            openInputString(&list, p->here_string);
+        }
+        else if (shellInput.fd == 0)
+        {
+            source = &shellInput;
+        }
+        else
+        {
+            openInputFd(&list, fcntl(0, F_DUPFD_CLOEXEC, 10));
+        }
+    }
+
+    int out_fd = 1;
+    if (p->output_file != NULL)
+    {
+        out_fd = open(p->output_file, O_WRONLY | O_CREAT | (p->output_append ? O_APPEND : O_TRUNC) | O_CLOEXEC, 0644);
+        if (out_fd == -1)
+        {
+            perror("output open()");
+            if (separator == -1 && source == &list)
+            {
+                closeInput(&list);
+            }
+            return;
+        }
+    }
+    // With >&2 the output goes to stderr
+    else if (p->output_to_error)
+    {
+        out_fd = 2;
+    }
+    fflush(stdout);
+
+    // The shell's reader reaps finished children with wait4(-1) while it waits for input, which would take the
+    // running commands away from the loop below, so it does not watch for them while parallel reads from it
+    int wake_fd = shellInput.wake_fd;
+    if (source == &shellInput)
+    {
+        shellInput.wake_fd = -1;
+    }
+
+    struct ParallelSlot *table = calloc(slots, sizeof(struct ParallelSlot));
+    int next_arg = separator + 1;
+    int running = 0;
+    int total = 0;
+    int failed = 0;
+    int last_failure = 0;
+
+    while (1)
+    {
+        // Fill every free slot with the next command of the list
+        for (int i = 0; i < slots; i++)
+        {
+            while (table[i].pid == 0)
+            {
+                char **argv;
+                if (separator != -1)
+                {
+                    if (cmd_args[next_arg] == NULL)
+                    {
+                        break;
+                    }
+                    argv = expandTemplate(cmd_args + first, separator - first, cmd_args[next_arg++]);
+                }
+                else
+                {
+                    size_t length;
+                    char *line = readLine(source, &length);
+                    if (line == NULL)
+                    {
+                        break;
+                    }
+                    argv = splitCommandLine(line, length);
+                }
+
+                if (startParallelJob(&table[i], argv) == 0)
+                {
+                    running++;
+                }
+            }
+        }
+
+        if (running == 0)
+        {
+            break;
+        }
+
+        // Wait for any child, background jobs that finish meanwhile go to the job table
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        int found = 0;
+        for (int i = 0; i < slots; i++)
+        {
+            if (table[i].pid == pid)
+            {
+                finishParallelJob(&table[i], out_fd, &usage);
+                running--;
+                total++;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                {
+                    failed++;
+                    last_failure = status;
+                }
+                found = 1;
+                break;
+            }
+        }
+        if (!found)
+        {
+            recordExit(pid, status, &usage);
+        }
+    }
+
+    free(table);
+    shellInput.wake_fd = wake_fd;
+    if (separator == -1 && source == &list)
+    {
+        closeInput(&list);
+    }
+    if (out_fd > 2)
+    {
+        close(out_fd);
+    }
+
+    // Summarise the exit statuses
+    printf("parallel: %d of %d jobs succeeded\n", total - failed, total);
+    if (failed > 0)
+    {
+        printf("parallel: last failure: ");
+        getStatus(last_failure);
+    }
+    flushOutput();
+    *exitStatus = last_failure;
+}
+
+#endif
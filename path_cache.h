@@ -0,0 +1,296 @@
+/*
+    This file contains the PATH lookup cache. The first time a command name is run, every directory in PATH
+    is searched for it and the absolute path is stored in a hash table. Later runs go straight to the stored
+    path instead of letting execvp() try every PATH directory again. The table is cleared when PATH changes,
+    and an entry is dropped when its file no longer exists.
+
+    There are eight functions in this file:
+        1.) hashName()
+        2.) hashBytes()
+        3.) clearPathCache()
+        4.) checkPathChanged()
+        5.) searchPath()
+        6.) lookupCommand()
+        7.) forgetCommand()
+        8.) printPathCache()
+*/
+
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "helper_functions.h"
+
+#define PATH_CACHE_BUCKETS 256
+
+/*
+    Data Members:
+        name: (string) ->           command name as typed by the user
+        path: (string) ->           absolute path the name resolved to
+        hits: (int) ->              number of times the entry was used
+        next: (PathEntry pointer) -> next entry in the same bucket
+*/
+struct PathEntry
+{
+    char *name;
+    char *path;
+    int hits;
+    struct PathEntry *next;
+};
+
+struct PathEntry *pathCache[PATH_CACHE_BUCKETS];
+
+// Copy of the PATH value the table was filled with
+char *cachedPath = NULL;
+
+// Lookup counters reported by the hash builtin
+long pathCacheHits = 0;
+long pathCacheMisses = 0;
+
+/*  hashName()
+    Functionality:
+            This function hashes a command name with FNV-1a.
+    Parameters:
+            1.) command name
+    Returns:
+            Returns the 32 bit hash of the name, callers reduce it to a bucket index.
+*/
+unsigned int hashName(const char *name)
+{
+    unsigned int hash = 2166136261u;
+    for (; *name != '\0'; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*  hashBytes()
+    Functionality:
+            This function hashes a name that is not NUL terminated with FNV-1a, giving the same value as
+            hashName() for the same characters.
+    Parameters:
+            1.) name
+            2.) length of the name
+    Returns:
+            Returns the 32 bit hash of the name, callers reduce it to a bucket index.
+*/
+unsigned int hashBytes(const char *name, size_t length)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*  clearPathCache()
+    Functionality:
+            This function frees every entry of the table and resets the hit/miss counters.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void clearPathCache()
+{
+    for (int i = 0; i < PATH_CACHE_BUCKETS; i++)
+    {
+        struct PathEntry *entry = pathCache[i];
+        while (entry != NULL)
+        {
+            struct PathEntry *next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        pathCache[i] = NULL;
+    }
+    pathCacheHits = 0;
+    pathCacheMisses = 0;
+}
+
+/*  checkPathChanged()
+    Functionality:
+            This function compares the current PATH with the PATH the table was filled with, and clears the
+            table if it changed.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void checkPathChanged()
+{
+    char *path = getenv("PATH");
+    if (path == NULL)
+    {
+        path = "";
+    }
+
+    if (cachedPath == NULL || strcmp(cachedPath, path) != 0)
+    {
+        clearPathCache();
+        free(cachedPath);
+        cachedPath = strdup(path);
+    }
+}
+
+/*  searchPath()
+    Functionality:
+            This function searches every directory in PATH for an executable regular file with the given name,
+            in the same order execvp() would.
+    Parameters:
+            1.) command name
+    Returns:
+            Returns a newly allocated absolute path, or NULL if the command was not found.
+*/
+char *searchPath(const char *name)
+{
+    const char *dir = cachedPath;
+    size_t name_len = strlen(name);
+
+    while (dir != NULL)
+    {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end != NULL ? (size_t)(end - dir) : strlen(dir);
+
+        // An empty PATH entry means the current directory
+        char *candidate = malloc(dir_len + name_len + 3);
+        if (dir_len == 0)
+        {
+            sprintf(candidate, "./%s", name);
+        }
+        else
+        {
+            memcpy(candidate, dir, dir_len);
+            candidate[dir_len] = '/';
+            strcpy(candidate + dir_len + 1, name);
+        }
+
+        struct stat info;
+        if (stat(candidate, &info) == 0 && S_ISREG(info.st_mode) && access(candidate, X_OK) == 0)
+        {
+            return candidate;
+        }
+        free(candidate);
+
+        dir = end != NULL ? end + 1 : NULL;
+    }
+    return NULL;
+}
+
+/*  lookupCommand()
+    Functionality:
+            This function returns the absolute path of a command, using the table when possible and searching
+            PATH on a miss. Names that contain a '/' are not looked up.
+    Parameters:
+            1.) command name
+    Returns:
+            Returns the absolute path stored in the table (do not free), or NULL if the command was not found.
+*/
+char *lookupCommand(const char *name)
+{
+    if (strchr(name, '/') != NULL)
+    {
+        return NULL;
+    }
+    checkPathChanged();
+
+    unsigned int bucket = hashName(name) % PATH_CACHE_BUCKETS;
+    for (struct PathEntry *entry = pathCache[bucket]; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->name, name) == 0)
+        {
+            entry->hits++;
+            pathCacheHits++;
+            return entry->path;
+        }
+    }
+
+    pathCacheMisses++;
+    char *path = searchPath(name);
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    struct PathEntry *entry = malloc(sizeof(struct PathEntry));
+    entry->name = strdup(name);
+    entry->path = path;
+    entry->hits = 1;
+    entry->next = pathCache[bucket];
+    pathCache[bucket] = entry;
+    return path;
+}
+
+/*  forgetCommand()
+    Functionality:
+            This function drops a single command from the table, e.g. when its stored path returned ENOENT.
+    Parameters:
+            1.) command name
+    Returns:
+            Does not return anything.
+*/
+void forgetCommand(const char *name)
+{
+    struct PathEntry **link = &pathCache[hashName(name) % PATH_CACHE_BUCKETS];
+    while (*link != NULL)
+    {
+        struct PathEntry *entry = *link;
+        if (strcmp(entry->name, name) == 0)
+        {
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+/*  printPathCache()
+    Functionality:
+            This function prints every entry of the table with its hit count, followed by the hit rate.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything. Prints the table.
+*/
+void printPathCache()
+{
+    int empty = 1;
+    for (int i = 0; i < PATH_CACHE_BUCKETS; i++)
+    {
+        for (struct PathEntry *entry = pathCache[i]; entry != NULL; entry = entry->next)
+        {
+            if (empty)
+            {
+                printf("hits\tcommand\n");
+                empty = 0;
+            }
+            printf("%4d\t%s\n", entry->hits, entry->path);
+        }
+    }
+
+    if (empty)
+    {
+        printf("hash: hash table empty\n");
+    }
+    else
+    {
+        long lookups = pathCacheHits + pathCacheMisses;
+        printf("hit rate: %ld/%ld (%.1f%%)\n", pathCacheHits, lookups, 100.0 * pathCacheHits / lookups);
+    }
+    flushOutput();
+}
+
+#endif
@@ -0,0 +1,293 @@
+/*
+    This file contains the functions used to run multi-stage pipelines (a | b | c). Every stage of the
+    pipeline is its own Command struct, linked together through the next data member. The stages are
+    connected with pipes and the whole pipeline is waited on as a single job. A stage that is a built in
+    (printf ... | parallel) runs in a forked copy of the shell, the same way as the relay stage.
+
+    There are four functions in this file:
+        1.) setPipeSize()
+        2.) relayStage()
+        3.) startRelay()
+        4.) runPipeline()
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "Command.h"
+#include "input_reader.h"
+#include "spawn.h"
+#include "job_table.h"
+#include "stats.h"
+#include "trace.h"
+
+// Size requested for every pipe between two stages (default Linux pipe-max-size)
+#define PIPE_BUFFER_SIZE (1024 * 1024)
+
+// Name of the in-shell relay stage
+#define RELAY_COMMAND "relay"
+
+// Defined in builtin_registry.h
+struct Builtin;
+struct Builtin *findBuiltin(const char *name);
+void runBuiltin(struct Builtin *builtin, struct Command *p, int *exitStatus);
+
+/*  setPipeSize()
+    Functionality:
+            This function grows the kernel buffer of a pipe using F_SETPIPE_SZ so that stages can move large
+            chunks of data without blocking on every write. The request is only a hint, if the kernel refuses
+            (e.g. over /proc/sys/fs/pipe-max-size) the pipe keeps its default size.
+    Parameters:
+            1.) file descriptor of either end of the pipe
+    Returns:
+            Does not return anything.
+*/
+void setPipeSize(int fd)
+{
+#ifdef F_SETPIPE_SZ
+    fcntl(fd, F_SETPIPE_SZ, PIPE_BUFFER_SIZE);
+#else
+    (void)fd;
+#endif
+}
+
+/*  relayStage()
+    Functionality:
+            This function runs the in-shell "relay" stage of a pipeline. Data is moved from stdin to stdout with
+            splice() so it is never copied through user space. If neither end is a pipe splice() fails with EINVAL,
+            and the relay falls back to a plain read()/write() loop.
+    Parameters:
+            N/A
+    Returns:
+            Returns 0 once stdin reaches end of file, otherwise 1.
+    Sources Cited:
+            https://man7.org/linux/man-pages/man2/splice.2.html
+*/
+int relayStage()
+{
+    ssize_t moved;
+    while ((moved = splice(0, NULL, 1, NULL, PIPE_BUFFER_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+        ;
+
+    if (moved == 0)
+    {
+        return 0;
+    }
+    if (errno != EINVAL)
+    {
+        perror("relay splice()");
+        return 1;
+    }
+
+    // Neither stdin nor stdout is a pipe, copy through a buffer instead
+    char buffer[65536];
+    while ((moved = read(0, buffer, sizeof(buffer))) > 0)
+    {
+        char *out = buffer;
+        while (moved > 0)
+        {
+            ssize_t written = write(1, out, moved);
+            if (written == -1)
+            {
+                perror("relay write()");
+                return 1;
+            }
+            out += written;
+            moved -= written;
+        }
+    }
+    return moved == 0 ? 0 : 1;
+}
+
+/*  startRelay()
+    Functionality:
+            This function forks a copy of the shell that runs relayStage(), or a built in, between the given file
+            descriptors. Both are in-shell code, so they always take the fork() path. The copy no longer reads
+            the shell's input, its stdin is the one of the stage, and the commands a built in starts do not go
+            through the zygote.
+    Parameters:
+            1.) Pointer to Command struct of the stage
+            2.) file descriptor to use as stdin, or -1 to keep the shell's stdin
+            3.) file descriptor to use as stdout, or -1 to keep the shell's stdout
+            4.) Pointer to Builtin struct of the stage, or NULL for the relay
+    Returns:
+            Returns the process ID of the relay, or -1 if fork() failed.
+*/
+pid_t startRelay(struct Command *p, int in_fd, int out_fd, struct Builtin *builtin)
+{
+    fflush(stdout);
+    pid_t spawnid = fork();
+    if (spawnid == -1)
+    {
+        perror("fork() failed!");
+        return -1;
+    }
+    if (spawnid == 0)
+    {
+        if (in_fd != -1)
+        {
+            dup2(in_fd, 0);
+            close(in_fd);
+        }
+        if (out_fd != -1)
+        {
+            dup2(out_fd, 1);
+            close(out_fd);
+        }
+        openInputString(&shellInput, "");
+        // Commands started by the zygote are re-parented to the shell, so the copy could not wait for them
+        if (spawnMode == SPAWN_ZYGOTE)
+        {
+            spawnMode = SPAWN_FAST;
+        }
+        if (builtin != NULL)
+        {
+            // runBuiltin() applies the redirections of the stage itself
+            int status = 0;
+            runBuiltin(builtin, p, &status);
+            fflush(stdout);
+            exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+        }
+        redirectFiles(p);
+        exit(relayStage());
+    }
+    return spawnid;
+}
+
+/*  runPipeline()
+    Functionality:
+            This function forks one child per stage of the pipeline and connects the stdout of each stage to the
+            stdin of the next stage. Each stage may still have its own < and > files. Foreground pipelines are
+            waited on as one job, and the exit status of the pipeline is the exit status of the last stage.
+            Background pipelines are added to the job table as a single job.
+    Parameters:
+            1.) Pointer to first Command struct of the pipeline
+            2.) Pointer to the int that holds the exit status of the last foreground child
+    Returns:
+            Returns the process ID of the last stage, or -1 if the pipeline could not be started.
+    Sources Cited:
+            https://man7.org/linux/man-pages/man2/pipe.2.html
+*/
+pid_t runPipeline(struct Command *head, int *exitStatus)
+{
+    int stages = 0;
+    for (struct Command *stage = head; stage != NULL; stage = stage->next)
+    {
+        // Every stage needs a command, e.g. "ls | | wc" is rejected
+        if (stage->cmd_args[0] == NULL)
+        {
+            printf("syntax error near unexpected token '|'\n");
+            flushOutput();
+            return -1;
+        }
+        stages++;
+    }
+
+    pid_t *pids = malloc(stages * sizeof(pid_t));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int prev_read = -1;
+    int started = 0;
+    pid_t last = -1;
+
+    for (struct Command *stage = head; stage != NULL; stage = stage->next)
+    {
+        int pipe_fds[2] = {-1, -1};
+        if (stage->next != NULL)
+        {
+            // Close-on-exec so that no stage inherits the pipe ends of other stages
+            if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+            {
+                perror("pipe()");
+                break;
+            }
+            setPipeSize(pipe_fds[1]);
+        }
+
+        // Start the stage, the relay and built ins run in a forked copy of the shell
+        pid_t spawnid;
+        struct Builtin *builtin = stage->placement == NULL ? findBuiltin(stage->cmd_args[0]) : NULL;
+        if (strcmp(stage->cmd_args[0], RELAY_COMMAND) == 0 || builtin != NULL)
+        {
+            spawnid = startRelay(stage, prev_read, pipe_fds[1], builtin);
+        }
+        else
+        {
+            spawnid = startCommand(stage, prev_read, pipe_fds[1], head->background == 0);
+        }
+
+        if (spawnid == -1)
+        {
+            if (pipe_fds[0] != -1)
+            {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+            }
+            break;
+        }
+
+        // Parent keeps only the read end needed by the next stage
+        pids[started++] = spawnid;
+        last = spawnid;
+        if (prev_read != -1)
+        {
+            close(prev_read);
+        }
+        if (pipe_fds[1] != -1)
+        {
+            close(pipe_fds[1]);
+        }
+        prev_read = pipe_fds[0];
+    }
+
+    if (prev_read != -1)
+    {
+        close(prev_read);
+    }
+
+    // A stage failed to start, the pipeline is incomplete
+    if (started < stages)
+    {
+        last = -1;
+    }
+
+    if (head->background == 1 && last != -1)
+    {
+        // The stages are reaped through the job table
+        addJob(pids, started, head);
+    }
+    else
+    {
+        // Wait on every stage so that the pipeline finishes as one job
+        recordSpawn();
+        uint64_t wait_start = traceBegin();
+        struct Command *stage = head;
+        for (int i = 0; i < started; i++)
+        {
+            int status;
+            struct rusage usage;
+            wait4(pids[i], &status, 0, &usage);
+            recordUsage(stage->cmd_args[0], &start, &usage);
+            traceEvent("run", stage->cmd_args[0], pids[i], wait_start);
+            stage = stage->next;
+            if (pids[i] == last)
+            {
+                *exitStatus = status;
+            }
+        }
+        traceEvent("wait", head->cmd_args[0], 0, wait_start);
+    }
+
+    free(pids);
+    return last;
+}
+
+#endif
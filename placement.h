@@ -0,0 +1,624 @@
+/*
+    This file contains the pin, nice, ionice and ulimit built ins, which control where a command runs and
+    what it may use. Put in front of a command they only apply to that command, and can be combined:
+
+        pin 0-3 nice -n 5 ulimit -n 256 make -j4 &
+
+    The settings are stored in the Placement struct of the stage and applied in the child between fork()
+    and exec, so commands with a placement always take the fork() path. Without a command the same words
+    apply to the shell itself, and so to every command started after them.
+
+    "pin auto" places every following background job on the next CPU the shell may run on, round-robin,
+    and "pin auto nodes" on the next NUMA node. "pin off" turns this off again.
+
+    Usage:
+        pin CPULIST | nodeN [command]      CPULIST is e.g. 0-3,8
+        pin auto [cores | nodes] | off     round-robin placement of background jobs
+        nice [-n N] [command]              default adjustment is 10
+        ionice -c CLASS [-n LEVEL] [command]   1 realtime, 2 best-effort, 3 idle
+        ulimit [-v KB] [-n FILES] [command]    "unlimited" is accepted as a value
+        ulimit -v | -n                     print one limit of the shell
+
+    There are eleven functions in this file:
+        1.) parseCpuList()
+        2.) readNodeCpus()
+        3.) parseLimit()
+        4.) parsePrefix()
+        5.) applyPlacement()
+        6.) takePlacement()
+        7.) nextAutoCpus()
+        8.) assignAutoPlacement()
+        9.) takePlacements()
+        10.) printPlacement()
+        11.) placementCommand()
+*/
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "Command.h"
+#include "arena.h"
+
+#define PIN_OFF 0
+#define PIN_CORES 1
+#define PIN_NODES 2
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+/*
+    Data Members:
+        has_cpus: (int) ->          1 if cpus is set
+        cpus: (cpu_set_t) ->        CPUs the command may run on
+        has_nice: (int) ->          1 if nice is set
+        nice: (int) ->              niceness adjustment
+        ioprio: (int) ->            I/O priority for ioprio_set(), -1 if not set
+        has_as/has_nofile: (int) -> 1 if the RLIMIT_AS / RLIMIT_NOFILE limit is set
+        as/nofile: (rlim_t) ->      limits
+        query: (char) ->            'v' or 'n' for "ulimit -v" / "ulimit -n" without a value, otherwise 0
+*/
+struct Placement
+{
+    int has_cpus;
+    cpu_set_t cpus;
+    int has_nice;
+    int nice;
+    int ioprio;
+    int has_as;
+    rlim_t as;
+    int has_nofile;
+    rlim_t nofile;
+    char query;
+};
+
+// Round-robin placement of background jobs, set by "pin auto"
+int pinMode = PIN_OFF;
+int pinNext = 0;
+
+/*  parseCpuList()
+    Functionality:
+            This function parses a CPU list such as "0-3,8,10-11" into a CPU set.
+    Parameters:
+            1.) CPU list
+            2.) Pointer to cpu_set_t that receives the CPUs
+    Returns:
+            Returns the number of CPUs in the set, or -1 if the list is not valid.
+*/
+int parseCpuList(const char *list, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    const char *c = list;
+    while (*c != '\0')
+    {
+        char *end;
+        long first = strtol(c, &end, 10);
+        long last = first;
+        if (end == c || first < 0)
+        {
+            return -1;
+        }
+        if (*end == '-')
+        {
+            c = end + 1;
+            last = strtol(c, &end, 10);
+            if (end == c || last < first)
+            {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+        }
+        c = end;
+        if (*c == ',')
+        {
+            c++;
+        }
+        else if (*c != '\0' && *c != '\n')
+        {
+            return -1;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return CPU_COUNT(cpus) > 0 ? CPU_COUNT(cpus) : -1;
+}
+
+/*  readNodeCpus()
+    Functionality:
+            This function reads the CPUs of a NUMA node from sysfs.
+    Parameters:
+            1.) node number
+            2.) Pointer to cpu_set_t that receives the CPUs
+    Returns:
+            Returns the number of CPUs of the node, or -1 if there is no such node.
+*/
+int readNodeCpus(int node, cpu_set_t *cpus)
+{
+    char path[64];
+    char list[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    char *read = fgets(list, sizeof(list), file);
+    fclose(file);
+    return read != NULL ? parseCpuList(list, cpus) : -1;
+}
+
+/*  parseLimit()
+    Functionality:
+            This function parses a limit value, a number or "unlimited".
+    Parameters:
+            1.) value
+            2.) multiplier applied to numbers (1024 for values given in kilobytes)
+            3.) Pointer to rlim_t that receives the limit
+    Returns:
+            Returns 0, or -1 if the value is not valid.
+*/
+int parseLimit(const char *value, rlim_t scale, rlim_t *limit)
+{
+    if (strcmp(value, "unlimited") == 0)
+    {
+        *limit = RLIM_INFINITY;
+        return 0;
+    }
+    char *end;
+    unsigned long long number = strtoull(value, &end, 10);
+    if (end == value || *end != '\0')
+    {
+        return -1;
+    }
+    *limit = number * scale;
+    return 0;
+}
+
+/*  parsePrefix()
+    Functionality:
+            This function parses one pin, nice, ionice or ulimit word with its options into a Placement struct.
+    Parameters:
+            1.) words starting with pin, nice, ionice or ulimit
+            2.) Pointer to Placement struct that is filled in
+            3.) Pointer to int that is set to PIN_CORES/PIN_NODES/PIN_OFF + 1 for "pin auto"/"pin off", else 0
+    Returns:
+            Returns the number of words used, 0 if the first word is not one of the four, or -1 on an error.
+*/
+int parsePrefix(char **args, struct Placement *placement, int *pin_mode)
+{
+    int i = 1;
+    *pin_mode = 0;
+
+    if (strcmp(args[0], "pin") == 0)
+    {
+        if (args[1] == NULL)
+        {
+            return 1;
+        }
+        if (strcmp(args[1], "off") == 0)
+        {
+            *pin_mode = PIN_OFF + 1;
+            return 2;
+        }
+        if (strcmp(args[1], "auto") == 0)
+        {
+            int nodes = args[2] != NULL && strcmp(args[2], "nodes") == 0;
+            *pin_mode = (nodes ? PIN_NODES : PIN_CORES) + 1;
+            return args[2] != NULL && (nodes || strcmp(args[2], "cores") == 0) ? 3 : 2;
+        }
+
+        int count = strncmp(args[1], "node", 4) == 0 ? readNodeCpus(atoi(args[1] + 4), &placement->cpus)
+                                                     : parseCpuList(args[1], &placement->cpus);
+        if (count == -1)
+        {
+            fprintf(stderr, "pin: %s: not a valid CPU list or node\n", args[1]);
+            return -1;
+        }
+        placement->has_cpus = 1;
+        return 2;
+    }
+
+    if (strcmp(args[0], "nice") == 0)
+    {
+        placement->has_nice = 1;
+        placement->nice = 10;
+        if (args[1] != NULL && strcmp(args[1], "-n") == 0 && args[2] != NULL)
+        {
+            placement->nice = atoi(args[2]);
+            i = 3;
+        }
+        else if (args[1] != NULL && args[1][0] == '-' && args[1][1] >= '0' && args[1][1] <= '9')
+        {
+            placement->nice = atoi(args[1] + 1);
+            i = 2;
+        }
+        return i;
+    }
+
+    if (strcmp(args[0], "ionice") == 0)
+    {
+        int class = 2;
+        int level = 4;
+        while (args[i] != NULL && args[i + 1] != NULL &&
+               (strcmp(args[i], "-c") == 0 || strcmp(args[i], "-n") == 0))
+        {
+            *(args[i][1] == 'c' ? &class : &level) = atoi(args[i + 1]);
+            i += 2;
+        }
+        if (class < 1 || class > 3 || level < 0 || level > 7)
+        {
+            fprintf(stderr, "ionice: class must be 1-3 and level 0-7\n");
+            return -1;
+        }
+        placement->ioprio = i > 1 ? class << IOPRIO_CLASS_SHIFT | (class == 3 ? 0 : level) : -1;
+        return i;
+    }
+
+    if (strcmp(args[0], "ulimit") == 0)
+    {
+        while (args[i] != NULL && args[i + 1] != NULL && (strcmp(args[i], "-v") == 0 || strcmp(args[i], "-n") == 0))
+        {
+            int memory = args[i][1] == 'v';
+            if (parseLimit(args[i + 1], memory ? 1024 : 1, memory ? &placement->as : &placement->nofile) == -1)
+            {
+                fprintf(stderr, "ulimit: %s: invalid limit\n", args[i + 1]);
+                return -1;
+            }
+            *(memory ? &placement->has_as : &placement->has_nofile) = 1;
+            i += 2;
+        }
+
+        // A last -v or -n without a value asks for the current limit
+        if (args[i] != NULL && args[i + 1] == NULL && (strcmp(args[i], "-v") == 0 || strcmp(args[i], "-n") == 0))
+        {
+            placement->query = args[i][1];
+            i++;
+        }
+        return i;
+    }
+
+    return 0;
+}
+
+/*  applyPlacement()
+    Functionality:
+            This function applies a placement to the calling process. It is called in the child between fork()
+            and exec, or in the shell itself for the forms without a command. Failures are reported and the
+            remaining settings are still applied.
+    Parameters:
+            1.) Pointer to Placement struct
+    Returns:
+            Returns 0, or -1 if a setting could not be applied.
+*/
+int applyPlacement(struct Placement *placement)
+{
+    int result = 0;
+    if (placement->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &placement->cpus) == -1)
+    {
+        perror("pin: sched_setaffinity()");
+        result = -1;
+    }
+    if (placement->has_nice)
+    {
+        errno = 0;
+        if (nice(placement->nice) == -1 && errno != 0)
+        {
+            perror("nice");
+            result = -1;
+        }
+    }
+    if (placement->ioprio != -1 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, placement->ioprio) == -1)
+    {
+        perror("ionice: ioprio_set()");
+        result = -1;
+    }
+
+    struct rlimit limit;
+    if (placement->has_as && getrlimit(RLIMIT_AS, &limit) == 0)
+    {
+        limit.rlim_cur = placement->as;
+        if (placement->as > limit.rlim_max)
+        {
+            limit.rlim_max = placement->as;
+        }
+        if (setrlimit(RLIMIT_AS, &limit) == -1)
+        {
+            perror("ulimit: RLIMIT_AS");
+            result = -1;
+        }
+    }
+    if (placement->has_nofile && getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = placement->nofile;
+        if (placement->nofile > limit.rlim_max)
+        {
+            limit.rlim_max = placement->nofile;
+        }
+        if (setrlimit(RLIMIT_NOFILE, &limit) == -1)
+        {
+            perror("ulimit: RLIMIT_NOFILE");
+            result = -1;
+        }
+    }
+    return result;
+}
+
+/*  takePlacement()
+    Functionality:
+            This function strips the pin/nice/ionice/ulimit words from the front of a stage and stores them in
+            the stage's Placement struct. If no command follows them the words are left alone, so that the
+            built in runs on the shell itself. A later pin/nice/ionice/ulimit word without options that ends the
+            line is the command itself (ionice -c 3 ionice), not another prefix.
+    Parameters:
+            1.) Pointer to Command struct of the stage
+    Returns:
+            Returns 0, or -1 if a word was not valid.
+*/
+int takePlacement(struct Command *p)
+{
+    struct Placement placement = {0};
+    placement.ioprio = -1;
+    int i = 0;
+    int pin_mode = 0;
+
+    while (p->cmd_args[i] != NULL)
+    {
+        if (i > 0 && p->cmd_args[i + 1] == NULL)
+        {
+            break;
+        }
+        int used = parsePrefix(p->cmd_args + i, &placement, &pin_mode);
+        if (used <= 0)
+        {
+            if (used == -1)
+            {
+                return -1;
+            }
+            break;
+        }
+        i += used;
+        if (pin_mode != 0 && p->cmd_args[i] != NULL)
+        {
+            fprintf(stderr, "pin: auto and off can not be used in front of a command\n");
+            return -1;
+        }
+    }
+
+    if (i == 0 || p->cmd_args[i] == NULL)
+    {
+        return 0;
+    }
+    p->cmd_args += i;
+    p->placement = arenaAlloc(&lineArena, sizeof(struct Placement));
+    memcpy(p->placement, &placement, sizeof(struct Placement));
+    return 0;
+}
+
+/*  nextAutoCpus()
+    Functionality:
+            This function picks the CPUs for the next background job: the next CPU of the shell's own affinity
+            mask in "pin auto cores" mode, or the CPUs of the next NUMA node in "pin auto nodes" mode.
+    Parameters:
+            1.) Pointer to cpu_set_t that receives the CPUs
+    Returns:
+            Returns 0, or -1 if there is nothing to pick from.
+*/
+int nextAutoCpus(cpu_set_t *cpus)
+{
+    if (pinMode == PIN_NODES)
+    {
+        int nodes = 0;
+        cpu_set_t node_cpus;
+        while (readNodeCpus(nodes, &node_cpus) != -1)
+        {
+            nodes++;
+        }
+        if (nodes == 0)
+        {
+            return -1;
+        }
+        return readNodeCpus(pinNext++ % nodes, cpus) != -1 ? 0 : -1;
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == -1 || CPU_COUNT(&allowed) == 0)
+    {
+        return -1;
+    }
+    int wanted = pinNext++ % CPU_COUNT(&allowed);
+    CPU_ZERO(cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowed) && wanted-- == 0)
+        {
+            CPU_SET(cpu, cpus);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*  assignAutoPlacement()
+    Functionality:
+            This function gives a command the next CPUs in "pin auto" mode, unless it was pinned explicitly.
+    Parameters:
+            1.) Pointer to Command struct
+    Returns:
+            Does not return anything.
+*/
+void assignAutoPlacement(struct Command *p)
+{
+    if (pinMode == PIN_OFF || (p->placement != NULL && p->placement->has_cpus))
+    {
+        return;
+    }
+
+    cpu_set_t cpus;
+    if (nextAutoCpus(&cpus) == -1)
+    {
+        return;
+    }
+    if (p->placement == NULL)
+    {
+        p->placement = arenaAlloc(&lineArena, sizeof(struct Placement));
+        p->placement->ioprio = -1;
+    }
+    p->placement->has_cpus = 1;
+    p->placement->cpus = cpus;
+}
+
+/*  takePlacements()
+    Functionality:
+            This function strips the placement words from every stage of a command line. Background jobs get
+            their round-robin placement here: in cores mode each stage goes to the next CPU, in nodes mode the
+            whole job goes to the next node.
+    Parameters:
+            1.) Pointer to the first Command struct of the line
+    Returns:
+            Returns 0, or -1 if a word was not valid.
+*/
+int takePlacements(struct Command *head)
+{
+    for (struct Command *stage = head; stage != NULL; stage = stage->next)
+    {
+        if (stage->cmd_args[0] != NULL && takePlacement(stage) == -1)
+        {
+            return -1;
+        }
+    }
+
+    if (head->background == 1 && pinMode != PIN_OFF)
+    {
+        for (struct Command *stage = head; stage != NULL; stage = stage->next)
+        {
+            assignAutoPlacement(stage);
+            if (pinMode == PIN_NODES && stage->next != NULL && stage->placement != NULL &&
+                (stage->next->placement == NULL || !stage->next->placement->has_cpus))
+            {
+                // Keep the rest of the job on the same node
+                stage->next->placement = stage->placement;
+            }
+        }
+    }
+    return 0;
+}
+
+/*  printPlacement()
+    Functionality:
+            This function prints the shell's own settings for the forms without options.
+    Parameters:
+            1.) name of the built in
+            2.) 'v' or 'n' to print only that limit of ulimit, without its option, otherwise 0
+    Returns:
+            Does not return anything.
+*/
+void printPlacement(const char *name, char query)
+{
+    if (strcmp(name, "pin") == 0)
+    {
+        cpu_set_t cpus;
+        printf("pin: %s, shell CPUs:", pinMode == PIN_OFF ? "off" : pinMode == PIN_CORES ? "auto cores" : "auto nodes");
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &cpus) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &cpus))
+                {
+                    printf(" %d", cpu);
+                }
+            }
+        }
+        printf("\n");
+    }
+    else if (strcmp(name, "nice") == 0)
+    {
+        errno = 0;
+        printf("%d\n", getpriority(PRIO_PROCESS, 0));
+    }
+    else if (strcmp(name, "ionice") == 0)
+    {
+        long ioprio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+        printf("class %ld, level %ld\n", ioprio >> IOPRIO_CLASS_SHIFT, ioprio & 7);
+    }
+    else
+    {
+        struct rlimit as;
+        struct rlimit nofile;
+        getrlimit(RLIMIT_AS, &as);
+        getrlimit(RLIMIT_NOFILE, &nofile);
+        if (query != 'n')
+        {
+            printf("%s", query == 0 ? "-v " : "");
+            if (as.rlim_cur == RLIM_INFINITY)
+            {
+                printf("unlimited\n");
+            }
+            else
+            {
+                printf("%llu\n", (unsigned long long)as.rlim_cur / 1024);
+            }
+        }
+        if (query != 'v')
+        {
+            printf("%s%llu\n", query == 0 ? "-n " : "", (unsigned long long)nofile.rlim_cur);
+        }
+    }
+}
+
+/*  placementCommand()
+    Functionality:
+            This function runs pin, nice, ionice or ulimit without a command. Without options it prints the
+            shell's own setting, otherwise the setting is applied to the shell and so to every later command.
+    Parameters:
+            1.) cmd_args char array that holds the command at index [0] and the options after it
+    Returns:
+            Returns 0, 1 if a setting could not be applied, or 2 on a usage error.
+*/
+int placementCommand(char **cmd_args)
+{
+    struct Placement placement = {0};
+    placement.ioprio = -1;
+    int pin_mode = 0;
+
+    int used = parsePrefix(cmd_args, &placement, &pin_mode);
+    if (used == -1)
+    {
+        return 2;
+    }
+    if (cmd_args[used] != NULL)
+    {
+        fprintf(stderr, "%s: %s: unexpected argument\n", cmd_args[0], cmd_args[used]);
+        return 2;
+    }
+    if (pin_mode != 0)
+    {
+        pinMode = pin_mode - 1;
+        pinNext = 0;
+        return 0;
+    }
+    if (used == 1)
+    {
+        printPlacement(cmd_args[0], 0);
+        return 0;
+    }
+    int result = applyPlacement(&placement) == -1 ? 1 : 0;
+    if (placement.query != 0)
+    {
+        printPlacement(cmd_args[0], placement.query);
+    }
+    return result;
+}
+
+#endif
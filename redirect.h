@@ -0,0 +1,311 @@
+/*
+    This file contains the redirections of a command. Besides < and >, a stage may use >> to append, 2> and
+    2>> for stderr, 2>&1 to send stderr where stdout goes, &> and &>> for both, and <<< to feed a string to
+    stdin. Here-strings are written to a memfd, so a string of any size can be read without a helper process.
+
+    Giving > (or >>) more than once fans stdout out to every file, like "| tee a b c" without the external
+    tee. The command writes into a pipe and a relay copies the pipe into each file with tee() and splice(),
+    so the data never passes through user space: each chunk is duplicated into a scratch pipe with tee() and
+    spliced into one file, and the last file consumes the chunk from the input pipe. splice() can not write
+    to a file opened with O_APPEND, so >> targets of the relay are opened without it and positioned at the end.
+
+    There are seven functions in this file:
+        1.) hereStringFile()
+        2.) redirectFile()
+        3.) redirectFiles()
+        4.) closeFanOut()
+        5.) openFanOut()
+        6.) drainPipe()
+        7.) fanOutRelay()
+*/
+
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <sys/mman.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "Command.h"
+
+/*  hereStringFile()
+    Functionality:
+            This function writes the text of a here-string and a newline to an anonymous memory file and rewinds
+            it, so it can be used as stdin.
+    Parameters:
+            1.) text of the here-string
+    Returns:
+            Returns the close-on-exec file descriptor, or -1 on error.
+    Sources Cited:
+            https://man7.org/linux/man-pages/man2/memfd_create.2.html
+*/
+int hereStringFile(const char *text)
+{
+    int fd = memfd_create("here-string", MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    size_t length = strlen(text);
+    if (write(fd, text, length) != (ssize_t)length || write(fd, "\n", 1) != 1 || lseek(fd, 0, SEEK_SET) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*  redirectFile()
+    Functionality:
+            This function is called in the child process and opens one file onto stdin, stdout or stderr.
+    Parameters:
+            1.) name of the file
+            2.) open() flags
+            3.) file descriptor the file is copied onto
+            4.) name of the redirection for error messages ("input", "output", "error")
+    Returns:
+            Does not return anything. Exits the child process on error.
+*/
+void redirectFile(const char *name, int flags, int target, const char *what)
+{
+    char message[32];
+    int fd = open(name, flags, 0644);
+    if (fd == -1)
+    {
+        snprintf(message, sizeof(message), "%s open()", what);
+        perror(message);
+        fflush(stdout);
+        exit(1);
+    }
+
+    // Create copy of file descriptor using dup2()
+    if (dup2(fd, target) == -1)
+    {
+        snprintf(message, sizeof(message), "%s dup2()", what);
+        perror(message);
+        fflush(stdout);
+        exit(2);
+    }
+    close(fd);
+}
+
+/*  redirectFiles()
+    Functionality:
+            This function is called in the child process and sets up the redirections of the command, after the
+            pipe ends have been copied onto stdin and stdout. The child exits if a file can not be opened.
+    Parameters:
+            1.) Pointer to Command struct
+    Returns:
+            Does not return anything. Exits the child process on error.
+*/
+void redirectFiles(struct Command *p)
+{
+    // Open input file if one was specified, otherwise the here-string
+    if (p->input_file != NULL)
+    {
+        redirectFile(p->input_file, O_RDONLY, 0, "input");
+    }
+    else if (p->here_string != NULL)
+    {
+        int fd = hereStringFile(p->here_string);
+        if (fd == -1 || dup2(fd, 0) == -1)
+        {
+            perror("here-string");
+            fflush(stdout);
+            exit(1);
+        }
+        close(fd);
+    }
+
+    // "2>&1 > file" copies stdout before it is replaced, ">&2 2> file" copies stderr
+    if (p->error_to_output == STDERR_BEFORE_OUTPUT)
+    {
+        dup2(1, 2);
+    }
+    if (p->output_to_error == STDOUT_BEFORE_ERROR)
+    {
+        dup2(2, 1);
+    }
+
+    // Handle output file if one was specified
+    if (p->output_file != NULL)
+    {
+        redirectFile(p->output_file, O_WRONLY | O_CREAT | (p->output_append ? O_APPEND : O_TRUNC), 1, "output");
+    }
+    if (p->error_file != NULL)
+    {
+        redirectFile(p->error_file, O_WRONLY | O_CREAT | (p->error_append ? O_APPEND : O_TRUNC), 2, "error");
+    }
+    if (p->error_to_output == STDERR_AFTER_OUTPUT)
+    {
+        dup2(1, 2);
+    }
+    if (p->output_to_error == STDOUT_AFTER_ERROR)
+    {
+        dup2(2, 1);
+    }
+}
+
+/*  closeFanOut()
+    Functionality:
+            This function closes the files opened by openFanOut().
+    Parameters:
+            1.) array of file descriptors
+            2.) number of file descriptors
+    Returns:
+            Does not return anything.
+*/
+void closeFanOut(int *fds, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        close(fds[i]);
+    }
+}
+
+/*  openFanOut()
+    Functionality:
+            This function opens output_file and every file in tee_files for the relay. Files given with >> are
+            opened without O_APPEND, which splice() rejects, and positioned at their end instead.
+    Parameters:
+            1.) Pointer to Command struct
+            2.) array that receives tee_count + 1 file descriptors
+    Returns:
+            Returns 0, or -1 if a file could not be opened. The files opened so far are closed again.
+*/
+int openFanOut(struct Command *p, int *fds)
+{
+    for (int i = 0; i <= p->tee_count; i++)
+    {
+        char *name = i == 0 ? p->output_file : p->tee_files[i - 1].name;
+        int append = i == 0 ? p->output_append : p->tee_files[i - 1].append;
+        fds[i] = open(name, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC), 0644);
+        if (fds[i] == -1 || (append && lseek(fds[i], 0, SEEK_END) == -1))
+        {
+            perror("output open()");
+            closeFanOut(fds, i + (fds[i] != -1));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*  drainPipe()
+    Functionality:
+            This function moves exactly length bytes from a pipe to a file with splice(). If the file does not
+            support splice() (EINVAL) the bytes are copied through a buffer instead.
+    Parameters:
+            1.) read end of the pipe
+            2.) file descriptor of the file
+            3.) number of bytes to move
+    Returns:
+            Returns 0, or -1 on error.
+*/
+int drainPipe(int from, int to, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t moved = splice(from, NULL, to, NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved > 0)
+        {
+            length -= moved;
+            continue;
+        }
+        if (moved == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (moved == 0 || errno != EINVAL)
+        {
+            return -1;
+        }
+
+        // The file can not be spliced to, copy the rest of the chunk
+        char buffer[65536];
+        ssize_t got = read(from, buffer, length < sizeof(buffer) ? length : sizeof(buffer));
+        if (got <= 0)
+        {
+            return -1;
+        }
+        length -= got;
+        for (char *out = buffer; got > 0;)
+        {
+            ssize_t written = write(to, out, got);
+            if (written == -1)
+            {
+                return -1;
+            }
+            out += written;
+            got -= written;
+        }
+    }
+    return 0;
+}
+
+/*  fanOutRelay()
+    Functionality:
+            This function copies everything read from a pipe into several files until end of file. Every chunk
+            is duplicated into a scratch pipe with tee() once for each file but the last, which splices the
+            chunk out of the input pipe. Chunks are no bigger than the scratch pipe, so each tee() copies the
+            whole chunk.
+    Parameters:
+            1.) read end of the input pipe
+            2.) array of file descriptors of the files
+            3.) number of files, at least two
+    Returns:
+            Returns 0 once the input reaches end of file, otherwise 1.
+    Sources Cited:
+            https://man7.org/linux/man-pages/man2/tee.2.html
+*/
+int fanOutRelay(int in_fd, int *fds, int count)
+{
+    int scratch[2];
+    if (pipe2(scratch, O_CLOEXEC) == -1)
+    {
+        perror("fan-out pipe()");
+        return 1;
+    }
+    int input_size = fcntl(in_fd, F_GETPIPE_SZ);
+    if (input_size > 0)
+    {
+        fcntl(scratch[1], F_SETPIPE_SZ, input_size);
+    }
+    size_t chunk_limit = fcntl(scratch[1], F_GETPIPE_SZ);
+
+    int result = 0;
+    while (1)
+    {
+        // tee() blocks until the command writes, and returns 0 at end of file
+        ssize_t chunk;
+        while ((chunk = tee(in_fd, scratch[1], chunk_limit, 0)) == -1 && errno == EINTR)
+            ;
+        if (chunk == 0)
+        {
+            break;
+        }
+
+        for (int i = 0; i < count - 1 && chunk > 0; i++)
+        {
+            if ((i > 0 && tee(in_fd, scratch[1], chunk, 0) != chunk) || drainPipe(scratch[0], fds[i], chunk) == -1)
+            {
+                chunk = -1;
+            }
+        }
+        if (chunk == -1 || drainPipe(in_fd, fds[count - 1], chunk) == -1)
+        {
+            perror("fan-out");
+            result = 1;
+            break;
+        }
+    }
+
+    close(scratch[0]);
+    close(scratch[1]);
+    return result;
+}
+
+#endif
@@ -0,0 +1,1495 @@
+/*
+    This file contains the control flow of the shell: if, for, while, until, break, continue, return, shell
+    functions and lists of commands separated by ; or newlines. Input that uses any of them is read until every
+    construct is closed, parsed once into a tree of ScriptNode structs and lowered to a flat array of
+    instructions (a Program). Running a loop only walks the instructions. The words of each command are kept as
+    tokens, so a command is never split or parsed again, and only the words with a $ in them are expanded again
+    from their source text each time the command runs. Functions are compiled when their definition is read and
+    kept by name in a hash table.
+
+    Syntax:
+        if LIST; then LIST; [elif LIST; then LIST;]... [else LIST;] fi
+        for NAME [in WORD...]; do LIST; done        (without "in" the loop runs over $@)
+        while LIST; do LIST; done
+        until LIST; do LIST; done
+        NAME() { LIST; }                            (or "function NAME { LIST; }")
+        { LIST; }
+        break [N]   continue [N]   return [N]
+    A LIST is one or more commands separated by ;, & or newlines, its exit status is the one of the last command.
+    Words are only reserved at the start of a command and when they are not quoted.
+
+    There are twenty-six functions in this file:
+        1.) isKeyword()
+        2.) isFunctionHeader()
+        3.) startsProgram()
+        4.) scriptDepth()
+        5.) newNode()
+        6.) parseError()
+        7.) expectKeyword()
+        8.) parseList()
+        9.) parseIf()
+        10.) parseLoop()
+        11.) parseFunction()
+        12.) parseCommand()
+        13.) emit()
+        14.) lowerNode()
+        15.) lowerProgram()
+        16.) releaseProgram()
+        17.) compileProgram()
+        18.) expandWord()
+        19.) expandWords()
+        20.) runWords()
+        21.) findFunction()
+        22.) defineFunction()
+        23.) joinArguments()
+        24.) callFunction()
+        25.) runProgram()
+        26.) addScriptToken()
+*/
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "Command.h"
+#include "arena.h"
+#include "lexer.h"
+#include "glob.h"
+#include "variables.h"
+#include "input_reader.h"
+#include "helper_functions.h"
+#include "job_table.h"
+#include "stats.h"
+#include "builtin_registry.h"
+
+#define NODE_COMMAND 0
+#define NODE_LIST 1
+#define NODE_IF 2
+#define NODE_FOR 3
+#define NODE_WHILE 4
+#define NODE_FUNCTION 5
+#define NODE_BREAK 6
+#define NODE_CONTINUE 7
+#define NODE_RETURN 8
+
+#define OP_RUN 0
+#define OP_JUMP 1
+#define OP_JUMP_FALSE 2
+#define OP_JUMP_TRUE 3
+#define OP_FOR 4
+#define OP_NEXT 5
+#define OP_BREAK 6
+#define OP_STATUS 7
+#define OP_DEFINE 8
+#define OP_RETURN 9
+
+// Deepest chain of function calls before a call is refused
+#define FUNCTION_DEPTH_LIMIT 1000
+
+// Initial number of slots of the function table, always a power of two
+#define FUNCTION_SLOTS 32
+
+/*
+    Data Members:
+        tokens: (Token array) ->    tokens of a command (or of the words of a for loop), copied into the program
+        count: (int) ->             number of tokens
+        dynamic: (int) ->           1 if any word has a $ and is expanded again on every run
+*/
+struct WordList
+{
+    struct Token *tokens;
+    int count;
+    int dynamic;
+};
+
+/*
+    Data Members:
+        type: (int) ->              one of the NODE_* types
+        words: (WordList) ->        command, words of a for loop or the argument of return
+        name: (string) ->           variable of a for loop or name of a function
+        levels: (int) ->            number of loops left by break or continue
+        until: (int) ->             1 for an until loop
+        first: (ScriptNode pointer) ->  condition of if/while, body of for and functions, first entry of a list
+        second: (ScriptNode pointer) -> body of if/while
+        third: (ScriptNode pointer) ->  else part of if (an elif is a nested if)
+        next: (ScriptNode pointer) ->   next entry of the list the node is in
+*/
+struct ScriptNode
+{
+    int type;
+    struct WordList words;
+    char *name;
+    int levels;
+    int until;
+    struct ScriptNode *first;
+    struct ScriptNode *second;
+    struct ScriptNode *third;
+    struct ScriptNode *next;
+};
+
+/*
+    Data Members:
+        op: (int) ->            one of the OP_* codes
+        target: (int) ->        jump target, or the status set by OP_STATUS
+        frames: (int) ->        number of for loops left by OP_BREAK
+        operand: (pointer) ->   WordList of OP_RUN/OP_FOR/OP_RETURN, variable name of OP_NEXT,
+                                FunctionDefinition of OP_DEFINE
+*/
+struct Instruction
+{
+    int op;
+    int target;
+    int frames;
+    void *operand;
+};
+
+/*
+    Data Members:
+        arena: (Arena) ->       memory of the tokens, the lines they came from and the tree
+        refs: (int) ->          number of programs using the arena
+*/
+struct ScriptSource
+{
+    struct Arena arena;
+    int refs;
+};
+
+/*
+    Data Members:
+        code: (Instruction array) ->    instructions of the program
+        length: (int) ->                number of instructions
+        capacity: (int) ->              room in code
+        loops: (int) ->                 deepest nesting of for loops, the size of the frame stack
+        refs: (int) ->                  references from the shell, the function table and running calls
+        source: (ScriptSource pointer) -> arena shared by the program and the functions defined in it
+*/
+struct Program
+{
+    struct Instruction *code;
+    int length;
+    int capacity;
+    int loops;
+    int refs;
+    struct ScriptSource *source;
+};
+
+/*
+    Data Members:
+        name: (string) ->       name of the function
+        body: (Program pointer) -> compiled body
+*/
+struct FunctionDefinition
+{
+    char *name;
+    struct Program *body;
+};
+
+/*
+    Data Members:
+        words: (string array) ->    words of a running for loop
+        count: (int) ->             number of words
+        index: (int) ->             next word to assign
+*/
+struct LoopFrame
+{
+    char **words;
+    int count;
+    int index;
+};
+
+/*
+    Data Members:
+        tokens: (Token array) ->    tokens of all lines read so far, a TOKEN_SEMI marks every line end
+        count: (int) ->             number of tokens
+        capacity: (int) ->          room in tokens
+        pos: (int) ->               next token to parse
+        error: (string) ->          token the parser stopped at, NULL while there is no error
+        source: (ScriptSource pointer) -> arena the tree is allocated from
+*/
+struct ScriptParser
+{
+    struct Token *tokens;
+    int count;
+    int capacity;
+    int pos;
+    const char *error;
+    struct ScriptSource *source;
+};
+
+/*
+    Data Members:
+        top: (int) ->               instruction continue jumps to
+        frames_before: (int) ->     for loops open outside of this loop
+        is_for: (int) ->            1 for a for loop
+        breaks: (int array) ->      OP_BREAK instructions that leave this loop, patched at its end
+        break_count: (int) ->       number of entries in breaks
+        outer: (LoopContext pointer) -> enclosing loop
+*/
+struct LoopContext
+{
+    int top;
+    int frames_before;
+    int is_for;
+    int *breaks;
+    int break_count;
+    struct LoopContext *outer;
+};
+
+// Table of shell functions, and the number of calls currently running
+struct FunctionDefinition **functionTable = NULL;
+size_t functionSlots = 0;
+size_t functionsUsed = 0;
+int callDepth = 0;
+
+// Defined in main.c
+struct Command *parseTokens(struct Token *tokens, int count);
+void runCommand(struct Command *p, const char *process_id);
+int runProgram(struct Program *program, const char *process_id);
+
+/*  isKeyword()
+    Functionality:
+            This function checks if a token is an unquoted reserved word.
+    Parameters:
+            1.) Pointer to Token struct
+            2.) reserved word
+    Returns:
+            Returns 1 if it is, otherwise 0.
+*/
+int isKeyword(struct Token *token, const char *word)
+{
+    return token->type == TOKEN_WORD && strcmp(token->text, word) == 0 && token->source_length == strlen(word);
+}
+
+/*  isFunctionHeader()
+    Functionality:
+            This function checks if the tokens at a position start a function definition, "NAME()", "NAME ()"
+            or "function NAME".
+    Parameters:
+            1.) array of tokens
+            2.) number of tokens
+            3.) position
+    Returns:
+            Returns 1 if they do, otherwise 0.
+*/
+int isFunctionHeader(struct Token *tokens, int count, int pos)
+{
+    struct Token *token = &tokens[pos];
+    if (token->type != TOKEN_WORD)
+    {
+        return 0;
+    }
+    if (isKeyword(token, "function"))
+    {
+        return 1;
+    }
+    size_t length = strlen(token->text);
+    if (length > 2 && strcmp(token->text + length - 2, "()") == 0 && token->source_length == length &&
+        variableNameLength(token->text, length - 2) == length - 2)
+    {
+        return 1;
+    }
+    return pos + 1 < count && isKeyword(&tokens[pos + 1], "()") &&
+           variableNameLength(token->text, length) == length && length > 0;
+}
+
+/*  startsProgram()
+    Functionality:
+            This function checks if a line has to be compiled: it contains a ; or starts with a reserved word or
+            a function definition. Every other line runs on the direct path of getCommand().
+    Parameters:
+            1.) array of tokens of the line
+            2.) number of tokens
+    Returns:
+            Returns 1 if the line has to be compiled, otherwise 0.
+*/
+int startsProgram(struct Token *tokens, int count)
+{
+    static const char *reserved[] = {"if", "then", "elif", "else", "fi", "for", "do", "done", "while", "until",
+                                     "{", "}", "break", "continue", "return", NULL};
+    if (count == 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (tokens[i].type == TOKEN_SEMI || (tokens[i].type == TOKEN_BACKGROUND && i + 1 < count))
+        {
+            return 1;
+        }
+    }
+    for (int i = 0; reserved[i] != NULL; i++)
+    {
+        if (isKeyword(&tokens[0], reserved[i]))
+        {
+            return 1;
+        }
+    }
+    return isFunctionHeader(tokens, count, 0);
+}
+
+/*  scriptDepth()
+    Functionality:
+            This function counts the constructs that are still open at the end of the tokens read so far,
+            looking only at words in command position.
+    Parameters:
+            1.) array of tokens
+            2.) number of tokens
+    Returns:
+            Returns the number of open constructs, 0 once the input is complete.
+*/
+int scriptDepth(struct Token *tokens, int count)
+{
+    int depth = 0;
+    int command = 1;
+    for (int i = 0; i < count; i++)
+    {
+        struct Token *token = &tokens[i];
+        if (token->type == TOKEN_SEMI || token->type == TOKEN_PIPE || token->type == TOKEN_BACKGROUND)
+        {
+            command = 1;
+            continue;
+        }
+        if (token->type != TOKEN_WORD || !command)
+        {
+            command = 0;
+            continue;
+        }
+
+        if (isKeyword(token, "if") || isKeyword(token, "while") || isKeyword(token, "until") ||
+            isKeyword(token, "{"))
+        {
+            depth++;
+        }
+        else if (isKeyword(token, "for"))
+        {
+            // The loop variable and the words are not commands
+            depth++;
+            command = 0;
+        }
+        else if (isKeyword(token, "fi") || isKeyword(token, "done") || isKeyword(token, "}"))
+        {
+            depth--;
+            command = 0;
+        }
+        else if (isKeyword(token, "function"))
+        {
+            // Skip the name, the { after it is in command position
+            i++;
+        }
+        else if (isFunctionHeader(tokens, count, i))
+        {
+            i += isKeyword(&tokens[i + 1 < count ? i + 1 : i], "()");
+        }
+        else if (!isKeyword(token, "then") && !isKeyword(token, "do") && !isKeyword(token, "else") &&
+                 !isKeyword(token, "elif"))
+        {
+            command = 0;
+        }
+    }
+    return depth;
+}
+
+/*  newNode()
+    Functionality:
+            This function allocates a tree node from the arena of the program.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+            2.) node type
+    Returns:
+            Returns the zero filled node.
+*/
+struct ScriptNode *newNode(struct ScriptParser *parser, int type)
+{
+    struct ScriptNode *node = arenaAlloc(&parser->source->arena, sizeof(struct ScriptNode));
+    node->type = type;
+    return node;
+}
+
+/*  parseError()
+    Functionality:
+            This function records the token the parser could not use, unless an error was already recorded.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+    Returns:
+            Returns NULL, so that parse functions can return it directly.
+*/
+struct ScriptNode *parseError(struct ScriptParser *parser)
+{
+    if (parser->error == NULL)
+    {
+        struct Token *token = parser->pos < parser->count ? &parser->tokens[parser->pos] : NULL;
+        parser->error = token == NULL ? "end of file" : token->type == TOKEN_SEMI ? "newline" :
+                        token->type == TOKEN_WORD ? token->text : tokenNames[token->type];
+    }
+    return NULL;
+}
+
+/*  expectKeyword()
+    Functionality:
+            This function skips line ends and consumes a reserved word.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+            2.) reserved word
+    Returns:
+            Returns 1 if the word was found, otherwise 0 and the error is recorded.
+*/
+int expectKeyword(struct ScriptParser *parser, const char *word)
+{
+    while (parser->pos < parser->count && parser->tokens[parser->pos].type == TOKEN_SEMI)
+    {
+        parser->pos++;
+    }
+    if (parser->pos < parser->count && isKeyword(&parser->tokens[parser->pos], word))
+    {
+        parser->pos++;
+        return 1;
+    }
+    parseError(parser);
+    return 0;
+}
+
+struct ScriptNode *parseCommand(struct ScriptParser *parser);
+
+/*  parseList()
+    Functionality:
+            This function parses commands separated by ; or line ends until the end of the input or one of the
+            reserved words that close the list.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+            2.) NULL terminated array of the reserved words that end the list
+    Returns:
+            Returns a NODE_LIST node, or NULL on error or if the list is empty.
+*/
+struct ScriptNode *parseList(struct ScriptParser *parser, const char **stops)
+{
+    struct ScriptNode *list = newNode(parser, NODE_LIST);
+    struct ScriptNode **tail = &list->first;
+    while (1)
+    {
+        while (parser->pos < parser->count && parser->tokens[parser->pos].type == TOKEN_SEMI)
+        {
+            parser->pos++;
+        }
+        if (parser->pos >= parser->count)
+        {
+            break;
+        }
+        int stop = 0;
+        for (int i = 0; stops[i] != NULL; i++)
+        {
+            stop |= isKeyword(&parser->tokens[parser->pos], stops[i]);
+        }
+        if (stop)
+        {
+            break;
+        }
+
+        struct ScriptNode *node = parseCommand(parser);
+        if (node == NULL)
+        {
+            return NULL;
+        }
+        *tail = node;
+        tail = &node->next;
+    }
+    return list->first != NULL ? list : parseError(parser);
+}
+
+/*  parseIf()
+    Functionality:
+            This function parses the rest of an if or elif after the reserved word. An elif becomes a nested if
+            in the else part, and the innermost one consumes the fi.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+    Returns:
+            Returns the NODE_IF node, or NULL on error.
+*/
+struct ScriptNode *parseIf(struct ScriptParser *parser)
+{
+    static const char *condition_stops[] = {"then", NULL};
+    static const char *body_stops[] = {"elif", "else", "fi", NULL};
+    static const char *else_stops[] = {"fi", NULL};
+
+    struct ScriptNode *node = newNode(parser, NODE_IF);
+    if ((node->first = parseList(parser, condition_stops)) == NULL || !expectKeyword(parser, "then") ||
+        (node->second = parseList(parser, body_stops)) == NULL)
+    {
+        return NULL;
+    }
+    if (parser->pos < parser->count && isKeyword(&parser->tokens[parser->pos], "elif"))
+    {
+        parser->pos++;
+        node->third = parseIf(parser);
+        return node->third != NULL ? node : NULL;
+    }
+    if (parser->pos < parser->count && isKeyword(&parser->tokens[parser->pos], "else"))
+    {
+        parser->pos++;
+        if ((node->third = parseList(parser, else_stops)) == NULL)
+        {
+            return NULL;
+        }
+    }
+    return expectKeyword(parser, "fi") ? node : NULL;
+}
+
+/*  parseLoop()
+    Functionality:
+            This function parses a for, while or until loop after the reserved word.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+            2.) NODE_FOR or NODE_WHILE
+            3.) 1 for until, otherwise 0
+    Returns:
+            Returns the node, or NULL on error.
+*/
+struct ScriptNode *parseLoop(struct ScriptParser *parser, int type, int until)
+{
+    static const char *condition_stops[] = {"do", NULL};
+    static const char *body_stops[] = {"done", NULL};
+
+    struct ScriptNode *node = newNode(parser, type);
+    node->until = until;
+    if (type == NODE_FOR)
+    {
+        struct Token *name = parser->pos < parser->count ? &parser->tokens[parser->pos] : NULL;
+        if (name == NULL || name->type != TOKEN_WORD ||
+            variableNameLength(name->text, strlen(name->text)) != strlen(name->text) || name->text[0] == '\0')
+        {
+            return parseError(parser);
+        }
+        node->name = name->text;
+        parser->pos++;
+
+        // "for x; do" and "for x do" loop over $@, count -1 marks it
+        node->words.count = -1;
+        if (parser->pos < parser->count && isKeyword(&parser->tokens[parser->pos], "in"))
+        {
+            parser->pos++;
+            node->words.tokens = parser->tokens + parser->pos;
+            node->words.count = 0;
+            while (parser->pos < parser->count && parser->tokens[parser->pos].type == TOKEN_WORD)
+            {
+                node->words.count++;
+                parser->pos++;
+            }
+        }
+        if (parser->pos < parser->count && parser->tokens[parser->pos].type == TOKEN_SEMI)
+        {
+            parser->pos++;
+        }
+    }
+    else if ((node->first = parseList(parser, condition_stops)) == NULL)
+    {
+        return NULL;
+    }
+
+    if (!expectKeyword(parser, "do"))
+    {
+        return NULL;
+    }
+    struct ScriptNode *body = parseList(parser, body_stops);
+    if (body == NULL || !expectKeyword(parser, "done"))
+    {
+        return NULL;
+    }
+    if (type == NODE_FOR)
+    {
+        node->first = body;
+    }
+    else
+    {
+        node->second = body;
+    }
+    return node;
+}
+
+/*  parseFunction()
+    Functionality:
+            This function parses a function definition, "NAME() { LIST; }" or "function NAME [()] { LIST; }".
+    Parameters:
+            1.) Pointer to ScriptParser struct
+    Returns:
+            Returns the NODE_FUNCTION node, or NULL on error.
+*/
+struct ScriptNode *parseFunction(struct ScriptParser *parser)
+{
+    static const char *body_stops[] = {"}", NULL};
+
+    struct ScriptNode *node = newNode(parser, NODE_FUNCTION);
+    if (isKeyword(&parser->tokens[parser->pos], "function"))
+    {
+        parser->pos++;
+        if (parser->pos >= parser->count || parser->tokens[parser->pos].type != TOKEN_WORD)
+        {
+            return parseError(parser);
+        }
+    }
+
+    // Drop the () written after the name
+    char *name = parser->tokens[parser->pos++].text;
+    size_t length = strlen(name);
+    if (length > 2 && strcmp(name + length - 2, "()") == 0)
+    {
+        length -= 2;
+    }
+    else if (parser->pos < parser->count && isKeyword(&parser->tokens[parser->pos], "()"))
+    {
+        parser->pos++;
+    }
+    if (length == 0 || variableNameLength(name, length) != length)
+    {
+        parser->pos--;
+        return parseError(parser);
+    }
+    node->name = arenaAlloc(&parser->source->arena, length + 1);
+    memcpy(node->name, name, length);
+
+    if (!expectKeyword(parser, "{") || (node->first = parseList(parser, body_stops)) == NULL ||
+        !expectKeyword(parser, "}"))
+    {
+        return NULL;
+    }
+    return node;
+}
+
+/*  parseCommand()
+    Functionality:
+            This function parses one command: a compound command, a function definition, break/continue/return,
+            or a simple command (a pipeline with its redirections and &) that runs up to the next ; or line end.
+            Every redirection of a simple command has to be followed by its file.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+    Returns:
+            Returns the node, or NULL on error.
+*/
+struct ScriptNode *parseCommand(struct ScriptParser *parser)
+{
+    static const char *brace_stops[] = {"}", NULL};
+    static const char *misplaced[] = {"then", "elif", "else", "fi", "do", "done", "}", "in", NULL};
+
+    struct Token *token = &parser->tokens[parser->pos];
+    struct ScriptNode *node = NULL;
+    for (int i = 0; misplaced[i] != NULL; i++)
+    {
+        if (isKeyword(token, misplaced[i]))
+        {
+            return parseError(parser);
+        }
+    }
+
+    if (isKeyword(token, "if"))
+    {
+        parser->pos++;
+        node = parseIf(parser);
+    }
+    else if (isKeyword(token, "for") || isKeyword(token, "while") || isKeyword(token, "until"))
+    {
+        parser->pos++;
+        node = parseLoop(parser, isKeyword(token, "for") ? NODE_FOR : NODE_WHILE, isKeyword(token, "until"));
+    }
+    else if (isKeyword(token, "{"))
+    {
+        parser->pos++;
+        node = parseList(parser, brace_stops);
+        if (node != NULL && !expectKeyword(parser, "}"))
+        {
+            node = NULL;
+        }
+    }
+    else if (isFunctionHeader(parser->tokens, parser->count, parser->pos))
+    {
+        node = parseFunction(parser);
+    }
+    else
+    {
+        // Simple command, break, continue or return
+        int start = parser->pos;
+        // A & ends the command like a ; and stays with it
+        while (parser->pos < parser->count && parser->tokens[parser->pos].type != TOKEN_SEMI &&
+               parser->tokens[parser->pos++].type != TOKEN_BACKGROUND)
+            ;
+        int type = isKeyword(token, "break") ? NODE_BREAK : isKeyword(token, "continue") ? NODE_CONTINUE :
+                   isKeyword(token, "return") ? NODE_RETURN : NODE_COMMAND;
+        node = newNode(parser, type);
+        node->words.tokens = parser->tokens + start + (type != NODE_COMMAND);
+        node->words.count = parser->pos - start - (type != NODE_COMMAND);
+        for (int i = 0; i < node->words.count; i++)
+        {
+            struct Token *word = &node->words.tokens[i];
+            node->words.dynamic |= word->type == TOKEN_WORD && memchr(word->source, '$', word->source_length) != NULL;
+            // A redirection without its file is an error of the whole program, found before any of it runs
+            if (word->type != TOKEN_WORD && word->type != TOKEN_BACKGROUND && word->type != TOKEN_PIPE &&
+                word->type != TOKEN_ERROR_TO_OUTPUT && word->type != TOKEN_OUTPUT_TO_ERROR &&
+                (i + 1 >= node->words.count || word[1].type != TOKEN_WORD))
+            {
+                parser->pos = word + 1 - parser->tokens;
+                return parseError(parser);
+            }
+        }
+        if (type == NODE_BREAK || type == NODE_CONTINUE)
+        {
+            node->levels = node->words.count > 0 ? atoi(node->words.tokens[0].text) : 1;
+            if (node->levels < 1)
+            {
+                parser->pos = start + 1;
+                return parseError(parser);
+            }
+        }
+        return node;
+    }
+
+    // A compound command has to be followed by ; or a line end
+    if (node != NULL && parser->pos < parser->count && parser->tokens[parser->pos].type != TOKEN_SEMI)
+    {
+        return parseError(parser);
+    }
+    return node;
+}
+
+/*  emit()
+    Functionality:
+            This function appends an instruction to a program.
+    Parameters:
+            1.) Pointer to Program struct
+            2.) op code
+            3.) jump target or status
+            4.) operand
+    Returns:
+            Returns the index of the instruction.
+*/
+int emit(struct Program *program, int op, int target, void *operand)
+{
+    if (program->length == program->capacity)
+    {
+        program->capacity = program->capacity == 0 ? 16 : program->capacity * 2;
+        program->code = realloc(program->code, program->capacity * sizeof(struct Instruction));
+    }
+    struct Instruction *instruction = &program->code[program->length];
+    instruction->op = op;
+    instruction->target = target;
+    instruction->frames = 0;
+    instruction->operand = operand;
+    return program->length++;
+}
+
+struct Program *lowerProgram(struct ScriptNode *node, struct ScriptSource *source);
+
+/*  lowerNode()
+    Functionality:
+            This function lowers a tree node to instructions. if becomes conditional jumps around its parts, a
+            while loop jumps back to its condition, and a for loop pushes a frame with its words (OP_FOR) and
+            takes the next one on every round (OP_NEXT). break and continue know statically how many for loop
+            frames they leave, so they become a single OP_BREAK.
+    Parameters:
+            1.) Pointer to Program struct
+            2.) Pointer to ScriptNode struct
+            3.) Pointer to LoopContext struct of the innermost loop, or NULL
+            4.) number of for loops open around the node
+    Returns:
+            Does not return anything.
+*/
+void lowerNode(struct Program *program, struct ScriptNode *node, struct LoopContext *loop, int frames)
+{
+    switch (node->type)
+    {
+    case NODE_LIST:
+        for (struct ScriptNode *child = node->first; child != NULL; child = child->next)
+        {
+            lowerNode(program, child, loop, frames);
+        }
+        break;
+
+    case NODE_COMMAND:
+        emit(program, OP_RUN, 0, &node->words);
+        break;
+
+    case NODE_IF:
+    {
+        lowerNode(program, node->first, loop, frames);
+        int skip = emit(program, OP_JUMP_FALSE, 0, NULL);
+        lowerNode(program, node->second, loop, frames);
+        int end = emit(program, OP_JUMP, 0, NULL);
+        program->code[skip].target = program->length;
+        if (node->third != NULL)
+        {
+            lowerNode(program, node->third, loop, frames);
+        }
+        else
+        {
+            // No branch ran, the status is 0
+            emit(program, OP_STATUS, 0, NULL);
+        }
+        program->code[end].target = program->length;
+        break;
+    }
+
+    case NODE_WHILE:
+    case NODE_FOR:
+    {
+        struct LoopContext context = {0};
+        context.frames_before = frames;
+        context.is_for = node->type == NODE_FOR;
+        context.outer = loop;
+        context.breaks = malloc(sizeof(int));
+        int exit_jump;
+        if (context.is_for)
+        {
+            emit(program, OP_FOR, 0, &node->words);
+            frames++;
+            if (frames > program->loops)
+            {
+                program->loops = frames;
+            }
+            context.top = exit_jump = emit(program, OP_NEXT, 0, node->name);
+            lowerNode(program, node->first, &context, frames);
+        }
+        else
+        {
+            context.top = program->length;
+            lowerNode(program, node->first, loop, frames);
+            exit_jump = emit(program, node->until ? OP_JUMP_TRUE : OP_JUMP_FALSE, 0, NULL);
+            lowerNode(program, node->second, &context, frames);
+        }
+        emit(program, OP_JUMP, context.top, NULL);
+        program->code[exit_jump].target = program->length;
+        for (int i = 0; i < context.break_count; i++)
+        {
+            program->code[context.breaks[i]].target = program->length;
+        }
+        free(context.breaks);
+        if (!context.is_for)
+        {
+            emit(program, OP_STATUS, 0, NULL);
+        }
+        break;
+    }
+
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+    {
+        // Outside of a loop break and continue do nothing
+        struct LoopContext *target = loop;
+        for (int i = 1; i < node->levels && target != NULL && target->outer != NULL; i++)
+        {
+            target = target->outer;
+        }
+        if (target == NULL)
+        {
+            break;
+        }
+        int instruction = emit(program, OP_BREAK, target->top, NULL);
+        program->code[instruction].frames = frames - target->frames_before;
+        if (node->type == NODE_CONTINUE)
+        {
+            program->code[instruction].frames -= target->is_for;
+        }
+        else
+        {
+            target->breaks = realloc(target->breaks, (target->break_count + 1) * sizeof(int));
+            target->breaks[target->break_count++] = instruction;
+        }
+        break;
+    }
+
+    case NODE_RETURN:
+        emit(program, OP_RETURN, 0, &node->words);
+        break;
+
+    case NODE_FUNCTION:
+    {
+        struct FunctionDefinition *definition = arenaAlloc(&program->source->arena, sizeof(struct FunctionDefinition));
+        definition->name = node->name;
+        definition->body = lowerProgram(node->first, program->source);
+        emit(program, OP_DEFINE, 0, definition);
+        break;
+    }
+    }
+}
+
+/*  lowerProgram()
+    Functionality:
+            This function lowers a tree to a new program that shares the arena of the source.
+    Parameters:
+            1.) Pointer to the root ScriptNode struct
+            2.) Pointer to ScriptSource struct
+    Returns:
+            Returns the program, with one reference.
+*/
+struct Program *lowerProgram(struct ScriptNode *node, struct ScriptSource *source)
+{
+    struct Program *program = calloc(1, sizeof(struct Program));
+    program->refs = 1;
+    program->source = source;
+    source->refs++;
+    lowerNode(program, node, NULL, 0);
+    return program;
+}
+
+/*  releaseProgram()
+    Functionality:
+            This function drops a reference to a program. The last reference frees the instructions and the
+            functions compiled with it, and the arena once no program uses it any more.
+    Parameters:
+            1.) Pointer to Program struct
+    Returns:
+            Does not return anything.
+*/
+void releaseProgram(struct Program *program)
+{
+    if (--program->refs > 0)
+    {
+        return;
+    }
+    for (int i = 0; i < program->length; i++)
+    {
+        if (program->code[i].op == OP_DEFINE)
+        {
+            releaseProgram(((struct FunctionDefinition *)program->code[i].operand)->body);
+        }
+    }
+    free(program->code);
+
+    struct ScriptSource *source = program->source;
+    free(program);
+    if (--source->refs == 0)
+    {
+        arenaReset(&source->arena);
+        free(source->arena.head);
+        free(source);
+    }
+}
+
+/*  addScriptToken()
+    Functionality:
+            This function appends a token to the parser, copying its text into the arena of the program.
+    Parameters:
+            1.) Pointer to ScriptParser struct
+            2.) Pointer to Token struct, whose source already points into the arena
+    Returns:
+            Does not return anything.
+*/
+void addScriptToken(struct ScriptParser *parser, struct Token *token)
+{
+    if (parser->count == parser->capacity)
+    {
+        parser->capacity = parser->capacity == 0 ? 64 : parser->capacity * 2;
+        parser->tokens = realloc(parser->tokens, parser->capacity * sizeof(struct Token));
+    }
+    struct Token *copy = &parser->tokens[parser->count++];
+    *copy = *token;
+    if (token->text != NULL)
+    {
+        copy->text = arenaStrdup(&parser->source->arena, token->text);
+    }
+    if (token->pattern != NULL)
+    {
+        copy->pattern = arenaStrdup(&parser->source->arena, token->pattern);
+    }
+}
+
+/*  compileProgram()
+    Functionality:
+            This function reads lines until every construct is closed, then parses and lowers them. Interactive
+            input shows a "> " prompt for every extra line.
+    Parameters:
+            1.) first line
+            2.) length of the line
+            3.) process ID of the shell as a string
+    Returns:
+            Returns the program, or NULL after a syntax error, which has been printed.
+*/
+struct Program *compileProgram(const char *line, size_t length, const char *process_id)
+{
+    struct ScriptSource *source = calloc(1, sizeof(struct ScriptSource));
+    struct ScriptParser parser = {0};
+    parser.source = source;
+    const char *error = NULL;
+
+    while (1)
+    {
+        // The tokens keep pointing into this copy of the line, it lives as long as the program
+        char *copy = arenaAlloc(&source->arena, length + 1);
+        memcpy(copy, line, length);
+        struct Token *tokens;
+        int count = tokenizeLine(copy, length, process_id, &tokens);
+        if (count < 0)
+        {
+            error = count == -1 ? "unterminated quote" : "bad file descriptor";
+            break;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            addScriptToken(&parser, &tokens[i]);
+        }
+        struct Token end = {TOKEN_SEMI, NULL, NULL, NULL, 0};
+        addScriptToken(&parser, &end);
+
+        if (scriptDepth(parser.tokens, parser.count) <= 0)
+        {
+            break;
+        }
+        if (batchMode == 0)
+        {
+            printf("> ");
+            fflush(stdout);
+        }
+        line = readLine(&shellInput, &length);
+        if (line == NULL)
+        {
+            error = "unexpected end of file";
+            break;
+        }
+    }
+
+    // The word lists of the program point into the tokens, move them into the arena
+    struct Token *tokens = arenaAlloc(&source->arena, parser.count * sizeof(struct Token) + 1);
+    memcpy(tokens, parser.tokens, parser.count * sizeof(struct Token));
+    free(parser.tokens);
+    parser.tokens = tokens;
+
+    struct Program *program = NULL;
+    if (error == NULL)
+    {
+        static const char *no_stops[] = {NULL};
+        struct ScriptNode *tree = parseList(&parser, no_stops);
+        if (tree != NULL && parser.pos == parser.count)
+        {
+            program = lowerProgram(tree, source);
+        }
+        else if (parser.error != NULL)
+        {
+            printf("syntax error near unexpected token '%s'\n", parser.error);
+        }
+    }
+    else
+    {
+        printf("syntax error: %s\n", error);
+    }
+    flushOutput();
+
+    if (program == NULL)
+    {
+        arenaReset(&source->arena);
+        free(source->arena.head);
+        free(source);
+    }
+    return program;
+}
+
+/*  expandWord()
+    Functionality:
+            This function gives a token its text and glob pattern for this run. Words with a $ are tokenized
+            again from their source, every other word is used as it was compiled.
+    Parameters:
+            1.) Pointer to Token struct, updated in place
+            2.) process ID of the shell as a string
+    Returns:
+            Does not return anything.
+*/
+void expandWord(struct Token *token, const char *process_id)
+{
+    if (token->type != TOKEN_WORD || memchr(token->source, '$', token->source_length) == NULL)
+    {
+        return;
+    }
+    struct Token *expanded;
+    if (tokenizeLine(token->source, token->source_length, process_id, &expanded) >= 1)
+    {
+        token->text = expanded[0].text;
+        token->pattern = expanded[0].pattern;
+    }
+}
+
+/*  expandWords()
+    Functionality:
+            This function expands the words of a for loop into a frame, including their glob matches. The words
+            are copied, because the arena of the line is rewound by the commands of the loop body.
+    Parameters:
+            1.) Pointer to WordList struct, or a count of -1 for $@
+            2.) Pointer to LoopFrame struct
+            3.) process ID of the shell as a string
+    Returns:
+            Does not return anything.
+*/
+void expandWords(struct WordList *list, struct LoopFrame *frame, const char *process_id)
+{
+    frame->words = NULL;
+    frame->count = 0;
+    frame->index = 0;
+    if (list->count == -1)
+    {
+        frame->words = malloc((positionalCount + 1) * sizeof(char *));
+        for (int i = 1; i < positionalCount; i++)
+        {
+            frame->words[frame->count++] = strdup(positionalArgs[i]);
+        }
+        return;
+    }
+
+    struct ArenaMark mark = arenaMark(&lineArena);
+    resetGlobCache();
+    int capacity = list->count + 1;
+    frame->words = malloc(capacity * sizeof(char *));
+    for (int i = 0; i < list->count; i++)
+    {
+        struct Token token = list->tokens[i];
+        expandWord(&token, process_id);
+        int matched = 0;
+        char **matches = token.pattern != NULL ? expandGlob(token.pattern, &matched) : NULL;
+        if (matched == 0)
+        {
+            matches = &token.text;
+            matched = 1;
+        }
+        if (frame->count + matched + list->count - i > capacity)
+        {
+            capacity = 2 * (frame->count + matched + list->count - i);
+            frame->words = realloc(frame->words, capacity * sizeof(char *));
+        }
+        for (int j = 0; j < matched; j++)
+        {
+            frame->words[frame->count++] = strdup(matches[j]);
+        }
+    }
+    arenaRewind(&lineArena, mark);
+}
+
+/*  runWords()
+    Functionality:
+            This function runs one compiled command. The tokens are turned into Command structs by the same code
+            as a typed line, and everything allocated for the command is handed back once it has run.
+    Parameters:
+            1.) Pointer to WordList struct
+            2.) process ID of the shell as a string
+    Returns:
+            Does not return anything. The exit status is left in $?.
+*/
+void runWords(struct WordList *list, const char *process_id)
+{
+    struct ArenaMark mark = arenaMark(&lineArena);
+    resetGlobCache();
+    clock_gettime(CLOCK_MONOTONIC, &lineStart);
+
+    struct Token *tokens = list->tokens;
+    if (list->dynamic)
+    {
+        tokens = arenaAlloc(&lineArena, list->count * sizeof(struct Token));
+        memcpy(tokens, list->tokens, list->count * sizeof(struct Token));
+        for (int i = 0; i < list->count; i++)
+        {
+            expandWord(&tokens[i], process_id);
+        }
+    }
+
+    struct Command *p = parseTokens(tokens, list->count);
+    if (p->cmd_args[0] != NULL)
+    {
+        // Background jobs show their command line in the job table
+        if (p->background)
+        {
+            size_t length = 0;
+            for (int i = 0; i < list->count; i++)
+            {
+                length += list->tokens[i].type == TOKEN_WORD ? list->tokens[i].source_length + 1 : 5;
+            }
+            char *line = p->line = arenaAlloc(&lineArena, length + 1);
+            for (int i = 0; i < list->count; i++)
+            {
+                struct Token *token = &list->tokens[i];
+                const char *text = token->type == TOKEN_WORD ? token->source : tokenNames[token->type];
+                size_t text_length = token->type == TOKEN_WORD ? token->source_length : strlen(text);
+                memcpy(line, text, text_length);
+                line += text_length;
+                *line++ = ' ';
+            }
+            line[-1] = '\0';
+        }
+        runCommand(p, process_id);
+    }
+    arenaRewind(&lineArena, mark);
+
+    if (runningJobs > 0)
+    {
+        reapJobs();
+    }
+}
+
+/*  findFunction()
+    Functionality:
+            This function looks up a shell function by name.
+    Parameters:
+            1.) name
+    Returns:
+            Returns the FunctionDefinition struct, or NULL if there is no function with that name.
+*/
+struct FunctionDefinition *findFunction(const char *name)
+{
+    if (functionsUsed == 0)
+    {
+        return NULL;
+    }
+    size_t slot = hashName(name) & (functionSlots - 1);
+    while (functionTable[slot] != NULL)
+    {
+        if (strcmp(functionTable[slot]->name, name) == 0)
+        {
+            return functionTable[slot];
+        }
+        slot = (slot + 1) & (functionSlots - 1);
+    }
+    return NULL;
+}
+
+/*  defineFunction()
+    Functionality:
+            This function adds a function to the table, or replaces the body of an existing one. The table is
+            doubled once it is half full.
+    Parameters:
+            1.) Pointer to FunctionDefinition struct of the OP_DEFINE instruction
+    Returns:
+            Does not return anything.
+*/
+void defineFunction(struct FunctionDefinition *definition)
+{
+    struct FunctionDefinition *function = findFunction(definition->name);
+    definition->body->refs++;
+    if (function != NULL)
+    {
+        releaseProgram(function->body);
+        function->body = definition->body;
+        return;
+    }
+
+    if ((functionsUsed + 1) * 2 > functionSlots)
+    {
+        struct FunctionDefinition **old = functionTable;
+        size_t old_slots = functionSlots;
+        functionSlots = old_slots == 0 ? FUNCTION_SLOTS : old_slots * 2;
+        functionTable = calloc(functionSlots, sizeof(struct FunctionDefinition *));
+        for (size_t i = 0; i < old_slots; i++)
+        {
+            if (old[i] != NULL)
+            {
+                size_t slot = hashName(old[i]->name) & (functionSlots - 1);
+                while (functionTable[slot] != NULL)
+                {
+                    slot = (slot + 1) & (functionSlots - 1);
+                }
+                functionTable[slot] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    function = malloc(sizeof(struct FunctionDefinition));
+    function->name = strdup(definition->name);
+    function->body = definition->body;
+    size_t slot = hashName(function->name) & (functionSlots - 1);
+    while (functionTable[slot] != NULL)
+    {
+        slot = (slot + 1) & (functionSlots - 1);
+    }
+    functionTable[slot] = function;
+    functionsUsed++;
+}
+
+/*  joinArguments()
+    Functionality:
+            This function joins the arguments of a function call with spaces for $@ and $*.
+    Parameters:
+            1.) argument vector, index 0 is the function name
+    Returns:
+            Returns the joined string, which the caller frees.
+*/
+char *joinArguments(char **args)
+{
+    size_t length = 1;
+    for (int i = 1; args[i] != NULL; i++)
+    {
+        length += strlen(args[i]) + 1;
+    }
+    char *joined = malloc(length);
+    char *out = joined;
+    for (int i = 1; args[i] != NULL; i++)
+    {
+        size_t word = strlen(args[i]);
+        memcpy(out, args[i], word);
+        out += word;
+        *out++ = ' ';
+    }
+    *(out > joined ? out - 1 : out) = '\0';
+    return joined;
+}
+
+/*  callFunction()
+    Functionality:
+            This function runs a shell function with the arguments of a command as $1, $2, ... Redirections of
+            the call apply to the whole body, like for a built in.
+    Parameters:
+            1.) Pointer to FunctionDefinition struct
+            2.) Pointer to Command struct of the call
+            3.) process ID of the shell as a string
+    Returns:
+            Does not return anything. The exit status is left in $?.
+*/
+void callFunction(struct FunctionDefinition *function, struct Command *p, const char *process_id)
+{
+    if (callDepth >= FUNCTION_DEPTH_LIMIT)
+    {
+        printf("%s: maximum function nesting level exceeded (%d)\n", function->name, FUNCTION_DEPTH_LIMIT);
+        flushOutput();
+        *exitStatusVariable = 1 << 8;
+        return;
+    }
+    int saved[3] = {-1, -1, -1};
+    if (redirectBuiltin(p, saved) == -1)
+    {
+        *exitStatusVariable = 1 << 8;
+        return;
+    }
+
+    char **saved_args = positionalArgs;
+    int saved_count = positionalCount;
+    char *saved_joined = positionalJoined;
+    positionalArgs = p->cmd_args;
+    positionalCount = 0;
+    while (p->cmd_args[positionalCount] != NULL)
+    {
+        positionalCount++;
+    }
+    positionalJoined = joinArguments(p->cmd_args);
+
+    callDepth++;
+    runProgram(function->body, process_id);
+    callDepth--;
+
+    free(positionalJoined);
+    positionalArgs = saved_args;
+    positionalCount = saved_count;
+    positionalJoined = saved_joined;
+    restoreStreams(saved);
+}
+
+/*  runProgram()
+    Functionality:
+            This function runs the instructions of a program. The frames of the for loops that are running are
+            kept on a stack sized when the program was compiled.
+    Parameters:
+            1.) Pointer to Program struct
+            2.) process ID of the shell as a string
+    Returns:
+            Returns the exit status of the program, which is also left in $?.
+*/
+int runProgram(struct Program *program, const char *process_id)
+{
+    // A function may be redefined while it runs
+    program->refs++;
+    struct LoopFrame *frames = malloc((program->loops + 1) * sizeof(struct LoopFrame));
+    int depth = 0;
+    int pc = 0;
+
+    while (pc < program->length)
+    {
+        struct Instruction *instruction = &program->code[pc++];
+        switch (instruction->op)
+        {
+        case OP_RUN:
+            runWords(instruction->operand, process_id);
+            break;
+
+        case OP_JUMP:
+            pc = instruction->target;
+            break;
+
+        case OP_JUMP_FALSE:
+            if (*exitStatusVariable != 0)
+            {
+                pc = instruction->target;
+            }
+            break;
+
+        case OP_JUMP_TRUE:
+            if (*exitStatusVariable == 0)
+            {
+                pc = instruction->target;
+            }
+            break;
+
+        case OP_FOR:
+            expandWords(instruction->operand, &frames[depth++], process_id);
+            *exitStatusVariable = 0;
+            break;
+
+        case OP_NEXT:
+        {
+            struct LoopFrame *frame = &frames[depth - 1];
+            if (frame->index < frame->count)
+            {
+                setVariable(instruction->operand, frame->words[frame->index++], 0);
+                break;
+            }
+            pc = instruction->target;
+        }
+            // fall through, the loop is over and its frame is dropped
+        case OP_BREAK:
+        {
+            int drop = instruction->op == OP_NEXT ? 1 : instruction->frames;
+            for (int i = 0; i < drop; i++)
+            {
+                struct LoopFrame *frame = &frames[--depth];
+                for (int j = 0; j < frame->count; j++)
+                {
+                    free(frame->words[j]);
+                }
+                free(frame->words);
+            }
+            pc = instruction->target;
+            break;
+        }
+
+        case OP_STATUS:
+            *exitStatusVariable = instruction->target << 8;
+            break;
+
+        case OP_DEFINE:
+            defineFunction(instruction->operand);
+            *exitStatusVariable = 0;
+            break;
+
+        case OP_RETURN:
+        {
+            struct WordList *list = instruction->operand;
+            if (list->count > 0)
+            {
+                struct ArenaMark mark = arenaMark(&lineArena);
+                struct Token token = list->tokens[0];
+                expandWord(&token, process_id);
+                *exitStatusVariable = (atoi(token.text) & 0xff) << 8;
+                arenaRewind(&lineArena, mark);
+            }
+            pc = program->length;
+            break;
+        }
+        }
+    }
+
+    // return leaves the loops it is in
+    while (depth > 0)
+    {
+        struct LoopFrame *frame = &frames[--depth];
+        for (int j = 0; j < frame->count; j++)
+        {
+            free(frame->words[j]);
+        }
+        free(frame->words);
+    }
+    free(frames);
+    releaseProgram(program);
+    return *exitStatusVariable;
+}
+
+#endif
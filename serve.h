@@ -0,0 +1,544 @@
+/*
+    This file contains the server mode of the shell. "smallsh --serve PATH" initializes the shell once and
+    then listens on a Unix socket, so a task costs one request instead of starting a new shell. Every client
+    that connects gets a session: a worker forked from the initialized server, which keeps the cwd,
+    variables, functions and jobs of that client for as long as it stays connected. The server itself runs
+    one epoll loop over the listening socket, the clients and the workers, and passes requests and replies
+    between them. Since the workers are separate processes, the sessions run their commands concurrently
+    and a slow command only holds up its own client.
+
+    The socket is SOCK_SEQPACKET, so every message is one frame: a ServeFrame header followed by the payload.
+    A SERVE_RUN frame holds one or more command lines (up to SERVE_MESSAGE_SIZE bytes in all). The client
+    may attach three file descriptors with SCM_RIGHTS, which become stdin, stdout and stderr of the session,
+    otherwise the ones of the previous request are kept (/dev/null at first). Once the lines have run the
+    session replies with a SERVE_STATUS frame holding the exit code as a 32-bit int, the value $? would show.
+    A client sends its next request after the reply, requests sent earlier wait until then. The exit built in
+    ends the session and closes the connection instead of replying.
+
+    Usage:
+        smallsh --serve PATH                 run the server on the socket PATH
+        smallsh --connect PATH COMMAND       run COMMAND in a new session with the caller's stdio, and exit
+                                             with its exit code
+
+    There are nine functions in this file:
+        1.) sendFrame()
+        2.) receiveFrame()
+        3.) relayFrame()
+        4.) serveWorker()
+        5.) openSession()
+        6.) closeSession()
+        7.) listenSocket()
+        8.) serveShell()
+        9.) connectShell()
+*/
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "input_reader.h"
+#include "helper_functions.h"
+#include "job_table.h"
+#include "variables.h"
+
+#define SERVE_RUN 1
+#define SERVE_STATUS 2
+
+// Largest frame, kept below the default socket buffer so that a frame is always accepted whole
+#define SERVE_MESSAGE_SIZE 65536
+
+// epoll tags of the listening socket and the SIGCHLD self-pipe, sessions use (index << 1 | is_worker)
+#define SERVE_LISTENER UINT64_MAX
+#define SERVE_CHILDREN (UINT64_MAX - 1)
+
+#define SERVE_EVENTS 64
+
+/*
+    Data Members:
+        type: (uint32_t) ->     SERVE_RUN or SERVE_STATUS
+        length: (uint32_t) ->   number of payload bytes after the header
+*/
+struct ServeFrame
+{
+    uint32_t type;
+    uint32_t length;
+};
+
+/*
+    Data Members:
+        client: (int) ->        socket of the client
+        worker: (int) ->        server end of the socketpair to the worker
+        pid: (pid_t) ->         process ID of the worker
+*/
+struct ServeSession
+{
+    int client;
+    int worker;
+    pid_t pid;
+};
+
+struct ServeSession **serveSessions = NULL;
+int serveSlots = 0;
+
+// Defined in main.c
+void runInput(char *process_id);
+
+/*  sendFrame()
+    Functionality:
+            This function sends one message, with up to three file descriptors attached as SCM_RIGHTS.
+    Parameters:
+            1.) socket
+            2.) message
+            3.) length of the message
+            4.) array of file descriptors, or NULL
+            5.) number of file descriptors
+    Returns:
+            Returns 0, or -1 if the message could not be sent.
+*/
+int sendFrame(int sock, const void *data, size_t length, int *fds, int fd_count)
+{
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {(void *)data, length};
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (fd_count > 0)
+    {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(fd_count * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fd_count * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, fd_count * sizeof(int));
+    }
+
+    ssize_t sent;
+    while ((sent = sendmsg(sock, &message, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+        ;
+    return sent == (ssize_t)length ? 0 : -1;
+}
+
+/*  receiveFrame()
+    Functionality:
+            This function receives one message and the file descriptors attached to it. A message longer than
+            the buffer is cut short, which the receiver notices because the length in its header does not match.
+    Parameters:
+            1.) socket
+            2.) buffer of SERVE_MESSAGE_SIZE bytes
+            3.) array of three ints that receives the file descriptors
+            4.) Pointer to the int that receives the number of file descriptors
+    Returns:
+            Returns the number of bytes received, 0 once the peer has closed the socket, or -1 on error.
+*/
+ssize_t receiveFrame(int sock, char *buffer, int *fds, int *fd_count)
+{
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = {buffer, SERVE_MESSAGE_SIZE};
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    while ((received = recvmsg(sock, &message, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+        ;
+
+    *fd_count = 0;
+    if (received <= 0)
+    {
+        return received;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            *fd_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            *fd_count = *fd_count > 3 ? 3 : *fd_count;
+            memcpy(fds, CMSG_DATA(cmsg), *fd_count * sizeof(int));
+        }
+    }
+    return received;
+}
+
+/*  relayFrame()
+    Functionality:
+            This function passes one message and its file descriptors from one socket to another. The server's
+            copies of the file descriptors are closed once they have been sent on.
+    Parameters:
+            1.) socket to receive from
+            2.) socket to send to
+            3.) buffer of SERVE_MESSAGE_SIZE bytes
+    Returns:
+            Returns 0, or -1 if the first socket was closed or either side failed.
+*/
+int relayFrame(int from, int to, char *buffer)
+{
+    int fds[3];
+    int fd_count;
+    ssize_t length = receiveFrame(from, buffer, fds, &fd_count);
+    if (length <= 0)
+    {
+        return -1;
+    }
+    int result = sendFrame(to, buffer, length, fds, fd_count);
+    for (int i = 0; i < fd_count; i++)
+    {
+        close(fds[i]);
+    }
+    return result;
+}
+
+/*  serveWorker()
+    Functionality:
+            This function is the loop of a session. It takes the stdio passed with a request, runs the command
+            lines of the request the same way the main loop runs a script, and replies with the exit code.
+    Parameters:
+            1.) worker end of the socketpair
+            2.) process ID of the shell as a string
+    Returns:
+            Does not return. The worker exits once the server closes the socket.
+*/
+void serveWorker(int sock, char *process_id)
+{
+    char *buffer = malloc(SERVE_MESSAGE_SIZE + 1);
+    // $$ is the process ID of the session
+    sprintf(process_id, "%d", getpid());
+    int null_fd = open("/dev/null", O_RDWR);
+    for (int i = 0; i < 3; i++)
+    {
+        dup2(null_fd, i);
+    }
+    close(null_fd);
+
+    while (1)
+    {
+        int fds[3];
+        int fd_count;
+        ssize_t length = receiveFrame(sock, buffer, fds, &fd_count);
+        if (length <= 0)
+        {
+            exit(0);
+        }
+
+        // Later output goes to the new stdio, everything written so far to the old one
+        fflush(stdout);
+        for (int i = 0; i < fd_count; i++)
+        {
+            if (fd_count == 3)
+            {
+                dup2(fds[i], i);
+            }
+            close(fds[i]);
+        }
+
+        struct ServeFrame *frame = (struct ServeFrame *)buffer;
+        struct
+        {
+            struct ServeFrame frame;
+            int32_t code;
+        } reply = {{SERVE_STATUS, sizeof(int32_t)}, 0};
+        if (length < (ssize_t)sizeof(struct ServeFrame) || frame->type != SERVE_RUN ||
+            frame->length != length - sizeof(struct ServeFrame))
+        {
+            fprintf(stderr, "smallsh: bad request\n");
+            reply.code = 2;
+        }
+        else
+        {
+            buffer[length] = '\0';
+            openInputString(&shellInput, buffer + sizeof(struct ServeFrame));
+            runInput(process_id);
+            fflush(stdout);
+            int status = *exitStatusVariable;
+            reply.code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+        }
+        if (sendFrame(sock, &reply, sizeof(reply), NULL, 0) == -1)
+        {
+            exit(0);
+        }
+    }
+}
+
+/*  openSession()
+    Functionality:
+            This function starts the session of a new client. The worker is forked from the server and keeps
+            only its end of the socketpair, with a job table of its own.
+    Parameters:
+            1.) socket of the client
+            2.) epoll instance of the server
+            3.) listening socket
+            4.) process ID of the shell as a string
+    Returns:
+            Returns 0, or -1 if the session could not be started. The client socket is closed on error.
+*/
+int openSession(int client, int epoll_fd, int listener, char *process_id)
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1)
+    {
+        perror("serve socketpair()");
+        close(client);
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("serve fork()");
+        close(client);
+        close(sockets[0]);
+        close(sockets[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // The worker keeps nothing of the server or of the other sessions
+        close(epoll_fd);
+        close(listener);
+        close(client);
+        close(sockets[0]);
+        for (int i = 0; i < serveSlots; i++)
+        {
+            if (serveSessions[i] != NULL)
+            {
+                close(serveSessions[i]->client);
+                close(serveSessions[i]->worker);
+            }
+        }
+        close(childPipe[0]);
+        close(childPipe[1]);
+        initJobTable();
+        serveWorker(sockets[1], process_id);
+    }
+    close(sockets[1]);
+
+    int index = 0;
+    while (index < serveSlots && serveSessions[index] != NULL)
+    {
+        index++;
+    }
+    if (index == serveSlots)
+    {
+        serveSlots = serveSlots == 0 ? 16 : serveSlots * 2;
+        serveSessions = realloc(serveSessions, serveSlots * sizeof(struct ServeSession *));
+        memset(serveSessions + index, 0, (serveSlots - index) * sizeof(struct ServeSession *));
+    }
+    struct ServeSession *session = malloc(sizeof(struct ServeSession));
+    session->client = client;
+    session->worker = sockets[0];
+    session->pid = pid;
+    serveSessions[index] = session;
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = (uint64_t)index << 1;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &event);
+    event.data.u64 = (uint64_t)index << 1 | 1;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockets[0], &event);
+    return 0;
+}
+
+/*  closeSession()
+    Functionality:
+            This function ends a session. Closing the socketpair makes the worker exit, it is reaped once its
+            SIGCHLD arrives.
+    Parameters:
+            1.) index of the session
+    Returns:
+            Does not return anything.
+*/
+void closeSession(int index)
+{
+    struct ServeSession *session = serveSessions[index];
+    close(session->client);
+    close(session->worker);
+    free(session);
+    serveSessions[index] = NULL;
+}
+
+/*  listenSocket()
+    Functionality:
+            This function creates the listening socket. A socket file left behind by an earlier server is
+            removed first, any other file at the path is an error.
+    Parameters:
+            1.) path of the socket
+    Returns:
+            Returns the non-blocking listening socket, or -1 on error.
+*/
+int listenSocket(const char *path)
+{
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        unlink(path);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listener == -1 || bind(listener, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(listener, SOMAXCONN) == -1)
+    {
+        perror(path);
+        if (listener != -1)
+        {
+            close(listener);
+        }
+        return -1;
+    }
+    return listener;
+}
+
+/*  serveShell()
+    Functionality:
+            This function is the server loop. New clients get a session, a request from a client is passed
+            to its worker and the client is not read again until the reply has been passed back, so a busy
+            session never blocks the loop. Workers are reaped as their SIGCHLD arrives.
+    Parameters:
+            1.) path of the socket
+            2.) process ID of the shell as a string
+    Returns:
+            Returns 1 if the server could not be started, otherwise it does not return.
+*/
+int serveShell(const char *path, char *process_id)
+{
+    int listener = listenSocket(path);
+    int epoll_fd = listener != -1 ? epoll_create1(EPOLL_CLOEXEC) : -1;
+    if (epoll_fd == -1)
+    {
+        if (listener != -1)
+        {
+            perror("epoll_create1()");
+            close(listener);
+        }
+        return 1;
+    }
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = SERVE_LISTENER;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event);
+    event.data.u64 = SERVE_CHILDREN;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, childPipe[0], &event);
+
+    char *buffer = malloc(SERVE_MESSAGE_SIZE);
+    struct epoll_event events[SERVE_EVENTS];
+    while (1)
+    {
+        int ready = epoll_wait(epoll_fd, events, SERVE_EVENTS, -1);
+        for (int i = 0; i < ready; i++)
+        {
+            uint64_t tag = events[i].data.u64;
+            if (tag == SERVE_LISTENER)
+            {
+                int client;
+                while ((client = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) != -1)
+                {
+                    openSession(client, epoll_fd, listener, process_id);
+                }
+                continue;
+            }
+            if (tag == SERVE_CHILDREN)
+            {
+                char drain[64];
+                while (read(childPipe[0], drain, sizeof(drain)) > 0)
+                    ;
+                while (waitpid(-1, NULL, WNOHANG) > 0)
+                    ;
+                continue;
+            }
+
+            // A session closed earlier in this batch may still have events
+            int index = tag >> 1;
+            struct ServeSession *session = serveSessions[index];
+            if (session == NULL)
+            {
+                continue;
+            }
+            int from_worker = tag & 1;
+            if (relayFrame(from_worker ? session->worker : session->client,
+                           from_worker ? session->client : session->worker, buffer) == -1)
+            {
+                closeSession(index);
+                continue;
+            }
+
+            // Stop reading the client until its request has been answered
+            event.events = from_worker ? EPOLLIN : 0;
+            event.data.u64 = (uint64_t)index << 1;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session->client, &event);
+        }
+    }
+}
+
+/*  connectShell()
+    Functionality:
+            This function is the client of "smallsh --connect". It sends one request with its own stdin,
+            stdout and stderr attached and waits for the exit code.
+    Parameters:
+            1.) path of the socket
+            2.) command lines to run
+    Returns:
+            Returns the exit code of the request, 0 if the session exited, or 1 if the server could not be reached.
+*/
+int connectShell(const char *path, const char *command)
+{
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    size_t length = strlen(command);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        length > SERVE_MESSAGE_SIZE - sizeof(struct ServeFrame))
+    {
+        perror(path);
+        return 1;
+    }
+
+    char *buffer = malloc(SERVE_MESSAGE_SIZE);
+    struct ServeFrame *frame = (struct ServeFrame *)buffer;
+    frame->type = SERVE_RUN;
+    frame->length = length;
+    memcpy(buffer + sizeof(struct ServeFrame), command, length);
+    int fds[3] = {0, 1, 2};
+    if (sendFrame(sock, buffer, sizeof(struct ServeFrame) + length, fds, 3) == -1)
+    {
+        perror(path);
+        return 1;
+    }
+
+    int fd_count;
+    ssize_t received = receiveFrame(sock, buffer, fds, &fd_count);
+    if (received < (ssize_t)(sizeof(struct ServeFrame) + sizeof(int32_t)) || frame->type != SERVE_STATUS)
+    {
+        return 0;
+    }
+    int32_t code;
+    memcpy(&code, buffer + sizeof(struct ServeFrame), sizeof(code));
+    return code;
+}
+
+#endif
@@ -0,0 +1,846 @@
+/*
+    This file contains the functions used to start external commands. The fast path uses posix_spawn(),
+    which glibc implements with clone(CLONE_VM|CLONE_VFORK), so the child never copies the page tables of
+    the shell. The redirections (redirect.h) and the SIGINT disposition are set up with spawn file actions and
+    attributes.
+    The fork() path is kept as a fallback, and is also used when SMALLSH_SPAWN=fork is set in the environment.
+    Command names are resolved through the PATH lookup cache in path_cache.h before either path runs.
+
+    SMALLSH_SPAWN=zygote starts a small helper process at startup, before the shell has built up any state.
+    The shell sends it each command (argv, cwd, environment) over a socketpair, with the child's stdin, stdout
+    and stderr attached as SCM_RIGHTS. The zygote forks twice and sends back the process ID; the shell is a
+    child subreaper, so the command is re-parented to the shell and is waited for like any other child.
+
+    A command whose stdout fans out to several files runs under a relay, a forked copy of the shell that
+    starts the command with its stdout on a pipe and copies the pipe into the files (fanOutRelay()). The relay
+    waits for the command and exits with its status, so the shell waits for one process as usual.
+
+    While tracing is on, the fork() and zygote paths hand the child the write end of a close-on-exec pipe and
+    wait until it is closed, so that the spawn span of every path ends once the command has been exec'd, the
+    way posix_spawn() returns.
+
+    There are twelve functions in this file:
+        1.) waitForExec()
+        2.) packStrings()
+        3.) zygoteChild()
+        4.) zygoteSpawn()
+        5.) zygoteLoop()
+        6.) startZygote()
+        7.) zygoteCommand()
+        8.) setSpawnMode()
+        9.) forkCommand()
+        10.) spawnCommand()
+        11.) fanOutCommand()
+        12.) startCommand()
+*/
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <spawn.h>
+#include <errno.h>
+#include "Command.h"
+#include "path_cache.h"
+#include "redirect.h"
+#include "trace.h"
+#include "placement.h"
+#include "variables.h"
+
+#define SPAWN_FAST 0
+#define SPAWN_FORK 1
+#define SPAWN_ZYGOTE 2
+
+// Largest request sent to the zygote, bigger commands are started with fork()
+#define ZYGOTE_MESSAGE_SIZE (256 * 1024)
+
+// Bits of ZygoteRequest.redirects, the first four say which file name strings follow
+#define ZYGOTE_INPUT 1
+#define ZYGOTE_OUTPUT 2
+#define ZYGOTE_ERROR 4
+#define ZYGOTE_HERE_STRING 8
+#define ZYGOTE_OUTPUT_APPEND 16
+#define ZYGOTE_ERROR_APPEND 32
+#define ZYGOTE_ERROR_SHIFT 6
+#define ZYGOTE_OUTPUT_SHIFT 8
+
+extern char **environ;
+
+// Which path startCommand() takes, set once at startup by setSpawnMode()
+int spawnMode = SPAWN_FAST;
+
+// Shell end of the socketpair to the zygote
+int zygoteSocket = -1;
+
+/*
+    Data Members:
+        foreground: (int) ->    1 if the command runs in the foreground, otherwise 0
+        argc: (int) ->          number of arguments
+        envc: (int) ->          number of environment strings
+        redirects: (int) ->     ZYGOTE_* bits for the redirections, error_to_output is stored from ZYGOTE_ERROR_SHIFT
+                                and output_to_error from ZYGOTE_OUTPUT_SHIFT
+    The header is followed by NUL terminated strings: cwd, path ("" for execvp()), the <, >, 2> files and the
+    here-string that are set, the arguments and the environment.
+*/
+struct ZygoteRequest
+{
+    int foreground;
+    int argc;
+    int envc;
+    int redirects;
+};
+
+/*  waitForExec()
+    Functionality:
+            This function waits until the child has closed the write end of an exec report pipe, which happens
+            when it execs the command (the end is close-on-exec) or exits, and closes the read end.
+    Parameters:
+            1.) read end of the pipe, or -1 if there is none
+    Returns:
+            Does not return anything.
+*/
+void waitForExec(int fd)
+{
+    if (fd == -1)
+    {
+        return;
+    }
+    char byte;
+    while (read(fd, &byte, 1) == -1 && errno == EINTR)
+        ;
+    close(fd);
+}
+
+/*  packStrings()
+    Functionality:
+            This function appends NUL terminated strings to a request buffer.
+    Parameters:
+            1.) request buffer
+            2.) Pointer to the number of bytes used, moved past the strings
+            3.) size of the buffer
+            4.) array of strings
+            5.) number of strings
+    Returns:
+            Returns 0, or -1 if the strings do not fit.
+*/
+int packStrings(char *buffer, size_t *used, size_t size, char **strings, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        size_t length = strlen(strings[i]) + 1;
+        if (*used + length > size)
+        {
+            return -1;
+        }
+        memcpy(buffer + *used, strings[i], length);
+        *used += length;
+    }
+    return 0;
+}
+
+/*  zygoteChild()
+    Functionality:
+            This function runs in the command process forked by the zygote. It takes over the received stdio,
+            the cwd and the environment of the shell, sets up the signals the way forkCommand() does, sets up the
+            redirections and execs the command.
+    Parameters:
+            1.) request header
+            2.) strings of the request
+            3.) received stdin, stdout and stderr
+    Returns:
+            Does not return. Exits with status 2 if the command can not be run.
+*/
+void zygoteChild(struct ZygoteRequest *request, char *strings, int *fds)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        dup2(fds[i], i);
+        if (fds[i] > 2)
+        {
+            close(fds[i]);
+        }
+    }
+
+    // Unpack cwd, path, files, arguments and environment
+    char *cwd = strings;
+    char *path = cwd + strlen(cwd) + 1;
+    char *next = path + strlen(path) + 1;
+    struct Command command = {0};
+    char **files[] = {&command.input_file, &command.output_file, &command.error_file, &command.here_string};
+    for (int i = 0; i < 4; i++)
+    {
+        if (request->redirects & (1 << i))
+        {
+            *files[i] = next;
+            next += strlen(next) + 1;
+        }
+    }
+    command.output_append = (request->redirects & ZYGOTE_OUTPUT_APPEND) != 0;
+    command.error_append = (request->redirects & ZYGOTE_ERROR_APPEND) != 0;
+    command.error_to_output = (request->redirects >> ZYGOTE_ERROR_SHIFT) & 3;
+    command.output_to_error = request->redirects >> ZYGOTE_OUTPUT_SHIFT;
+    char **argv = malloc((request->argc + request->envc + 2) * sizeof(char *));
+    char **envp = argv + request->argc + 1;
+    for (int i = 0; i < request->argc + request->envc + 1; i++)
+    {
+        if (i == request->argc)
+        {
+            continue;
+        }
+        argv[i] = next;
+        next += strlen(next) + 1;
+    }
+    argv[request->argc] = NULL;
+    envp[request->envc] = NULL;
+    command.cmd_args = argv;
+    environ = envp;
+
+    signal(SIGINT, request->foreground ? SIG_DFL : SIG_IGN);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    if (chdir(cwd) == -1)
+    {
+        perror("chdir()");
+        exit(2);
+    }
+    redirectFiles(&command);
+
+    if (path[0] != '\0')
+    {
+        execv(path, argv);
+    }
+    execvp(argv[0], argv);
+    perror("execve");
+    exit(2);
+}
+
+/*  zygoteSpawn()
+    Functionality:
+            This function starts one command in the zygote. An intermediate child forks the command and exits
+            right away, so the command is re-parented to the shell (the subreaper) before its process ID is
+            sent back.
+    Parameters:
+            1.) request header
+            2.) strings of the request
+            3.) received stdin, stdout and stderr
+    Returns:
+            Returns the process ID of the command, or -1 if it could not be forked.
+*/
+pid_t zygoteSpawn(struct ZygoteRequest *request, char *strings, int *fds)
+{
+    int report[2];
+    if (pipe(report) == -1)
+    {
+        return -1;
+    }
+
+    pid_t middle = fork();
+    if (middle == 0)
+    {
+        close(report[0]);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            close(report[1]);
+            zygoteChild(request, strings, fds);
+        }
+        write(report[1], &child, sizeof(child));
+        _exit(0);
+    }
+
+    close(report[1]);
+    pid_t child = -1;
+    if (middle == -1 || read(report[0], &child, sizeof(child)) != sizeof(child))
+    {
+        child = -1;
+    }
+    close(report[0]);
+
+    // Once the intermediate child has been reaped the command belongs to the shell
+    if (middle != -1)
+    {
+        waitpid(middle, NULL, 0);
+    }
+    return child;
+}
+
+/*  zygoteLoop()
+    Functionality:
+            This function is the main loop of the zygote. It receives one request per message, starts the command
+            and replies with its process ID. The zygote exits when the shell closes its end of the socket.
+    Parameters:
+            1.) zygote end of the socketpair
+    Returns:
+            Does not return.
+*/
+void zygoteLoop(int sock)
+{
+    char *buffer = malloc(ZYGOTE_MESSAGE_SIZE);
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
+
+    while (1)
+    {
+        char control[CMSG_SPACE(4 * sizeof(int))];
+        struct iovec iov = {buffer, ZYGOTE_MESSAGE_SIZE};
+        struct msghdr message = {0};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received = recvmsg(sock, &message, MSG_CMSG_CLOEXEC);
+        if (received == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= (ssize_t)sizeof(struct ZygoteRequest))
+        {
+            _exit(0);
+        }
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        pid_t child = -1;
+        if (header != NULL && header->cmsg_type == SCM_RIGHTS)
+        {
+            // A fourth descriptor is the exec report pipe, it stays close-on-exec in the command
+            int fds[4];
+            int count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(header), count * sizeof(int));
+            child = zygoteSpawn((struct ZygoteRequest *)buffer, buffer + sizeof(struct ZygoteRequest), fds);
+            for (int i = 0; i < count; i++)
+            {
+                close(fds[i]);
+            }
+        }
+        if (write(sock, &child, sizeof(child)) == -1)
+        {
+            _exit(0);
+        }
+    }
+}
+
+/*  startZygote()
+    Functionality:
+            This function makes the shell a child subreaper and forks the zygote. It has to run before the shell
+            allocates anything large, so that the zygote stays small.
+    Parameters:
+            N/A
+    Returns:
+            Returns 0 if the zygote was started, otherwise -1.
+*/
+int startZygote()
+{
+    int sockets[2];
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1 ||
+        socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1)
+    {
+        perror("zygote");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t zygote = fork();
+    if (zygote == -1)
+    {
+        perror("zygote fork()");
+        close(sockets[0]);
+        close(sockets[1]);
+        return -1;
+    }
+    if (zygote == 0)
+    {
+        close(sockets[0]);
+        zygoteLoop(sockets[1]);
+    }
+
+    close(sockets[1]);
+    zygoteSocket = sockets[0];
+    return 0;
+}
+
+/*  zygoteCommand()
+    Functionality:
+            This function asks the zygote to start a command and waits for its process ID.
+    Parameters:
+            1.) Pointer to Command struct
+            2.) absolute path of the command, or NULL to let execvp() search PATH
+            3.) file descriptor to use as stdin, or -1 to keep the shell's stdin
+            4.) file descriptor to use as stdout, or -1 to keep the shell's stdout
+            5.) 1 if the command runs in the foreground, otherwise 0
+    Returns:
+            Returns the process ID of the command, or -1 if the zygote could not start it.
+*/
+pid_t zygoteCommand(struct Command *p, char *path, int in_fd, int out_fd, int foreground)
+{
+    static char *buffer = NULL;
+    if (buffer == NULL)
+    {
+        buffer = malloc(ZYGOTE_MESSAGE_SIZE);
+    }
+
+    struct ZygoteRequest *request = (struct ZygoteRequest *)buffer;
+    request->foreground = foreground;
+    request->argc = 0;
+    while (p->cmd_args[request->argc] != NULL)
+    {
+        request->argc++;
+    }
+    request->envc = 0;
+    while (environ[request->envc] != NULL)
+    {
+        request->envc++;
+    }
+    request->redirects = (p->output_append ? ZYGOTE_OUTPUT_APPEND : 0) | (p->error_append ? ZYGOTE_ERROR_APPEND : 0) |
+                         p->error_to_output << ZYGOTE_ERROR_SHIFT | p->output_to_error << ZYGOTE_OUTPUT_SHIFT;
+
+    char cwd[4096];
+    char *header[] = {getcwd(cwd, sizeof(cwd)) != NULL ? cwd : ".", path != NULL ? path : ""};
+    char *files[] = {p->input_file, p->output_file, p->error_file, p->here_string};
+    size_t used = sizeof(struct ZygoteRequest);
+    if (packStrings(buffer, &used, ZYGOTE_MESSAGE_SIZE, header, 2) == -1)
+    {
+        return -1;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        if (files[i] != NULL)
+        {
+            request->redirects |= 1 << i;
+            if (packStrings(buffer, &used, ZYGOTE_MESSAGE_SIZE, files + i, 1) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    if (packStrings(buffer, &used, ZYGOTE_MESSAGE_SIZE, p->cmd_args, request->argc) == -1 ||
+        packStrings(buffer, &used, ZYGOTE_MESSAGE_SIZE, environ, request->envc) == -1)
+    {
+        return -1;
+    }
+
+    // The child's stdin, stdout and stderr travel with the request, while tracing also an exec report pipe
+    int report[2] = {-1, -1};
+    if (traceEnabled && pipe2(report, O_CLOEXEC) == -1)
+    {
+        report[0] = report[1] = -1;
+    }
+    int fds[4] = {in_fd != -1 ? in_fd : 0, out_fd != -1 ? out_fd : 1, 2, report[1]};
+    int fd_count = report[1] != -1 ? 4 : 3;
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {buffer, used};
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fd_count * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, fd_count * sizeof(int));
+    message.msg_controllen = CMSG_SPACE(fd_count * sizeof(int));
+
+    pid_t child = -1;
+    int sent = sendmsg(zygoteSocket, &message, MSG_NOSIGNAL) != -1;
+    if (report[1] != -1)
+    {
+        close(report[1]);
+    }
+    if (!sent)
+    {
+        if (report[0] != -1)
+        {
+            close(report[0]);
+        }
+        return -1;
+    }
+    while (read(zygoteSocket, &child, sizeof(child)) == -1 && errno == EINTR)
+        ;
+    waitForExec(report[0]);
+    return child;
+}
+
+/*  setSpawnMode()
+    Functionality:
+            This function reads the SMALLSH_SPAWN environment variable and selects the spawn path.
+            "fork" forces the fork() path, "zygote" starts the zygote, anything else keeps the posix_spawn()
+            fast path. If the zygote can not be started (or is not allowed) the fast path is used.
+    Parameters:
+            1.) 1 if the zygote may be started, otherwise 0
+    Returns:
+            Does not return anything. Sets the global spawnMode.
+*/
+void setSpawnMode(int allow_zygote)
+{
+    char *mode = getenv("SMALLSH_SPAWN");
+    if (mode != NULL && strcmp(mode, "fork") == 0)
+    {
+        spawnMode = SPAWN_FORK;
+    }
+    else if (mode != NULL && strcmp(mode, "zygote") == 0 && allow_zygote && startZygote() == 0)
+    {
+        spawnMode = SPAWN_ZYGOTE;
+    }
+    else
+    {
+        spawnMode = SPAWN_FAST;
+    }
+}
+
+/*  forkCommand()
+    Functionality:
+            This function starts a command with fork() and exec. In the child the pipe ends are copied onto
+            stdin/stdout, SIGINT is set back to its default action for foreground commands, the placement is
+            applied, and the redirections are set up before calling execv() with the resolved path (or execvp()
+            if the name was not resolved).
+    Parameters:
+            1.) Pointer to Command struct
+            2.) absolute path of the command, or NULL to let execvp() search PATH
+            3.) file descriptor to use as stdin, or -1 to keep the shell's stdin
+            4.) file descriptor to use as stdout, or -1 to keep the shell's stdout
+            5.) 1 if the command runs in the foreground, otherwise 0
+    Returns:
+            Returns the process ID of the child, or -1 if fork() failed.
+*/
+pid_t forkCommand(struct Command *p, char *path, int in_fd, int out_fd, int foreground)
+{
+    // While tracing, wait for the exec like posix_spawn() does
+    int report[2] = {-1, -1};
+    if (traceEnabled && pipe2(report, O_CLOEXEC) == -1)
+    {
+        report[0] = report[1] = -1;
+    }
+    pid_t spawnid = fork();
+    if (spawnid == -1)
+    {
+        perror("fork() failed!");
+        if (report[0] != -1)
+        {
+            close(report[0]);
+            close(report[1]);
+        }
+        return -1;
+    }
+    if (spawnid != 0)
+    {
+        if (report[1] != -1)
+        {
+            close(report[1]);
+        }
+        waitForExec(report[0]);
+        return spawnid;
+    }
+
+    // Foreground children can be interrupted with ^C, background children keep ignoring it
+    if (foreground)
+    {
+        signal(SIGINT, SIG_DFL);
+    }
+
+    // CPU affinity, niceness and limits from pin/nice/ionice/ulimit
+    if (p->placement != NULL)
+    {
+        applyPlacement(p->placement);
+    }
+
+    if (in_fd != -1)
+    {
+        dup2(in_fd, 0);
+        close(in_fd);
+    }
+    if (out_fd != -1)
+    {
+        dup2(out_fd, 1);
+        close(out_fd);
+    }
+    redirectFiles(p);
+
+    // Run command using the execv/execvp function. Passing p->cmd_args as parameters.
+    if (path != NULL)
+    {
+        execv(path, p->cmd_args);
+    }
+    execvp(p->cmd_args[0], p->cmd_args);
+
+    // Print error if execvp returns
+    perror("execve");
+    exit(2);
+}
+
+/*  spawnCommand()
+    Functionality:
+            This function starts a command with posix_spawn(). The pipe ends and the redirections are handed to
+            the child as spawn file actions, in the order redirectFiles() applies them, and SIGINT is reset to its
+            default action for foreground commands. A here-string is written to a memfd before the spawn.
+    Parameters:
+            1.) Pointer to Command struct
+            2.) absolute (or relative) path of the command
+            3.) file descriptor to use as stdin, or -1 to keep the shell's stdin
+            4.) file descriptor to use as stdout, or -1 to keep the shell's stdout
+            5.) 1 if the command runs in the foreground, otherwise 0
+            6.) Pointer to int that receives the error number when posix_spawn() fails
+    Returns:
+            Returns the process ID of the child, or -1 if posix_spawn() failed.
+    Sources Cited:
+            https://man7.org/linux/man-pages/man3/posix_spawn.3.html
+*/
+pid_t spawnCommand(struct Command *p, char *path, int in_fd, int out_fd, int foreground, int *error)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t defaults;
+    sigset_t mask;
+    pid_t spawnid;
+
+    posix_spawn_file_actions_init(&actions);
+    if (in_fd != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, 0);
+    }
+    if (out_fd != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, 1);
+    }
+    int here_fd = -1;
+    if (p->input_file != NULL)
+    {
+        posix_spawn_file_actions_addopen(&actions, 0, p->input_file, O_RDONLY, 0);
+    }
+    else if (p->here_string != NULL)
+    {
+        here_fd = hereStringFile(p->here_string);
+        if (here_fd == -1)
+        {
+            *error = errno;
+            posix_spawn_file_actions_destroy(&actions);
+            return -1;
+        }
+        posix_spawn_file_actions_adddup2(&actions, here_fd, 0);
+    }
+    if (p->error_to_output == STDERR_BEFORE_OUTPUT)
+    {
+        posix_spawn_file_actions_adddup2(&actions, 1, 2);
+    }
+    if (p->output_to_error == STDOUT_BEFORE_ERROR)
+    {
+        posix_spawn_file_actions_adddup2(&actions, 2, 1);
+    }
+    if (p->output_file != NULL)
+    {
+        posix_spawn_file_actions_addopen(&actions, 1, p->output_file,
+                                         O_WRONLY | O_CREAT | (p->output_append ? O_APPEND : O_TRUNC), 0644);
+    }
+    if (p->error_file != NULL)
+    {
+        posix_spawn_file_actions_addopen(&actions, 2, p->error_file,
+                                         O_WRONLY | O_CREAT | (p->error_append ? O_APPEND : O_TRUNC), 0644);
+    }
+    if (p->error_to_output == STDERR_AFTER_OUTPUT)
+    {
+        posix_spawn_file_actions_adddup2(&actions, 1, 2);
+    }
+    if (p->output_to_error == STDOUT_AFTER_ERROR)
+    {
+        posix_spawn_file_actions_adddup2(&actions, 2, 1);
+    }
+
+    // Reset SIGINT for foreground children and start with an empty signal mask
+    sigemptyset(&defaults);
+    if (foreground)
+    {
+        sigaddset(&defaults, SIGINT);
+    }
+    sigemptyset(&mask);
+
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &mask);
+
+    int result = posix_spawn(&spawnid, path, &actions, &attr, p->cmd_args, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (here_fd != -1)
+    {
+        close(here_fd);
+    }
+
+    if (result != 0)
+    {
+        *error = result;
+        return -1;
+    }
+    return spawnid;
+}
+
+pid_t startCommand(struct Command *p, int in_fd, int out_fd, int foreground);
+
+/*  fanOutCommand()
+    Functionality:
+            This function starts a command whose stdout fans out to several files. A forked relay opens the
+            files, starts the command with its stdout on a pipe and copies the pipe into the files with
+            fanOutRelay(). The relay then waits for the command and exits with the same status, or is killed by
+            the same signal, so it stands in for the command in the job table and in wait4().
+    Parameters:
+            1.) Pointer to Command struct
+            2.) file descriptor to use as stdin, or -1 to keep the shell's stdin
+            3.) file descriptor to use as stdout, replaced by the files
+            4.) 1 if the command runs in the foreground, otherwise 0
+    Returns:
+            Returns the process ID of the relay, or -1 if fork() failed.
+*/
+pid_t fanOutCommand(struct Command *p, int in_fd, int out_fd, int foreground)
+{
+    pid_t relay = fork();
+    if (relay == -1)
+    {
+        perror("fork() failed!");
+    }
+    if (relay != 0)
+    {
+        return relay;
+    }
+
+    // The relay keeps ignoring SIGINT and ^Z so it can finish copying what the command wrote
+    signal(SIGCHLD, SIG_DFL);
+    traceEnabled = 0;
+    if (out_fd != -1)
+    {
+        close(out_fd);
+    }
+
+    int *fds = malloc((p->tee_count + 1) * sizeof(int));
+    int pipe_fds[2];
+    if (openFanOut(p, fds) == -1)
+    {
+        _exit(1);
+    }
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+    {
+        perror("pipe()");
+        _exit(1);
+    }
+#ifdef F_SETPIPE_SZ
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+
+    // Commands started by the zygote are re-parented to the shell, so the relay can not wait for them
+    if (spawnMode == SPAWN_ZYGOTE)
+    {
+        spawnMode = SPAWN_FAST;
+    }
+    struct Command command = *p;
+    command.output_file = NULL;
+    command.tee_files = NULL;
+    command.tee_count = 0;
+    pid_t child = startCommand(&command, in_fd, pipe_fds[1], foreground);
+    close(pipe_fds[1]);
+    if (in_fd != -1)
+    {
+        close(in_fd);
+    }
+    signal(SIGTSTP, SIG_IGN);
+
+    int failed = child == -1 || fanOutRelay(pipe_fds[0], fds, p->tee_count + 1);
+    close(pipe_fds[0]);
+    closeFanOut(fds, p->tee_count + 1);
+
+    int status;
+    while (child != -1 && waitpid(child, &status, 0) == -1 && errno == EINTR)
+        ;
+    if (child == -1)
+    {
+        _exit(1);
+    }
+    if (WIFSIGNALED(status))
+    {
+        signal(WTERMSIG(status), SIG_DFL);
+        raise(WTERMSIG(status));
+    }
+    _exit(WIFEXITED(status) && WEXITSTATUS(status) != 0 ? WEXITSTATUS(status) : failed);
+}
+
+/*  startCommand()
+    Functionality:
+            This function brings environ up to date with the exported variables, resolves the command through
+            the PATH lookup cache and starts it using the selected spawn path. If the cached file is gone (ENOENT) the entry is dropped and PATH is searched once more.
+            If posix_spawn() still can not start the command (missing command, unreadable input file, ...) the
+            command is started again with fork() so that the child prints the same error message and exits with
+            the same status as before. Commands that fan out to several files are handed to fanOutCommand().
+    Parameters:
+            1.) Pointer to Command struct
+            2.) file descriptor to use as stdin, or -1 to keep the shell's stdin
+            3.) file descriptor to use as stdout, or -1 to keep the shell's stdout
+            4.) 1 if the command runs in the foreground, otherwise 0
+    Returns:
+            Returns the process ID of the child, or -1 if the command could not be started.
+*/
+pid_t startCommand(struct Command *p, int in_fd, int out_fd, int foreground)
+{
+    // Write out buffered status messages before the child writes to the same stdout
+    fflush(stdout);
+
+    // Variables exported or changed since the last command, wherever they were set, go to the child
+    refreshEnvironment();
+
+    // Several > files are written by a relay that stands in for the command
+    if (p->tee_count > 0)
+    {
+        return fanOutCommand(p, in_fd, out_fd, foreground);
+    }
+    uint64_t trace_start = traceBegin();
+
+    char *name = p->cmd_args[0];
+    int has_slash = strchr(name, '/') != NULL;
+    char *path = has_slash ? name : lookupCommand(name);
+
+    // A placement has to be applied between fork() and exec, which only the fork() path can do
+    pid_t spawnid = -1;
+    int fork_only = p->placement != NULL;
+    if (spawnMode == SPAWN_ZYGOTE && !fork_only)
+    {
+        spawnid = zygoteCommand(p, path, in_fd, out_fd, foreground);
+    }
+    if (spawnid == -1 && spawnMode == SPAWN_FAST && path != NULL && !fork_only)
+    {
+        int error = 0;
+        spawnid = spawnCommand(p, path, in_fd, out_fd, foreground, &error);
+
+        // The cached file was removed or moved, search PATH again
+        if (spawnid == -1 && error == ENOENT && !has_slash && access(path, X_OK) != 0)
+        {
+            forgetCommand(name);
+            path = lookupCommand(name);
+            if (path != NULL)
+            {
+                spawnid = spawnCommand(p, path, in_fd, out_fd, foreground, &error);
+            }
+        }
+    }
+    if (spawnid == -1)
+    {
+        spawnid = forkCommand(p, path, in_fd, out_fd, foreground);
+    }
+
+    // This covers the child opening its files and calling exec on every path
+    traceEvent("spawn", name, 0, trace_start);
+    return spawnid;
+}
+
+#endif
@@ -0,0 +1,430 @@
+/*
+    This file contains the per-command resource accounting. Every child is reaped with wait4(), and the wall
+    time, user/sys CPU time, max RSS and context switches are added to the entry of its command name. Wall
+    times go into log-scale histograms so that p50/p90/p99 can be reported without keeping every sample.
+    The shell also times its own spawn overhead, from the moment a line is read until the child is started.
+
+    There are eleven functions in this file:
+        1.) elapsedMicros()
+        2.) histogramBucket()
+        3.) bucketLimit()
+        4.) histogramPercentile()
+        5.) findStats()
+        6.) addWallTime()
+        7.) recordSpawn()
+        8.) recordUsage()
+        9.) printStats()
+        10.) resetStats()
+        11.) statsCommand()
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "helper_functions.h"
+#include "path_cache.h"
+
+// Quarter-octave buckets from 1us up to about 71 minutes
+#define HISTOGRAM_BUCKETS 128
+#define STATS_BUCKETS 256
+
+#define STATS_TABLE 0
+#define STATS_CSV 1
+#define STATS_JSON 2
+
+/*
+    Data Members:
+        name: (string) ->                   command name (cmd_args[0])
+        count: (long) ->                    number of finished runs
+        histogram: (long array) ->          number of runs per wall time bucket
+        wall/user/sys: (double) ->          total wall, user CPU and system CPU time in seconds
+        min_wall/max_wall: (long) ->        shortest and longest wall time of a run in microseconds
+        max_rss: (long) ->                  largest max RSS of a run in kilobytes
+        switches: (long) ->                 total voluntary and involuntary context switches
+        next: (CommandStats pointer) ->     next entry in the same bucket
+*/
+struct CommandStats
+{
+    char *name;
+    long count;
+    long histogram[HISTOGRAM_BUCKETS];
+    double wall;
+    double user;
+    double sys;
+    long min_wall;
+    long max_wall;
+    long max_rss;
+    long switches;
+    struct CommandStats *next;
+};
+
+struct CommandStats *commandStats[STATS_BUCKETS];
+
+// Shell overhead from reading a line to starting its child (parse -> fork -> exec)
+struct CommandStats spawnStats = {"(spawn)"};
+
+// Time the current input line was read, set by getCommand()
+struct timespec lineStart;
+
+/*  elapsedMicros()
+    Functionality:
+            This function returns the number of microseconds between a monotonic clock reading and now.
+    Parameters:
+            1.) Pointer to start time
+    Returns:
+            Returns the elapsed time in microseconds.
+*/
+long elapsedMicros(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/*  histogramBucket()
+    Functionality:
+            This function maps a time to its histogram bucket. Each power of two is split into four buckets,
+            using the highest set bit and the two bits below it.
+    Parameters:
+            1.) time in microseconds
+    Returns:
+            Returns the bucket index.
+*/
+int histogramBucket(long micros)
+{
+    if (micros < 4)
+    {
+        return micros < 0 ? 0 : micros;
+    }
+
+    int msb = 63 - __builtin_clzl((unsigned long)micros);
+    int bucket = msb * 4 + ((micros >> (msb - 2)) & 3);
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+/*  bucketLimit()
+    Functionality:
+            This function returns the largest time that falls into a histogram bucket.
+    Parameters:
+            1.) bucket index
+    Returns:
+            Returns the upper limit of the bucket in microseconds.
+*/
+long bucketLimit(int bucket)
+{
+    if (bucket < 4)
+    {
+        return bucket;
+    }
+    int msb = bucket / 4;
+    return ((4L + bucket % 4 + 1) << (msb - 2)) - 1;
+}
+
+/*  histogramPercentile()
+    Functionality:
+            This function finds the bucket that holds the given percentile of the runs and places the percentile
+            inside it by rank, assuming the runs of the bucket are spread evenly between its edges. The result is
+            kept between the shortest and the longest run, so it never lies outside the recorded times.
+    Parameters:
+            1.) Pointer to CommandStats struct
+            2.) percentile (0-100)
+    Returns:
+            Returns the time in milliseconds.
+*/
+double histogramPercentile(struct CommandStats *stats, int percentile)
+{
+    long wanted = (stats->count * percentile + 99) / 100;
+    long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        long runs = stats->histogram[i];
+        if (runs > 0 && seen + runs >= wanted)
+        {
+            long low = i < 4 ? i : (4L + i % 4) << (i / 4 - 2);
+            double micros = low + (bucketLimit(i) - low) * (double)(wanted > seen ? wanted - seen : 1) / runs;
+            micros = micros < stats->min_wall ? stats->min_wall : micros;
+            micros = micros > stats->max_wall ? stats->max_wall : micros;
+            return micros / 1000.0;
+        }
+        seen += runs;
+    }
+    return 0;
+}
+
+/*  findStats()
+    Functionality:
+            This function finds the entry of a command name, creating it on first use.
+    Parameters:
+            1.) command name
+    Returns:
+            Returns the CommandStats struct of the command.
+*/
+struct CommandStats *findStats(const char *name)
+{
+    unsigned int bucket = hashName(name) % STATS_BUCKETS;
+    for (struct CommandStats *stats = commandStats[bucket]; stats != NULL; stats = stats->next)
+    {
+        if (strcmp(stats->name, name) == 0)
+        {
+            return stats;
+        }
+    }
+
+    struct CommandStats *stats = calloc(1, sizeof(struct CommandStats));
+    stats->name = strdup(name);
+    stats->next = commandStats[bucket];
+    commandStats[bucket] = stats;
+    return stats;
+}
+
+/*  addWallTime()
+    Functionality:
+            This function adds the wall time of one run to an entry: its count, histogram, total and range.
+    Parameters:
+            1.) Pointer to CommandStats struct
+            2.) wall time in microseconds
+    Returns:
+            Does not return anything.
+*/
+void addWallTime(struct CommandStats *stats, long micros)
+{
+    if (stats->count == 0 || micros < stats->min_wall)
+    {
+        stats->min_wall = micros;
+    }
+    if (micros > stats->max_wall)
+    {
+        stats->max_wall = micros;
+    }
+    stats->count++;
+    stats->histogram[histogramBucket(micros)]++;
+    stats->wall += micros / 1e6;
+}
+
+/*  recordSpawn()
+    Functionality:
+            This function records the shell's own overhead for the current line, from the time the line was read
+            until its child was started.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void recordSpawn()
+{
+    addWallTime(&spawnStats, elapsedMicros(&lineStart));
+}
+
+/*  recordUsage()
+    Functionality:
+            This function adds one finished child to the entry of its command name.
+    Parameters:
+            1.) command name (cmd_args[0]), may be NULL
+            2.) Pointer to time the child was started
+            3.) Pointer to rusage struct filled in by wait4()
+    Returns:
+            Does not return anything.
+*/
+void recordUsage(const char *name, struct timespec *start, struct rusage *usage)
+{
+    if (name == NULL)
+    {
+        return;
+    }
+
+    struct CommandStats *stats = findStats(name);
+    addWallTime(stats, elapsedMicros(start));
+    stats->user += usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6;
+    stats->sys += usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+    if (usage->ru_maxrss > stats->max_rss)
+    {
+        stats->max_rss = usage->ru_maxrss;
+    }
+    stats->switches += usage->ru_nvcsw + usage->ru_nivcsw;
+}
+
+/*  printStats()
+    Functionality:
+            This function prints one entry as a table row, a CSV line or a JSON object.
+    Parameters:
+            1.) output stream
+            2.) Pointer to CommandStats struct
+            3.) STATS_TABLE, STATS_CSV or STATS_JSON
+            4.) 1 if this is the first JSON object (no leading comma)
+    Returns:
+            Does not return anything.
+*/
+void printStats(FILE *out, struct CommandStats *stats, int format, int first)
+{
+    double p50 = histogramPercentile(stats, 50);
+    double p90 = histogramPercentile(stats, 90);
+    double p99 = histogramPercentile(stats, 99);
+
+    if (format == STATS_CSV)
+    {
+        fprintf(out, "%s,%ld,%.3f,%.3f,%.3f,%.6f,%.6f,%.6f,%ld,%ld\n", stats->name, stats->count, p50, p90, p99,
+                stats->wall, stats->user, stats->sys, stats->max_rss, stats->switches);
+    }
+    else if (format == STATS_JSON)
+    {
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"count\": %ld, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, "
+                     "\"wall_s\": %.6f, \"user_s\": %.6f, \"sys_s\": %.6f, \"max_rss_kb\": %ld, \"ctx_switches\": %ld}",
+                first ? "" : ",", stats->name, stats->count, p50, p90, p99, stats->wall, stats->user, stats->sys,
+                stats->max_rss, stats->switches);
+    }
+    else
+    {
+        fprintf(out, "%-16s %8ld %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10ld %10ld\n", stats->name, stats->count,
+                p50, p90, p99, stats->wall, stats->user, stats->sys, stats->max_rss, stats->switches);
+    }
+}
+
+/*  resetStats()
+    Functionality:
+            This function frees every entry and clears the spawn overhead histogram.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void resetStats()
+{
+    for (int i = 0; i < STATS_BUCKETS; i++)
+    {
+        struct CommandStats *stats = commandStats[i];
+        while (stats != NULL)
+        {
+            struct CommandStats *next = stats->next;
+            free(stats->name);
+            free(stats);
+            stats = next;
+        }
+        commandStats[i] = NULL;
+    }
+    char *name = spawnStats.name;
+    memset(&spawnStats, 0, sizeof(struct CommandStats));
+    spawnStats.name = name;
+}
+
+/*  statsCommand()
+    Functionality:
+            This function is the stats built in. "stats" prints a table with the p50/p90/p99 wall time in ms and
+            the totals of every command name, followed by the shell's spawn overhead and a total line.
+            "stats csv [file]" and "stats json [file]" export the same data, and "stats -r" resets it.
+    Parameters:
+            1.) cmd_args char array that holds the command(stats) at index [0] and the format/file after it
+    Returns:
+            Returns 0, or 1 for an unknown option or a file that can not be opened.
+*/
+int statsCommand(char **cmd_args)
+{
+    int format = STATS_TABLE;
+    FILE *out = stdout;
+
+    if (cmd_args[1] != NULL)
+    {
+        if (strcmp(cmd_args[1], "-r") == 0)
+        {
+            resetStats();
+            return 0;
+        }
+        else if (strcmp(cmd_args[1], "csv") == 0)
+        {
+            format = STATS_CSV;
+        }
+        else if (strcmp(cmd_args[1], "json") == 0)
+        {
+            format = STATS_JSON;
+        }
+        else
+        {
+            printf("stats: usage: stats [-r | csv [file] | json [file]]\n");
+            flushOutput();
+            return 1;
+        }
+
+        if (cmd_args[2] != NULL)
+        {
+            out = fopen(cmd_args[2], "w");
+            if (out == NULL)
+            {
+                perror(cmd_args[2]);
+                return 1;
+            }
+        }
+    }
+
+    // Header
+    if (format == STATS_CSV)
+    {
+        fprintf(out, "name,count,p50_ms,p90_ms,p99_ms,wall_s,user_s,sys_s,max_rss_kb,ctx_switches\n");
+    }
+    else if (format == STATS_JSON)
+    {
+        fprintf(out, "{\n  \"commands\": [");
+    }
+    else
+    {
+        fprintf(out, "%-16s %8s %10s %10s %10s %10s %10s %10s %10s %10s\n", "command", "count", "p50_ms", "p90_ms",
+                "p99_ms", "wall_s", "user_s", "sys_s", "maxrss_kb", "ctxsw");
+    }
+
+    struct CommandStats total = {"(total)"};
+    int first = 1;
+    for (int i = 0; i < STATS_BUCKETS; i++)
+    {
+        for (struct CommandStats *stats = commandStats[i]; stats != NULL; stats = stats->next)
+        {
+            printStats(out, stats, format, first);
+            first = 0;
+
+            if (total.count == 0 || stats->min_wall < total.min_wall)
+            {
+                total.min_wall = stats->min_wall;
+            }
+            total.max_wall = stats->max_wall > total.max_wall ? stats->max_wall : total.max_wall;
+            total.count += stats->count;
+            for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+            {
+                total.histogram[b] += stats->histogram[b];
+            }
+            total.wall += stats->wall;
+            total.user += stats->user;
+            total.sys += stats->sys;
+            total.max_rss = stats->max_rss > total.max_rss ? stats->max_rss : total.max_rss;
+            total.switches += stats->switches;
+        }
+    }
+
+    if (format == STATS_JSON)
+    {
+        fprintf(out, "\n  ],\n  \"spawn\": [");
+        printStats(out, &spawnStats, format, 1);
+        fprintf(out, "\n  ],\n  \"total\": [");
+        printStats(out, &total, format, 1);
+        fprintf(out, "\n  ]\n}\n");
+    }
+    else
+    {
+        printStats(out, &spawnStats, format, 0);
+        printStats(out, &total, format, 0);
+    }
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    else
+    {
+        flushOutput();
+    }
+    return 0;
+}
+
+#endif
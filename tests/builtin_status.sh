@@ -0,0 +1,14 @@
+# Built ins report failure through $? like the commands they stand in for
+false
+if cd /tmp; then echo cd ok; else echo cd notok; fi
+cd /nonexistent
+echo cd $?
+hash nosuchcmd
+echo hash $?
+hash sh
+echo hash $?
+stats bogus
+echo stats $?
+false
+jobs
+echo jobs $?
@@ -0,0 +1,24 @@
+# Replies read into an exported variable reach children
+export V=start
+coproc C cat
+C <<< fromcoproc
+read -u C V
+echo shell $V
+sh -c 'echo child $V'
+
+# Replies left by a coprocess that has exited can still be read
+C one two
+coproc -c C
+wait
+read -u C first
+read -u C second
+echo $first $second
+read -u C
+echo status $?
+
+# Once it is done, the name no longer shadows the command
+coproc cat cat
+coproc -c cat
+wait
+cat tests/coproc.sh > /dev/null
+echo cat status $?
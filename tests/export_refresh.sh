@@ -0,0 +1,7 @@
+# Exported variables changed by a plain assignment or export reach the next child
+export V=start
+V=assigned
+sh -c 'echo assign $V'
+export W
+W=later
+sh -c 'echo export $W'
@@ -0,0 +1,6 @@
+# The loop variable of a for loop is passed to children when it is exported
+export V=start
+for V in a b; do sh -c 'echo loop $V'; done
+sh -c 'echo after $V'
+f() { V=$1; sh -c 'echo function $V'; }
+f c
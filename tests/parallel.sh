@@ -0,0 +1,10 @@
+# parallel reads its command list from a pipe, a <<< string or the rest of the shell's input
+printf 'echo first\necho second\n' | parallel -j1
+parallel -j1 <<< 'echo here-string'
+# -jN without a space sets the number of slots
+parallel -j1 echo {} ::: a b
+echo "one two" | tr a-z A-Z
+# a command that finishes while parallel waits for the next line of the shell's input is still collected
+sh -c "echo 'parallel -j2'; echo 'echo a'; sleep 0.5; echo 'echo b'" | $SMALLSH
+# a built in in a pipeline waits for its own commands when the zygote starts the others
+printf "echo 'echo zygote' | parallel -j1\n" | env SMALLSH_SPAWN=zygote $SMALLSH
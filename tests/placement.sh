@@ -0,0 +1,9 @@
+# ulimit -n / -v without a value print the shell's limit
+ulimit -n 64
+ulimit -n
+echo ulimit $?
+ulimit -v unlimited
+ulimit -v
+# A built in name that ends the line after prefix options is the command
+nice -n 5 nice
+pin 0 nice -n 3 nice
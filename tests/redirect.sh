@@ -0,0 +1,18 @@
+# >&2 and 1>&2 send stdout to stderr, for built ins and programs
+echo builtin >&2 2>/dev/null
+echo builtin 2>/dev/null >&2
+/bin/echo program 1>&2 2>/dev/null
+/bin/echo program 2>/dev/null 1>&2
+ls /nonexistent 2>&1 >&2 | wc -l
+echo same 1>&1 2>&2
+echo one 1>redirect.tmp; cat redirect.tmp
+# >&word writes both streams to the file
+/bin/echo word >&redirect.tmp; cat redirect.tmp
+rm redirect.tmp
+# other descriptors are rejected and nothing on the line runs
+echo a >&5
+echo b; echo c 2>&x
+# a redirection without its file rejects the whole list or compound command before any of it runs
+echo a; echo b >; echo c
+if true; then echo x >; fi; echo after
+echo a & echo b 2>
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Runs every tests/*.sh script with the shell given as $1 (default ./smallsh) and compares its stdout and
+# stderr with the .out file next to it, with the process IDs of background jobs replaced by N. Prints the diff
+# of every script that does not match, and exits 1 if any of them failed.
+
+# The shell is exported as $SMALLSH for the scripts that start it themselves
+export SMALLSH=${1:-./smallsh}
+DIR=$(dirname "$0")
+failed=0
+for script in "$DIR"/*.sh; do
+    case $script in */run_tests.sh) continue ;; esac
+    expected=${script%.sh}.out
+    if "$SMALLSH" "$script" 2>&1 | sed -E 's/(pid is|process) [0-9]+/\1 N/' |
+        diff -u "$expected" - > /tmp/smallsh-test.$$; then
+        echo "ok    $(basename "$script")"
+    else
+        echo "FAIL  $(basename "$script")"
+        cat /tmp/smallsh-test.$$
+        failed=1
+    fi
+done
+rm -f /tmp/smallsh-test.$$
+exit $failed
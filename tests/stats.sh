@@ -0,0 +1,5 @@
+# the percentiles of a single run are its own wall time, not the upper edge of its histogram bucket
+sleep 0.0518
+stats csv stats.tmp
+awk -F, '$1 == "sleep" { print ($3 == $5 && $5 <= $6 * 1000 + 0.001) ? "p50 = p99 <= wall" : $0 }' stats.tmp
+rm stats.tmp
@@ -0,0 +1,18 @@
+# printf conversions and escapes the printf program has
+printf "%.2f|%e|%g|%5.1f\n" 1.5 1.5 0.0001 2.25
+printf '%b|%s\n' 'a\tb' 'c\td'
+printf '\101\x42\n'
+printf '%d %d\n' "'A" 010
+# conversions the built in does not handle run the printf program
+printf '%q\n' 'a b'
+printf '%*d|\n' 4 7
+echo -e '\x41\x4a|\0101'
+# test operators for file types, file dates and terminals
+test -t 1; echo $?
+test -c /dev/null; echo $?
+test -p /dev/null; echo $?
+test /etc -nt /nonexistent; echo $?
+test /etc/passwd -ef /etc/passwd; echo $?
+# errors are reported once, by the test program
+[ 1 -eq x ]; echo $?
+[ 1 = 1; echo $?
@@ -0,0 +1,293 @@
+/*
+    This file contains the tracer. While tracing is on, every phase of the main loop (waiting for input,
+    parsing, spawning, running built ins, waiting for children) and every reaped child is written as one
+    event to a fixed-size ring buffer. The buffer holds the last TRACE_EVENTS events and the oldest ones are
+    overwritten. When tracing is off each trace point costs one branch on traceEnabled, inlined even in the
+    unoptimized build. Building with -DSMALLSH_NO_TRACE removes the trace points altogether, which is the
+    baseline "make bench" measures the cost of tracing when it is off against.
+
+    "trace dump file.json" writes the buffer in the Chrome trace event format, which chrome://tracing and
+    ui.perfetto.dev can open. Shell phases are on the shell's own track and every child gets a track named
+    after its process ID, so background jobs show up as overlapping spans.
+
+    Usage:
+        trace start             clear the buffer and start recording
+        trace stop              stop recording, the buffer is kept
+        trace dump FILE         write the buffer to FILE as JSON
+        trace                   show whether tracing is on and how many events were recorded
+
+    There are seven functions in this file:
+        1.) traceNow()
+        2.) traceTime()
+        3.) traceBegin()
+        4.) traceEvent()
+        5.) writeJsonString()
+        6.) dumpTrace()
+        7.) traceCommand()
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Number of events kept, a power of two
+#define TRACE_EVENTS 65536
+#define TRACE_LABEL_SIZE 40
+
+/*
+    Data Members:
+        phase: (string) ->      name of the phase, a string literal ("spawn", "wait", ...)
+        label: (char array) ->  command name, truncated
+        tid: (pid_t) ->         process ID of the child the event belongs to, 0 for the shell itself
+        start: (uint64) ->      start time in nanoseconds on the monotonic clock
+        end: (uint64) ->        end time in nanoseconds on the monotonic clock
+*/
+struct TraceEvent
+{
+    const char *phase;
+    char label[TRACE_LABEL_SIZE];
+    pid_t tid;
+    uint64_t start;
+    uint64_t end;
+};
+
+int traceEnabled = 0;
+struct TraceEvent *traceBuffer = NULL;
+
+// Total number of events written, the slot of an event is its number modulo TRACE_EVENTS
+uint64_t traceHead = 0;
+
+/*  traceNow()
+    Functionality:
+            This function reads the monotonic clock.
+    Parameters:
+            N/A
+    Returns:
+            Returns the time in nanoseconds.
+*/
+uint64_t traceNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/*  traceTime()
+    Functionality:
+            This function converts a monotonic clock reading taken elsewhere (lineStart, job start times) to
+            nanoseconds.
+    Parameters:
+            1.) Pointer to timespec struct
+    Returns:
+            Returns the time in nanoseconds.
+*/
+static inline __attribute__((always_inline)) uint64_t traceTime(struct timespec *time)
+{
+    return (uint64_t)time->tv_sec * 1000000000u + time->tv_nsec;
+}
+
+/*  traceBegin()
+    Functionality:
+            This function returns the start time of a span, without reading the clock when tracing is off.
+    Parameters:
+            N/A
+    Returns:
+            Returns the time in nanoseconds, or 0 when tracing is off.
+*/
+static inline __attribute__((always_inline)) uint64_t traceBegin()
+{
+#ifdef SMALLSH_NO_TRACE
+    return 0;
+#else
+    return traceEnabled ? traceNow() : 0;
+#endif
+}
+
+/*  traceEvent()
+    Functionality:
+            This function writes one span that ends now to the ring buffer. The slot is claimed with an atomic
+            increment of the head, so no lock is taken. Spans that began while tracing was off are dropped.
+    Parameters:
+            1.) name of the phase, must be a string literal
+            2.) command name, or NULL
+            3.) process ID of the child, 0 for the shell
+            4.) start time from traceBegin() or traceTime()
+    Returns:
+            Does not return anything.
+*/
+static inline __attribute__((always_inline)) void traceEvent(const char *phase, const char *label, pid_t tid,
+                                                             uint64_t start)
+{
+#ifdef SMALLSH_NO_TRACE
+    return;
+#endif
+    if (!traceEnabled || start == 0)
+    {
+        return;
+    }
+
+    uint64_t number = __atomic_fetch_add(&traceHead, 1, __ATOMIC_RELAXED);
+    struct TraceEvent *event = &traceBuffer[number & (TRACE_EVENTS - 1)];
+    event->phase = phase;
+    event->tid = tid;
+    event->start = start;
+    event->end = traceNow();
+    if (label != NULL)
+    {
+        strncpy(event->label, label, TRACE_LABEL_SIZE - 1);
+        event->label[TRACE_LABEL_SIZE - 1] = '\0';
+    }
+    else
+    {
+        event->label[0] = '\0';
+    }
+}
+
+/*  writeJsonString()
+    Functionality:
+            This function writes a string as a quoted JSON string.
+    Parameters:
+            1.) output stream
+            2.) string
+    Returns:
+            Does not return anything.
+*/
+void writeJsonString(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (; *text != '\0'; text++)
+    {
+        unsigned char c = *text;
+        if (c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*  dumpTrace()
+    Functionality:
+            This function writes the events in the buffer, oldest first, as Chrome trace "complete" events with
+            times in microseconds. Each child track is named with a thread_name metadata event.
+    Parameters:
+            1.) output stream
+    Returns:
+            Does not return anything.
+*/
+void dumpTrace(FILE *out)
+{
+    pid_t shell = getpid();
+    uint64_t end = traceHead;
+    uint64_t first = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"smallsh\"}}",
+            shell, shell);
+    for (uint64_t i = first; i < end; i++)
+    {
+        struct TraceEvent *event = &traceBuffer[i & (TRACE_EVENTS - 1)];
+        pid_t tid = event->tid != 0 ? event->tid : shell;
+        fprintf(out, ",\n  {\"name\": ");
+        if (event->label[0] != '\0')
+        {
+            char name[TRACE_LABEL_SIZE + 16];
+            snprintf(name, sizeof(name), "%s %s", event->phase, event->label);
+            writeJsonString(out, name);
+        }
+        else
+        {
+            writeJsonString(out, event->phase);
+        }
+        fprintf(out, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+                event->phase, event->start / 1000.0, (event->end - event->start) / 1000.0, shell, tid);
+
+        // Name the track of a child after its command
+        if (event->tid != 0)
+        {
+            char name[TRACE_LABEL_SIZE + 16];
+            snprintf(name, sizeof(name), "%d %s", event->tid, event->label);
+            fprintf(out, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": ",
+                    shell, event->tid);
+            writeJsonString(out, name);
+            fprintf(out, "}}");
+        }
+    }
+    fprintf(out, "\n]}\n");
+}
+
+/*  traceCommand()
+    Functionality:
+            This function is the trace built in.
+    Parameters:
+            1.) cmd_args char array that holds the command(trace) at index [0] and the action after it
+    Returns:
+            Returns 0, 1 if the file can not be written or tracing was left out of the build, or 2 on a usage
+            error.
+*/
+int traceCommand(char **cmd_args)
+{
+    if (cmd_args[1] == NULL)
+    {
+        uint64_t kept = traceHead < TRACE_EVENTS ? traceHead : TRACE_EVENTS;
+        printf("trace: %s, %lu events recorded, %lu kept\n", traceEnabled ? "on" : "off",
+               (unsigned long)traceHead, (unsigned long)kept);
+        return 0;
+    }
+    if (strcmp(cmd_args[1], "start") == 0)
+    {
+#ifdef SMALLSH_NO_TRACE
+        fprintf(stderr, "trace: smallsh was built without tracing\n");
+        return 1;
+#endif
+        if (traceBuffer == NULL)
+        {
+            traceBuffer = calloc(TRACE_EVENTS, sizeof(struct TraceEvent));
+        }
+        traceHead = 0;
+        traceEnabled = 1;
+        return 0;
+    }
+    if (strcmp(cmd_args[1], "stop") == 0)
+    {
+        traceEnabled = 0;
+        return 0;
+    }
+    if (strcmp(cmd_args[1], "dump") == 0 && cmd_args[2] != NULL)
+    {
+        if (traceBuffer == NULL)
+        {
+            fprintf(stderr, "trace: nothing recorded\n");
+            return 1;
+        }
+        FILE *out = fopen(cmd_args[2], "w");
+        if (out == NULL)
+        {
+            perror(cmd_args[2]);
+            return 1;
+        }
+        dumpTrace(out);
+        fclose(out);
+        return 0;
+    }
+
+    fprintf(stderr, "trace: usage: trace start | stop | dump FILE\n");
+    return 2;
+}
+
+#endif
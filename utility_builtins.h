@@ -0,0 +1,817 @@
+/*
+    This file contains in-process versions of small utilities that scripts run in tight loops: echo, printf,
+    pwd, test/[, true, false and kill. Running them inside the shell avoids a fork/exec per call. Each function
+    returns the exit code the external utility would have returned. Arguments a built in does not handle (a
+    printf conversion it does not know, a test expression it can not parse, kill -l) make it return
+    UTILITY_EXTERNAL before it prints anything, and the program of the same name is run instead, so that a
+    script behaves the same as it did when every call was an exec.
+
+    There are sixteen functions in this file:
+        1.) printEscape()
+        2.) echoUtility()
+        3.) printfSpec()
+        4.) printfArgument()
+        5.) printfUtility()
+        6.) pwdUtility()
+        7.) trueUtility()
+        8.) falseUtility()
+        9.) testUnary()
+        10.) isBinaryOperator()
+        11.) testBinary()
+        12.) testPrimary()
+        13.) testExpression()
+        14.) testUtility()
+        15.) signalNumber()
+        16.) killUtility()
+*/
+
+#ifndef UTILITY_BUILTINS_H
+#define UTILITY_BUILTINS_H
+
+#include <sys/stat.h>
+#include <signal.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+
+// Returned by a utility for arguments it leaves to the external program of the same name
+#define UTILITY_EXTERNAL -1
+
+/*  printEscape()
+    Functionality:
+            This function prints the backslash escape at the start of text (\n, \t, \\, \a, \b, \e, \r, \v, \xHH,
+            \0NNN, ...). In a printf format octal values are written \NNN.
+    Parameters:
+            1.) text starting right after the backslash
+            2.) Pointer to int that is set to 1 when the escape is \c (stop printing)
+            3.) 1 for the escapes of a printf format, 0 for echo -e and printf %b
+    Returns:
+            Returns the number of characters of text that were consumed.
+*/
+int printEscape(const char *text, int *stop, int format)
+{
+    // Octal value with up to three digits, after a 0 except in a printf format
+    if ((format && *text >= '0' && *text <= '7') || *text == '0')
+    {
+        int value = 0;
+        int used = format ? 0 : 1;
+        int end = used + 3;
+        while (used < end && text[used] >= '0' && text[used] <= '7')
+        {
+            value = value * 8 + (text[used] - '0');
+            used++;
+        }
+        putchar(value);
+        return used;
+    }
+
+    // Hexadecimal value with up to two digits
+    if (*text == 'x')
+    {
+        int value = 0;
+        int used = 1;
+        while (used < 3 && isxdigit((unsigned char)text[used]))
+        {
+            int c = tolower((unsigned char)text[used]);
+            value = value * 16 + (c <= '9' ? c - '0' : c - 'a' + 10);
+            used++;
+        }
+        if (used == 1)
+        {
+            putchar('\\');
+            putchar('x');
+            return 1;
+        }
+        putchar(value);
+        return used;
+    }
+
+    switch (*text)
+    {
+    case 'n': putchar('\n'); return 1;
+    case 't': putchar('\t'); return 1;
+    case 'r': putchar('\r'); return 1;
+    case 'a': putchar('\a'); return 1;
+    case 'b': putchar('\b'); return 1;
+    case 'f': putchar('\f'); return 1;
+    case 'v': putchar('\v'); return 1;
+    case 'e': putchar('\033'); return 1;
+    case '\\': putchar('\\'); return 1;
+    case 'c': *stop = 1; return 1;
+    case '\0':
+        putchar('\\');
+        return 0;
+    default:
+        putchar('\\');
+        putchar(*text);
+        return 1;
+    }
+}
+
+/*  echoUtility()
+    Functionality:
+            This function is the echo utility. -n leaves out the newline, -e turns on backslash escapes and -E
+            turns them off again.
+    Parameters:
+            1.) cmd_args char array that holds the command(echo) at index [0] and the words after it
+    Returns:
+            Returns 0.
+*/
+int echoUtility(char **cmd_args)
+{
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+
+    // Options are only taken from leading words made of n, e and E
+    for (; cmd_args[i] != NULL && cmd_args[i][0] == '-' && cmd_args[i][1] != '\0'; i++)
+    {
+        if (strspn(cmd_args[i] + 1, "neE") != strlen(cmd_args[i] + 1))
+        {
+            break;
+        }
+        for (char *option = cmd_args[i] + 1; *option != '\0'; option++)
+        {
+            if (*option == 'n')
+            {
+                newline = 0;
+            }
+            else
+            {
+                escapes = *option == 'e';
+            }
+        }
+    }
+
+    for (int first = i; cmd_args[i] != NULL; i++)
+    {
+        if (i > first)
+        {
+            putchar(' ');
+        }
+        if (!escapes)
+        {
+            fputs(cmd_args[i], stdout);
+            continue;
+        }
+
+        int stop = 0;
+        for (const char *c = cmd_args[i]; *c != '\0' && !stop; c++)
+        {
+            if (*c == '\\')
+            {
+                c += printEscape(c + 1, &stop, 0);
+            }
+            else
+            {
+                putchar(*c);
+            }
+        }
+        if (stop)
+        {
+            return 0;
+        }
+    }
+
+    if (newline)
+    {
+        putchar('\n');
+    }
+    return 0;
+}
+
+/*  printfSpec()
+    Functionality:
+            This function measures the conversion spec at the start of text, "%[flags][width][.precision]" and the
+            conversion character.
+    Parameters:
+            1.) text starting at the %
+    Returns:
+            Returns the length of the spec, or 0 if it is not one printfArgument() handles (%q, %*d, %5b, ...).
+*/
+int printfSpec(const char *text)
+{
+    size_t length = strspn(text + 1, "-+ #0123456789.") + 1;
+    if (length > 24 || text[length] == '\0' || strchr("diouxXcseEfFgGaAb", text[length]) == NULL ||
+        (text[length] == 'b' && length > 1))
+    {
+        return 0;
+    }
+    return length + 1;
+}
+
+/*  printfArgument()
+    Functionality:
+            This function prints one argument for a single printf conversion, converting it to a number when
+            the conversion needs one. A number may also be given as a quote followed by a character.
+    Parameters:
+            1.) conversion spec, e.g. "%-5d"
+            2.) conversion character
+            3.) argument, or NULL if the arguments ran out
+            4.) Pointer to int that is set to 1 when a %b argument holds \c (stop printing)
+    Returns:
+            Returns 0, or 1 if a numeric argument was not a valid number.
+*/
+int printfArgument(char *spec, char conversion, char *argument, int *stop)
+{
+    if (conversion == 's')
+    {
+        printf(spec, argument != NULL ? argument : "");
+        return 0;
+    }
+    if (conversion == 'c')
+    {
+        printf(spec, argument != NULL ? argument[0] : '\0');
+        return 0;
+    }
+    if (conversion == 'b')
+    {
+        for (const char *c = argument != NULL ? argument : ""; *c != '\0' && !*stop; c++)
+        {
+            if (*c == '\\')
+            {
+                c += printEscape(c + 1, stop, 0);
+            }
+            else
+            {
+                putchar(*c);
+            }
+        }
+        return 0;
+    }
+
+    // Numeric conversions, printed as long long or long double
+    int floating = strchr("eEfFgGaA", conversion) != NULL;
+    char *end = "";
+    long long value = 0;
+    long double real = 0;
+    if (argument != NULL && (argument[0] == '\'' || argument[0] == '"'))
+    {
+        value = real = (unsigned char)argument[1];
+    }
+    else if (argument != NULL && floating)
+    {
+        real = strtold(argument, &end);
+    }
+    else if (argument != NULL)
+    {
+        value = strtoll(argument, &end, 0);
+    }
+
+    char wide[64];
+    size_t length = strlen(spec);
+    memcpy(wide, spec, length - 1);
+    strcpy(wide + length - 1, floating ? "L" : "ll");
+    length = strlen(wide);
+    wide[length] = conversion;
+    wide[length + 1] = '\0';
+    if (floating)
+    {
+        printf(wide, real);
+    }
+    else
+    {
+        printf(wide, value);
+    }
+
+    if (*end != '\0')
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", argument);
+        return 1;
+    }
+    return 0;
+}
+
+/*  printfUtility()
+    Functionality:
+            This function is the printf utility. It supports the %s %c %b %d %i %u %x %X %o %e %f %g %a (and their
+            upper case forms) and %% conversions with flags, width and precision, and the backslash escapes of
+            a printf format. The format is reused until all arguments have been printed. Any other conversion,
+            and \u or \U, is left to the printf program.
+    Parameters:
+            1.) cmd_args char array that holds the command(printf) at index [0], the format and the arguments
+    Returns:
+            Returns 0, 1 if an argument was not a valid number, 2 if the format is missing, or UTILITY_EXTERNAL.
+*/
+int printfUtility(char **cmd_args)
+{
+    if (cmd_args[1] == NULL)
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    char *format = cmd_args[1];
+    char **argument = cmd_args + 2;
+    int result = 0;
+
+    // Check every conversion before anything is printed, \u and \U depend on the locale
+    if (strstr(format, "\\u") != NULL || strstr(format, "\\U") != NULL)
+    {
+        return UTILITY_EXTERNAL;
+    }
+    for (char *c = strchr(format, '%'); c != NULL; c = strchr(c, '%'))
+    {
+        if (c[1] == '%')
+        {
+            c += 2;
+            continue;
+        }
+        int length = printfSpec(c);
+        if (length == 0)
+        {
+            return UTILITY_EXTERNAL;
+        }
+        c += length;
+    }
+
+    do
+    {
+        int used = 0;
+        int stop = 0;
+        for (char *c = format; *c != '\0' && !stop; c++)
+        {
+            if (*c == '\\')
+            {
+                c += printEscape(c + 1, &stop, 1);
+                continue;
+            }
+            if (*c != '%')
+            {
+                putchar(*c);
+                continue;
+            }
+            if (c[1] == '%')
+            {
+                putchar('%');
+                c++;
+                continue;
+            }
+
+            char spec[32];
+            int length = printfSpec(c);
+            memcpy(spec, c, length);
+            spec[length] = '\0';
+
+            result |= printfArgument(spec, c[length - 1], *argument, &stop);
+            if (*argument != NULL)
+            {
+                argument++;
+                used = 1;
+            }
+            c += length - 1;
+        }
+        if (stop || !used)
+        {
+            break;
+        }
+    } while (*argument != NULL);
+
+    return result;
+}
+
+/*  pwdUtility()
+    Functionality:
+            This function is the pwd utility and prints the current working directory.
+    Parameters:
+            1.) cmd_args char array that holds the command(pwd) at index [0]
+    Returns:
+            Returns 0, or 1 if the directory could not be read.
+*/
+int pwdUtility(char **cmd_args)
+{
+    char dir[4096];
+    if (getcwd(dir, sizeof(dir)) == NULL)
+    {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", dir);
+    return 0;
+}
+
+/*  trueUtility()
+    Functionality:
+            This function is the true utility.
+    Parameters:
+            1.) cmd_args char array that holds the command(true) at index [0]
+    Returns:
+            Returns 0.
+*/
+int trueUtility(char **cmd_args)
+{
+    return 0;
+}
+
+/*  falseUtility()
+    Functionality:
+            This function is the false utility.
+    Parameters:
+            1.) cmd_args char array that holds the command(false) at index [0]
+    Returns:
+            Returns 1.
+*/
+int falseUtility(char **cmd_args)
+{
+    return 1;
+}
+
+/*  testUnary()
+    Functionality:
+            This function evaluates a unary test such as -f file, -t fd or -z string.
+    Parameters:
+            1.) operator, e.g. "-f"
+            2.) operand
+    Returns:
+            Returns 1 if the test is true, 0 if it is false, or -1 if the operator is unknown.
+*/
+int testUnary(char *op, char *operand)
+{
+    struct stat info;
+    if (strcmp(op, "-z") == 0)
+    {
+        return operand[0] == '\0';
+    }
+    if (strcmp(op, "-n") == 0)
+    {
+        return operand[0] != '\0';
+    }
+    if (strlen(op) != 2 || strchr("edfrwxsLhbcpSgukGOt", op[1]) == NULL)
+    {
+        return -1;
+    }
+
+    switch (op[1])
+    {
+    case 'r': return access(operand, R_OK) == 0;
+    case 'w': return access(operand, W_OK) == 0;
+    case 'x': return access(operand, X_OK) == 0;
+    case 'L':
+    case 'h': return lstat(operand, &info) == 0 && S_ISLNK(info.st_mode);
+    case 't':
+    {
+        char *end;
+        long fd = strtol(operand, &end, 10);
+        return *operand != '\0' && *end == '\0' && fd >= 0 && fd <= 1024 && isatty(fd);
+    }
+    }
+
+    if (stat(operand, &info) != 0)
+    {
+        return 0;
+    }
+    switch (op[1])
+    {
+    case 'd': return S_ISDIR(info.st_mode);
+    case 'f': return S_ISREG(info.st_mode);
+    case 's': return info.st_size > 0;
+    case 'b': return S_ISBLK(info.st_mode);
+    case 'c': return S_ISCHR(info.st_mode);
+    case 'p': return S_ISFIFO(info.st_mode);
+    case 'S': return S_ISSOCK(info.st_mode);
+    case 'g': return (info.st_mode & S_ISGID) != 0;
+    case 'u': return (info.st_mode & S_ISUID) != 0;
+    case 'k': return (info.st_mode & S_ISVTX) != 0;
+    case 'G': return info.st_gid == getegid();
+    case 'O': return info.st_uid == geteuid();
+    default: return 1;
+    }
+}
+
+// Numeric comparisons of test, in the order testBinary() evaluates them
+static const char *numericOperators[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+
+/*  isBinaryOperator()
+    Functionality:
+            This function checks if a word is one of the binary operators of test.
+    Parameters:
+            1.) word
+    Returns:
+            Returns 1 if the word is a binary operator, otherwise 0.
+*/
+int isBinaryOperator(const char *word)
+{
+    if (strcmp(word, "=") == 0 || strcmp(word, "==") == 0 || strcmp(word, "!=") == 0 || strcmp(word, "-nt") == 0 ||
+        strcmp(word, "-ot") == 0 || strcmp(word, "-ef") == 0)
+    {
+        return 1;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        if (strcmp(word, numericOperators[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  testBinary()
+    Functionality:
+            This function evaluates a binary test such as a = b, 3 -lt 4 or file1 -nt file2.
+    Parameters:
+            1.) left operand
+            2.) operator
+            3.) right operand
+    Returns:
+            Returns 1 if the test is true, 0 if it is false, or -1 if the operator is unknown or a number is invalid.
+*/
+int testBinary(char *left, char *op, char *right)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+    {
+        return strcmp(left, right) == 0;
+    }
+    if (strcmp(op, "!=") == 0)
+    {
+        return strcmp(left, right) != 0;
+    }
+
+    // File comparisons, a file that does not exist is older than any file that does
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0)
+    {
+        struct stat a;
+        struct stat b;
+        int has_a = stat(left, &a) == 0;
+        int has_b = stat(right, &b) == 0;
+        if (op[1] == 'e')
+        {
+            return has_a && has_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        }
+        if (!has_a || !has_b)
+        {
+            return op[1] == 'n' ? has_a : has_b;
+        }
+        int newer = a.st_mtim.tv_sec != b.st_mtim.tv_sec ? a.st_mtim.tv_sec > b.st_mtim.tv_sec
+                                                         : a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+        int older = a.st_mtim.tv_sec != b.st_mtim.tv_sec ? a.st_mtim.tv_sec < b.st_mtim.tv_sec
+                                                         : a.st_mtim.tv_nsec < b.st_mtim.tv_nsec;
+        return op[1] == 'n' ? newer : older;
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (strcmp(op, numericOperators[i]) == 0)
+        {
+            char *left_end;
+            char *right_end;
+            long long a = strtoll(left, &left_end, 10);
+            long long b = strtoll(right, &right_end, 10);
+            // The test program reports the invalid number
+            if (*left == '\0' || *right == '\0' || *left_end != '\0' || *right_end != '\0')
+            {
+                return -1;
+            }
+            int results[] = {a == b, a != b, a < b, a <= b, a > b, a >= b};
+            return results[i];
+        }
+    }
+    return -1;
+}
+
+/*  testPrimary()
+    Functionality:
+            This function evaluates one primary of a test expression: ! primary, ( expression ), a binary test,
+            a unary test, or a single string (true if not empty).
+    Parameters:
+            1.) arguments of the expression
+            2.) Pointer to the index of the next argument, moved past the primary
+            3.) number of arguments
+    Returns:
+            Returns 1 if true, 0 if false, or -1 on a syntax error.
+*/
+int testExpression(char **args, int *pos, int count);
+int testPrimary(char **args, int *pos, int count)
+{
+    if (*pos >= count)
+    {
+        return -1;
+    }
+
+    char *word = args[*pos];
+    if (strcmp(word, "!") == 0)
+    {
+        (*pos)++;
+        int result = testPrimary(args, pos, count);
+        return result == -1 ? -1 : !result;
+    }
+    if (strcmp(word, "(") == 0)
+    {
+        (*pos)++;
+        int result = testExpression(args, pos, count);
+        if (*pos >= count || strcmp(args[*pos], ")") != 0)
+        {
+            return -1;
+        }
+        (*pos)++;
+        return result;
+    }
+
+    // "a op b" is tried before "-op a" so that e.g. "-n = -n" compares strings
+    if (*pos + 2 < count && isBinaryOperator(args[*pos + 1]))
+    {
+        int result = testBinary(word, args[*pos + 1], args[*pos + 2]);
+        *pos += 3;
+        return result;
+    }
+    if (word[0] == '-' && *pos + 1 < count)
+    {
+        int result = testUnary(word, args[*pos + 1]);
+        if (result != -1)
+        {
+            *pos += 2;
+            return result;
+        }
+    }
+
+    (*pos)++;
+    return word[0] != '\0';
+}
+
+/*  testExpression()
+    Functionality:
+            This function evaluates a test expression made of primaries joined with -a (and) and -o (or),
+            where -a binds tighter than -o.
+    Parameters:
+            1.) arguments of the expression
+            2.) Pointer to the index of the next argument, moved past the expression
+            3.) number of arguments
+    Returns:
+            Returns 1 if true, 0 if false, or -1 on a syntax error.
+*/
+int testExpression(char **args, int *pos, int count)
+{
+    int result = 0;
+    int any = 0;
+    while (1)
+    {
+        // Evaluate one -a chain
+        int chain = 1;
+        while (1)
+        {
+            int primary = testPrimary(args, pos, count);
+            if (primary == -1)
+            {
+                return -1;
+            }
+            chain = chain && primary;
+            if (*pos < count && strcmp(args[*pos], "-a") == 0)
+            {
+                (*pos)++;
+                continue;
+            }
+            break;
+        }
+        any = any || chain;
+        result = any;
+
+        if (*pos < count && strcmp(args[*pos], "-o") == 0)
+        {
+            (*pos)++;
+            continue;
+        }
+        return result;
+    }
+}
+
+/*  testUtility()
+    Functionality:
+            This function is the test utility, also called as [ in which case the last argument must be ].
+            An expression it can not evaluate, a syntax error or an invalid number, is left to the test program,
+            which reports it.
+    Parameters:
+            1.) cmd_args char array that holds the command(test or [) at index [0] and the expression after it
+    Returns:
+            Returns 0 if the expression is true, 1 if it is false, or UTILITY_EXTERNAL.
+*/
+int testUtility(char **cmd_args)
+{
+    int count = 0;
+    while (cmd_args[count + 1] != NULL)
+    {
+        count++;
+    }
+    char **args = cmd_args + 1;
+
+    if (strcmp(cmd_args[0], "[") == 0)
+    {
+        if (count == 0 || strcmp(args[count - 1], "]") != 0)
+        {
+            return UTILITY_EXTERNAL;
+        }
+        count--;
+    }
+
+    // No expression is false
+    if (count == 0)
+    {
+        return 1;
+    }
+
+    int pos = 0;
+    int result = testExpression(args, &pos, count);
+    if (result == -1 || pos != count)
+    {
+        return UTILITY_EXTERNAL;
+    }
+    return result ? 0 : 1;
+}
+
+/*  signalNumber()
+    Functionality:
+            This function converts a signal name (TERM, SIGTERM) or number to a signal number.
+    Parameters:
+            1.) signal name or number
+    Returns:
+            Returns the signal number, or -1 if the name is unknown.
+*/
+int signalNumber(char *name)
+{
+    static const struct
+    {
+        const char *name;
+        int number;
+    } signals[] = {
+        {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+        {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CHLD", SIGCHLD},
+        {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP},
+    };
+
+    if (name[0] >= '0' && name[0] <= '9')
+    {
+        return atoi(name);
+    }
+    if (strncasecmp(name, "SIG", 3) == 0)
+    {
+        name += 3;
+    }
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+    {
+        if (strcasecmp(name, signals[i].name) == 0)
+        {
+            return signals[i].number;
+        }
+    }
+    return -1;
+}
+
+/*  killUtility()
+    Functionality:
+            This function is the kill utility: kill [-SIGNAL | -s SIGNAL] pid...
+            The default signal is SIGTERM. Other options (-l, -L) and signal names it does not know are left to
+            the kill program.
+    Parameters:
+            1.) cmd_args char array that holds the command(kill) at index [0], the signal and the process IDs
+    Returns:
+            Returns 0 if every signal was sent, 1 if one failed, 2 on a usage error, or UTILITY_EXTERNAL.
+*/
+int killUtility(char **cmd_args)
+{
+    int sig = SIGTERM;
+    int i = 1;
+
+    if (cmd_args[i] != NULL && strcmp(cmd_args[i], "-s") == 0 && cmd_args[i + 1] != NULL)
+    {
+        sig = signalNumber(cmd_args[i + 1]);
+        i += 2;
+    }
+    else if (cmd_args[i] != NULL && cmd_args[i][0] == '-' && cmd_args[i][1] != '\0')
+    {
+        sig = signalNumber(cmd_args[i] + 1);
+        i++;
+    }
+
+    if (sig == -1)
+    {
+        return UTILITY_EXTERNAL;
+    }
+    if (cmd_args[i] == NULL)
+    {
+        fprintf(stderr, "kill: usage: kill [-s signal | -signal] pid...\n");
+        return 2;
+    }
+
+    int result = 0;
+    for (; cmd_args[i] != NULL; i++)
+    {
+        char *end;
+        long pid = strtol(cmd_args[i], &end, 10);
+        if (*end != '\0' || end == cmd_args[i])
+        {
+            fprintf(stderr, "kill: %s: arguments must be process IDs\n", cmd_args[i]);
+            result = 1;
+        }
+        else if (kill((pid_t)pid, sig) == -1)
+        {
+            fprintf(stderr, "kill: (%ld): %s\n", pid, strerror(errno));
+            result = 1;
+        }
+    }
+    return result;
+}
+
+#endif
@@ -0,0 +1,597 @@
+/*
+    This file contains the shell variables. Variables live in an open-addressing hash table (linear probing,
+    power-of-two size) that is filled from the environment at startup. Exported variables make up the
+    environment of the commands the shell starts. The envp array is built once and kept in environ until an
+    exported variable changes. startCommand() in spawn.h calls refreshEnvironment() before every command, so
+    a change made anywhere (a loop variable, read, a function) reaches the next child, and the rebuild only
+    happens when there was a change.
+
+    The lexer expands $NAME, ${NAME}, $$ (process ID of the shell), $? (exit code of the last command),
+    $! (process ID of the last background command) and the arguments of the running shell function: $0 to $9,
+    $# (number of arguments) and $@ or $* (all arguments joined by spaces). The value is inserted as is, it is
+    not split into words.
+
+    Usage:
+        NAME=value ...              set shell variables (when every word of the command is an assignment)
+        export [NAME[=value] ...]   export variables, or list the exported variables
+        unset NAME ...              remove variables
+
+    There are fourteen functions in this file:
+        1.) findSlot()
+        2.) growVariables()
+        3.) getVariable()
+        4.) setVariable()
+        5.) unsetVariable()
+        6.) refreshEnvironment()
+        7.) initVariables()
+        8.) variableNameLength()
+        9.) specialVariable()
+        10.) expandVariable()
+        11.) isAssignmentList()
+        12.) assignCommand()
+        13.) exportCommand()
+        14.) unsetCommand()
+*/
+
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "path_cache.h"
+
+// Initial number of slots, always a power of two
+#define VARIABLE_SLOTS 256
+
+extern char **environ;
+
+/*
+    Data Members:
+        name: (string) ->       variable name
+        entry: (string) ->      "NAME=value", the string put into the environment
+        value: (string) ->      value, points into entry
+        exported: (int) ->      1 if the variable is passed to commands
+        published: (int) ->     1 if entry is in cachedEnvironment, so it can not be freed before the next rebuild
+*/
+struct Variable
+{
+    char *name;
+    char *entry;
+    char *value;
+    int exported;
+    int published;
+};
+
+// Marks a slot whose variable was removed, probing continues past it
+struct Variable deletedVariable;
+
+struct Variable **variableTable = NULL;
+size_t variableSlots = 0;
+size_t variablesUsed = 0;
+
+// Environment built from the exported variables, rebuilt only when environmentChanged is set
+char **cachedEnvironment = NULL;
+int environmentChanged = 1;
+
+// Entries that are still in cachedEnvironment, freed once it has been rebuilt
+char **retiredEntries = NULL;
+size_t retiredCount = 0;
+
+// Sources of $? and $!
+int *exitStatusVariable = NULL;
+pid_t lastBackgroundPid = 0;
+
+// Arguments of the running shell function, set by callFunction() in script.h, and $@ joined by spaces
+char **positionalArgs = NULL;
+int positionalCount = 0;
+char *positionalJoined = NULL;
+
+/*  findSlot()
+    Functionality:
+            This function finds the slot of a name, or the slot a new variable with that name would go to.
+    Parameters:
+            1.) name
+            2.) length of the name
+    Returns:
+            Returns the index of the slot.
+*/
+size_t findSlot(const char *name, size_t length)
+{
+    size_t mask = variableSlots - 1;
+    size_t slot = hashBytes(name, length) & mask;
+    size_t free_slot = (size_t)-1;
+
+    while (variableTable[slot] != NULL)
+    {
+        struct Variable *variable = variableTable[slot];
+        if (variable == &deletedVariable)
+        {
+            if (free_slot == (size_t)-1)
+            {
+                free_slot = slot;
+            }
+        }
+        else if (strncmp(variable->name, name, length) == 0 && variable->name[length] == '\0')
+        {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return free_slot != (size_t)-1 ? free_slot : slot;
+}
+
+/*  growVariables()
+    Functionality:
+            This function doubles the table (or creates it) and inserts every variable again, which also drops
+            the deleted markers.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void growVariables()
+{
+    struct Variable **old = variableTable;
+    size_t old_slots = variableSlots;
+
+    variableSlots = old_slots == 0 ? VARIABLE_SLOTS : old_slots * 2;
+    variableTable = calloc(variableSlots, sizeof(struct Variable *));
+    variablesUsed = 0;
+
+    for (size_t i = 0; i < old_slots; i++)
+    {
+        if (old[i] != NULL && old[i] != &deletedVariable)
+        {
+            variableTable[findSlot(old[i]->name, strlen(old[i]->name))] = old[i];
+            variablesUsed++;
+        }
+    }
+    free(old);
+}
+
+/*  getVariable()
+    Functionality:
+            This function looks up a variable.
+    Parameters:
+            1.) name
+            2.) length of the name
+    Returns:
+            Returns the Variable struct, or NULL if the variable is not set.
+*/
+struct Variable *getVariable(const char *name, size_t length)
+{
+    if (variableTable == NULL)
+    {
+        return NULL;
+    }
+    struct Variable *variable = variableTable[findSlot(name, length)];
+    return variable != &deletedVariable ? variable : NULL;
+}
+
+/*  setVariable()
+    Functionality:
+            This function sets a variable, creating it if needed. A changed exported variable marks the
+            environment for rebuilding.
+    Parameters:
+            1.) name
+            2.) value
+            3.) 1 to export the variable, 0 to keep its current export flag
+    Returns:
+            Does not return anything.
+*/
+void setVariable(const char *name, const char *value, int exported)
+{
+    size_t name_length = strlen(name);
+    if (variableTable == NULL || (variablesUsed + 1) * 10 > variableSlots * 7)
+    {
+        growVariables();
+    }
+
+    size_t slot = findSlot(name, name_length);
+    struct Variable *variable = variableTable[slot];
+    if (variable == NULL || variable == &deletedVariable)
+    {
+        variable = calloc(1, sizeof(struct Variable));
+        variable->name = strdup(name);
+        variableTable[slot] = variable;
+        variablesUsed++;
+    }
+    else if (variable->published)
+    {
+        // The old entry is still in environ, an entry set since the last rebuild is not and is freed at once
+        retiredEntries = realloc(retiredEntries, (retiredCount + 1) * sizeof(char *));
+        retiredEntries[retiredCount++] = variable->entry;
+    }
+    else
+    {
+        free(variable->entry);
+    }
+
+    size_t value_length = strlen(value);
+    variable->entry = malloc(name_length + value_length + 2);
+    memcpy(variable->entry, name, name_length);
+    variable->entry[name_length] = '=';
+    memcpy(variable->entry + name_length + 1, value, value_length + 1);
+    variable->value = variable->entry + name_length + 1;
+    variable->published = 0;
+    variable->exported |= exported;
+
+    if (variable->exported)
+    {
+        environmentChanged = 1;
+    }
+}
+
+/*  unsetVariable()
+    Functionality:
+            This function removes a variable.
+    Parameters:
+            1.) name
+    Returns:
+            Does not return anything.
+*/
+void unsetVariable(const char *name)
+{
+    if (variableTable == NULL)
+    {
+        return;
+    }
+    size_t slot = findSlot(name, strlen(name));
+    struct Variable *variable = variableTable[slot];
+    if (variable == NULL || variable == &deletedVariable)
+    {
+        return;
+    }
+
+    if (variable->exported)
+    {
+        environmentChanged = 1;
+    }
+    if (variable->published)
+    {
+        retiredEntries = realloc(retiredEntries, (retiredCount + 1) * sizeof(char *));
+        retiredEntries[retiredCount++] = variable->entry;
+    }
+    else
+    {
+        free(variable->entry);
+    }
+    free(variable->name);
+    free(variable);
+    variableTable[slot] = &deletedVariable;
+}
+
+/*  refreshEnvironment()
+    Functionality:
+            This function rebuilds the envp array from the exported variables if one of them changed, and
+            points environ at it so that posix_spawn(), execvp() and getenv() all see the same environment.
+    Parameters:
+            N/A
+    Returns:
+            Does not return anything.
+*/
+void refreshEnvironment()
+{
+    if (!environmentChanged)
+    {
+        return;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < variableSlots; i++)
+    {
+        if (variableTable[i] != NULL && variableTable[i] != &deletedVariable && variableTable[i]->exported)
+        {
+            count++;
+        }
+    }
+
+    char **envp = malloc((count + 1) * sizeof(char *));
+    count = 0;
+    for (size_t i = 0; i < variableSlots; i++)
+    {
+        if (variableTable[i] != NULL && variableTable[i] != &deletedVariable && variableTable[i]->exported)
+        {
+            envp[count++] = variableTable[i]->entry;
+            variableTable[i]->published = 1;
+        }
+    }
+    envp[count] = NULL;
+
+    environ = envp;
+    free(cachedEnvironment);
+    cachedEnvironment = envp;
+    environmentChanged = 0;
+
+    for (size_t i = 0; i < retiredCount; i++)
+    {
+        free(retiredEntries[i]);
+    }
+    free(retiredEntries);
+    retiredEntries = NULL;
+    retiredCount = 0;
+}
+
+/*  initVariables()
+    Functionality:
+            This function imports the environment into the table as exported variables.
+    Parameters:
+            1.) Pointer to the int that holds the exit status, used for $?
+    Returns:
+            Does not return anything.
+*/
+void initVariables(int *exitStatus)
+{
+    exitStatusVariable = exitStatus;
+    for (char **env = environ; *env != NULL; env++)
+    {
+        char *equals = strchr(*env, '=');
+        if (equals == NULL)
+        {
+            continue;
+        }
+        char *name = strndup(*env, equals - *env);
+        setVariable(name, equals + 1, 1);
+        free(name);
+    }
+    refreshEnvironment();
+}
+
+/*  variableNameLength()
+    Functionality:
+            This function returns the length of the variable name at the start of text ([A-Za-z_][A-Za-z0-9_]*).
+    Parameters:
+            1.) text
+            2.) number of bytes left in text
+    Returns:
+            Returns the length of the name, 0 if text does not start with a name.
+*/
+size_t variableNameLength(const char *text, size_t length)
+{
+    size_t i = 0;
+    while (i < length && (text[i] == '_' || (text[i] >= 'A' && text[i] <= 'Z') || (text[i] >= 'a' && text[i] <= 'z') ||
+                          (i > 0 && text[i] >= '0' && text[i] <= '9')))
+    {
+        i++;
+    }
+    return i;
+}
+
+/*  specialVariable()
+    Functionality:
+            This function returns the value of $?, $!, $$, $#, $@, $* or $0 to $9.
+    Parameters:
+            1.) the character after the $
+            2.) process ID of the shell as a string
+            3.) buffer of at least 32 bytes for values that are formatted
+    Returns:
+            Returns the value, either in the buffer or a string owned by the shell.
+*/
+const char *specialVariable(char which, const char *process_id, char *buffer)
+{
+    if (which == '$')
+    {
+        return strcpy(buffer, process_id);
+    }
+    if (which == '!')
+    {
+        if (lastBackgroundPid == 0)
+        {
+            buffer[0] = '\0';
+        }
+        else
+        {
+            sprintf(buffer, "%d", lastBackgroundPid);
+        }
+        return buffer;
+    }
+    if (which == '#')
+    {
+        sprintf(buffer, "%d", positionalCount > 0 ? positionalCount - 1 : 0);
+        return buffer;
+    }
+    if (which == '@' || which == '*')
+    {
+        return positionalJoined != NULL ? positionalJoined : "";
+    }
+    if (which >= '0' && which <= '9')
+    {
+        if (which == '0' && positionalCount == 0)
+        {
+            return "smallsh";
+        }
+        return which - '0' < positionalCount ? positionalArgs[which - '0'] : "";
+    }
+
+    int status = exitStatusVariable != NULL ? *exitStatusVariable : 0;
+    sprintf(buffer, "%d", WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status));
+    return buffer;
+}
+
+/*  expandVariable()
+    Functionality:
+            This function handles a $ found in the line. $$, $?, $!, the function arguments, $NAME and ${NAME}
+            are replaced by their value (unset variables by nothing), any other $ is kept as it is. With out set to NULL nothing is
+            written and only the size of the expansion is returned, which the lexer uses to size its buffer.
+    Parameters:
+            1.) line being tokenized
+            2.) length of the line
+            3.) Pointer to the offset of the $, moved past what was consumed
+            4.) Pointer to the output position, moved past what was written, or NULL
+            5.) process ID of the shell as a string
+    Returns:
+            Returns the number of bytes the $ expands to.
+*/
+size_t expandVariable(const char *line, size_t length, size_t *pos, char **out, const char *process_id)
+{
+    const char *value = "$";
+    size_t value_length = 1;
+    size_t used = 1;
+    char buffer[32];
+    size_t start = *pos + 1;
+
+    if (start < length && line[start] != '\0' && strchr("$?!#@*0123456789", line[start]) != NULL)
+    {
+        value = specialVariable(line[start], process_id, buffer);
+        value_length = strlen(value);
+        used = 2;
+    }
+    else if (start < length && line[start] == '{')
+    {
+        const char *close = memchr(line + start, '}', length - start);
+        if (close != NULL)
+        {
+            size_t name_length = close - (line + start + 1);
+            struct Variable *variable = NULL;
+            if (name_length == 1 && line[start + 1] != '\0' && strchr("$?!#@*0123456789", line[start + 1]) != NULL)
+            {
+                value = specialVariable(line[start + 1], process_id, buffer);
+            }
+            else
+            {
+                variable = getVariable(line + start + 1, name_length);
+                value = variable != NULL ? variable->value : "";
+            }
+            value_length = strlen(value);
+            used = name_length + 3;
+        }
+    }
+    else
+    {
+        size_t name_length = variableNameLength(line + start, length - start);
+        if (name_length > 0)
+        {
+            struct Variable *variable = getVariable(line + start, name_length);
+            value = variable != NULL ? variable->value : "";
+            value_length = strlen(value);
+            used = name_length + 1;
+        }
+    }
+
+    if (out != NULL)
+    {
+        memcpy(*out, value, value_length);
+        *out += value_length;
+    }
+    *pos += used;
+    return value_length;
+}
+
+/*  isAssignmentList()
+    Functionality:
+            This function checks if every word of a command has the form NAME=value.
+    Parameters:
+            1.) cmd_args char array of the command
+    Returns:
+            Returns 1 if the command is made only of assignments, otherwise 0.
+*/
+int isAssignmentList(char **cmd_args)
+{
+    for (int i = 0; cmd_args[i] != NULL; i++)
+    {
+        size_t name_length = variableNameLength(cmd_args[i], strlen(cmd_args[i]));
+        if (name_length == 0 || cmd_args[i][name_length] != '=')
+        {
+            return 0;
+        }
+    }
+    return cmd_args[0] != NULL;
+}
+
+/*  assignCommand()
+    Functionality:
+            This function sets the shell variables of a command made only of NAME=value words. The export flag
+            of an existing variable is kept.
+    Parameters:
+            1.) cmd_args char array of assignments
+    Returns:
+            Returns 0.
+*/
+int assignCommand(char **cmd_args)
+{
+    for (int i = 0; cmd_args[i] != NULL; i++)
+    {
+        char *equals = strchr(cmd_args[i], '=');
+        *equals = '\0';
+        setVariable(cmd_args[i], equals + 1, 0);
+        *equals = '=';
+    }
+    refreshEnvironment();
+    return 0;
+}
+
+/*  exportCommand()
+    Functionality:
+            This function is the export built in. "export NAME=value" sets and exports a variable, "export NAME"
+            exports an existing one, and "export" alone lists the exported variables.
+    Parameters:
+            1.) cmd_args char array that holds the command(export) at index [0] and the variables after it
+    Returns:
+            Returns 0, or 1 if a name is not valid.
+*/
+int exportCommand(char **cmd_args)
+{
+    int result = 0;
+    if (cmd_args[1] == NULL)
+    {
+        for (char **env = environ; *env != NULL; env++)
+        {
+            printf("export %s\n", *env);
+        }
+        return 0;
+    }
+
+    for (int i = 1; cmd_args[i] != NULL; i++)
+    {
+        size_t name_length = variableNameLength(cmd_args[i], strlen(cmd_args[i]));
+        if (name_length == 0 || (cmd_args[i][name_length] != '=' && cmd_args[i][name_length] != '\0'))
+        {
+            fprintf(stderr, "export: `%s': not a valid identifier\n", cmd_args[i]);
+            result = 1;
+        }
+        else if (cmd_args[i][name_length] == '=')
+        {
+            cmd_args[i][name_length] = '\0';
+            setVariable(cmd_args[i], cmd_args[i] + name_length + 1, 1);
+            cmd_args[i][name_length] = '=';
+        }
+        else
+        {
+            struct Variable *variable = getVariable(cmd_args[i], name_length);
+            if (variable == NULL)
+            {
+                setVariable(cmd_args[i], "", 1);
+            }
+            else if (!variable->exported)
+            {
+                variable->exported = 1;
+                environmentChanged = 1;
+            }
+        }
+    }
+    refreshEnvironment();
+    return result;
+}
+
+/*  unsetCommand()
+    Functionality:
+            This function is the unset built in and removes every variable named after it.
+    Parameters:
+            1.) cmd_args char array that holds the command(unset) at index [0] and the names after it
+    Returns:
+            Returns 0.
+*/
+int unsetCommand(char **cmd_args)
+{
+    for (int i = 1; cmd_args[i] != NULL; i++)
+    {
+        unsetVariable(cmd_args[i]);
+    }
+    refreshEnvironment();
+    return 0;
+}
+
+#endif